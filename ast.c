@@ -8,6 +8,9 @@
 #include "codegen.h"
 #include "graphgen.h"
 #include "list.h"
+#include "type_array.h"
+#include "type_vector.h"
+#include "type_map.h"
 
 void ast_expr_node_free(expr_node_t* node) {
   if (node->free_fun == NULL) {
@@ -133,7 +136,31 @@ void ast_bin_op_node_free(bin_op_node_t* node) {
  * float < int = boolean
  */
 
+// both Boolean, or both Boolean vectors of the same width (lane masks)
+bool ast_is_boolean(type_t* lhs, type_t* rhs) {
+  if (!type_equals(lhs, rhs)) return false;
+  if (lhs->kind == TYPE_KIND_VECTOR) {
+    return type_name_is(type_vector_element(lhs), "Boolean");
+  }
+  return type_name_is(lhs, "Boolean");
+}
+
 bin_op_node_t* ast_bin_op_node_init(context_t* context, bin_op_t op, expr_node_t* lhs, expr_node_t* rhs) {
+  if (op == BIN_OP_ASSIGN && lhs->node_type == NODE_IDENT) {
+    symbol_t* symbol = symbol_get(context->symbol_table, ((ident_node_t*)lhs)->name);
+    if (symbol) {
+      symbol->is_assigned = true;
+    }
+  }
+  if (op == BIN_OP_ASSIGN && lhs->node_type == NODE_INDEX &&
+      ((index_node_t*)lhs)->array->type->kind == TYPE_KIND_VECTOR) {
+    fprintf(stderr, "Vector lanes cannot be assigned; build a new vector instead\n");
+    return NULL;
+  }
+  if ((op == BIN_OP_AND || op == BIN_OP_OR) && !ast_is_boolean(lhs->type, rhs->type)) {
+    fprintf(stderr, "Logical operators need Boolean operands, got %s and %s\n", lhs->type->name, rhs->type->name);
+    return NULL;
+  }
   bin_op_node_t* node = (bin_op_node_t*)malloc(sizeof(bin_op_node_t));
   node->node_type = NODE_BINARY_OP;
   node->codegen_fun = codegen_bin_op;
@@ -143,6 +170,13 @@ bin_op_node_t* ast_bin_op_node_init(context_t* context, bin_op_t op, expr_node_t
   type_t* type_float = type_get(context->type_sys, "Float");
   if (type_equals(lhs->type, rhs->type)) {
     node->type = lhs->type;
+  } else if (op != BIN_OP_ASSIGN && lhs->type->kind == TYPE_KIND_VECTOR &&
+      type_equals(type_vector_element(lhs->type), rhs->type)) {
+    // the scalar is broadcast to every lane
+    node->type = lhs->type;
+  } else if (op != BIN_OP_ASSIGN && rhs->type->kind == TYPE_KIND_VECTOR &&
+      type_equals(type_vector_element(rhs->type), lhs->type)) {
+    node->type = rhs->type;
   } else if ((type_equals(lhs->type, type_int) || type_equals(lhs->type, type_float)) &&
       (type_equals(rhs->type, type_int) || type_equals(rhs->type, type_float))) {
     node->type = type_float;
@@ -152,7 +186,13 @@ bin_op_node_t* ast_bin_op_node_init(context_t* context, bin_op_t op, expr_node_t
   }
   if (op == BIN_OP_EQ || op == BIN_OP_GT || op == BIN_OP_LT ||
       op == BIN_OP_GTE || op == BIN_OP_LTE) {
-    node->type = type_get(context->type_sys, "Boolean");
+    if (node->type->kind == TYPE_KIND_VECTOR) {
+      // lane-wise comparisons give a mask
+      node->type = type_vector_get(context->type_sys, type_vector_width(node->type),
+          type_get(context->type_sys, "Boolean"));
+    } else {
+      node->type = type_get(context->type_sys, "Boolean");
+    }
   }
   node->op = op;
   node->lhs = lhs;
@@ -166,6 +206,10 @@ void ast_unary_op_node_free(unary_op_node_t* node) {
 }
 
 unary_op_node_t* ast_unary_op_node_init(context_t* context, unary_op_t op, expr_node_t* rhs) {
+  if (op == UNARY_OP_NOT && !ast_is_boolean(rhs->type, rhs->type)) {
+    fprintf(stderr, "! needs a Boolean operand, got %s\n", rhs->type->name);
+    return NULL;
+  }
   unary_op_node_t* node = (unary_op_node_t*)malloc(sizeof(unary_op_node_t));
   node->node_type = NODE_UNARY_OP;
   node->codegen_fun = codegen_unary_op;
@@ -195,11 +239,17 @@ fun_call_node_t* ast_fun_call_node_init(context_t* context, char* name, list_t*
     return NULL;
   }
   if (!type_equals(symbol->type, type_get(context->type_sys, "Function"))) {
-    fprintf(stderr, "%s is not a function\n", node->name);
+    fprintf(stderr, "%s is not a function\n", name);
+    return NULL;
+  }
+  // a Function parameter takes whatever the block bound to it does
+  if (!symbol->is_param && symbol->num_params != params->size) {
+    fprintf(stderr, "wrong number of parameters calling %s. Expected %zd, got %zd\n", name, symbol->num_params, params->size);
     return NULL;
   }
-  if (symbol->num_params != params->size) {
-    fprintf(stderr, "wrong number of parameters calling %s. Expected %zd, got %zd\n", node->name, symbol->num_params, params->size);
+  if (symbol->ret_type == NULL) {
+    // only happens for a call to the block currently being parsed
+    fprintf(stderr, "Recursive call to %s needs the block's return type, e.g. { (i:Integer):Integer ... }\n", name);
     return NULL;
   }
 
@@ -207,6 +257,10 @@ fun_call_node_t* ast_fun_call_node_init(context_t* context, char* name, list_t*
   printf("function call returns: %s\n", type_to_string(node->type));
   node->name = strdup(name);
   node->params = params;
+  node->tail = false;
+  node->inline_block = NULL;
+  node->spawn = false;
+  node->profile_slot = context->profile_slots++;
   return node;
 }
 
@@ -214,6 +268,7 @@ void ast_block_node_free(block_node_t* node) {
   ast_expr_list_node_free(node->body);
   list_visit(node->params, (void(*)(void*))ast_expr_node_free);
   list_free(node->params);
+  list_free(node->captures);
   free(node);
 }
 
@@ -226,9 +281,56 @@ block_node_t* ast_block_node_init(context_t* context, list_t* param_list, expr_l
   node->type = type_get(context->type_sys, "Function");
   node->body = fun_body;
   node->params = param_list;
+  node->always_inline = false;
+  node->captures = list_init();
+  node->env_escapes = false;
+  node->memo_size = 0;
+  node->fast_math = FAST_MATH_NONE;
+  node->overflow = OVERFLOW_DEFAULT;
+  node->profile_slot = context->profile_slots++;
+  node->effects = EFFECT_UNKNOWN;
+  node->effects_depth = 0;
+  ast_mark_tail_calls((expr_node_t*)fun_body);
   return node;
 }
 
+// marks the calls whose result is returned straight from the block
+void ast_mark_tail_calls(expr_node_t* node) {
+  if (node == NULL) return;
+  switch (node->node_type) {
+    case NODE_EXPR_LIST: {
+      list_item_t* iter = list_iter_init(((expr_list_node_t*)node)->expressions);
+      for (; iter && list_iter(iter); iter = list_iter(iter));
+      if (iter) {
+        ast_mark_tail_calls(iter->val);
+      }
+      break;
+    }
+    case NODE_IF: {
+      if_node_t* if_node = (if_node_t*)node;
+      ast_mark_tail_calls((expr_node_t*)if_node->true_expr);
+      ast_mark_tail_calls((expr_node_t*)if_node->false_expr);
+      break;
+    }
+    case NODE_MATCH: {
+      match_node_t* match_node = (match_node_t*)node;
+      list_item_t* iter = list_iter_init(match_node->arms);
+      for (; iter; iter = list_iter(iter)) {
+        match_arm_t* arm = iter->val;
+        ast_mark_tail_calls((expr_node_t*)arm->body);
+      }
+      ast_mark_tail_calls((expr_node_t*)match_node->default_expr);
+      break;
+    }
+    case NODE_FUN_CALL:
+      printf("Tail call to %s\n", ((fun_call_node_t*)node)->name);
+      ((fun_call_node_t*)node)->tail = true;
+      break;
+    default:
+      break;
+  }
+}
+
 void ast_fun_param_node_free(fun_param_node_t* param) {
   free(param->name);
   free(param);
@@ -265,5 +367,635 @@ if_node_t* ast_if_node_init(context_t* context, expr_node_t* conditional, expr_l
   node->conditional = conditional;
   node->true_expr = true_expr;
   node->false_expr = false_expr;
+  node->profile_slot = context->profile_slots;
+  context->profile_slots += 2;
   return node;
 }
+
+void ast_while_node_free(while_node_t* node) {
+  ast_expr_node_free(node->conditional);
+  ast_expr_list_node_free(node->body);
+  free(node);
+}
+
+while_node_t* ast_while_node_init(context_t* context, expr_node_t* conditional, expr_list_node_t* body) {
+  if (!type_name_is(conditional->type, "Boolean")) {
+    fprintf(stderr, "while needs a Boolean condition, got %s\n", type_to_string(conditional->type));
+    return NULL;
+  }
+  while_node_t* node = (while_node_t*)malloc(sizeof(while_node_t));
+  node->node_type = NODE_WHILE;
+  node->codegen_fun = codegen_while;
+  node->graphgen_fun = graphgen_while;
+  node->free_fun = ast_while_node_free;
+  node->type = type_get(context->type_sys, "Integer");
+  node->conditional = conditional;
+  node->body = body;
+  return node;
+}
+
+void ast_for_node_free(for_node_t* node) {
+  free(node->name);
+  ast_expr_node_free(node->start);
+  ast_expr_node_free(node->end);
+  ast_expr_list_node_free(node->body);
+  free(node);
+}
+
+for_node_t* ast_for_node_init(context_t* context, char* name, expr_node_t* start, expr_node_t* end, expr_list_node_t* body) {
+  if (!type_name_is(start->type, "Integer") || !type_name_is(end->type, "Integer")) {
+    fprintf(stderr, "for %s needs an Integer range, got %s .. %s\n", name, type_to_string(start->type), type_to_string(end->type));
+    return NULL;
+  }
+  for_node_t* node = (for_node_t*)malloc(sizeof(for_node_t));
+  node->node_type = NODE_FOR;
+  node->codegen_fun = codegen_for;
+  node->graphgen_fun = graphgen_for;
+  node->free_fun = ast_for_node_free;
+  node->type = type_get(context->type_sys, "Integer");
+  node->name = name;
+  node->start = start;
+  node->end = end;
+  node->body = body;
+  return node;
+}
+
+void ast_variant_node_free(variant_node_t* node) {
+  if (node->payload) {
+    ast_expr_node_free(node->payload);
+  }
+  free(node);
+}
+
+variant_node_t* ast_variant_node_init(context_t* context, type_t* union_type, type_member_t* variant, expr_node_t* payload) {
+  if (variant->type && (payload == NULL || !type_equals(payload->type, variant->type))) {
+    fprintf(stderr, "Variant %s of %s takes a %s\n", variant->name, type_to_string(union_type), type_to_string(variant->type));
+    return NULL;
+  }
+  if (variant->type == NULL && payload != NULL) {
+    fprintf(stderr, "Variant %s of %s takes no value\n", variant->name, type_to_string(union_type));
+    return NULL;
+  }
+  variant_node_t* node = (variant_node_t*)malloc(sizeof(variant_node_t));
+  node->node_type = NODE_VARIANT;
+  node->codegen_fun = codegen_variant;
+  node->graphgen_fun = graphgen_variant;
+  node->free_fun = ast_variant_node_free;
+  node->type = union_type;
+  node->variant = variant;
+  node->payload = payload;
+  return node;
+}
+
+void ast_match_arm_free(match_arm_t* arm) {
+  ast_expr_list_node_free(arm->body);
+  free(arm->binding);
+  if (arm->cases) {
+    list_visit(arm->cases, free);
+    list_free(arm->cases);
+  }
+  free(arm);
+}
+
+match_arm_t* ast_match_arm_init(context_t* context, type_member_t* variant, char* binding, expr_list_node_t* body) {
+  match_arm_t* arm = (match_arm_t*)malloc(sizeof(match_arm_t));
+  arm->variant = variant;
+  arm->cases = NULL;
+  arm->binding = binding;
+  arm->body = body;
+  return arm;
+}
+
+match_arm_t* ast_match_int_arm_init(context_t* context, list_t* cases, expr_list_node_t* body) {
+  match_arm_t* arm = ast_match_arm_init(context, NULL, NULL, body);
+  arm->cases = cases;
+  return arm;
+}
+
+// the first value two arms (or one arm twice) both match, in *overlap
+bool ast_match_cases_overlap(list_t* arms, long* overlap) {
+  list_item_t* arm_iter = list_iter_init(arms);
+  for (; arm_iter; arm_iter = list_iter(arm_iter)) {
+    list_item_t* case_iter = list_iter_init(((match_arm_t*)arm_iter->val)->cases);
+    for (; case_iter; case_iter = list_iter(case_iter)) {
+      match_case_t* a = case_iter->val;
+      // every case before this one, in this arm and the ones before it
+      list_item_t* prev_arm = list_iter_init(arms);
+      for (; prev_arm != list_iter(arm_iter); prev_arm = list_iter(prev_arm)) {
+        list_item_t* prev = list_iter_init(((match_arm_t*)prev_arm->val)->cases);
+        for (; prev && prev != case_iter; prev = list_iter(prev)) {
+          match_case_t* b = prev->val;
+          if (a->lo <= b->hi && b->lo <= a->hi) {
+            *overlap = a->lo > b->lo ? a->lo : b->lo;
+            return true;
+          }
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void ast_match_node_free(match_node_t* node) {
+  ast_expr_node_free(node->subject);
+  list_visit(node->arms, (void(*)(void*))ast_match_arm_free);
+  list_free(node->arms);
+  if (node->default_expr) {
+    ast_expr_list_node_free(node->default_expr);
+  }
+  free(node);
+}
+
+match_node_t* ast_match_node_init(context_t* context, expr_node_t* subject, list_t* arms, expr_list_node_t* default_expr) {
+  type_t* type = default_expr ? default_expr->type : NULL;
+  size_t covered = 0;
+  list_item_t* iter = list_iter_init(arms);
+  for (; iter; iter = list_iter(iter)) {
+    match_arm_t* arm = iter->val;
+    if (type == NULL) {
+      type = arm->body->type;
+    } else if (!type_equals(type, arm->body->type)) {
+      fprintf(stderr, "Match arm %s returns %s, expected %s\n", arm->variant ? arm->variant->name : "", type_to_string(arm->body->type), type_to_string(type));
+      return NULL;
+    }
+    list_item_t* prev = list_iter_init(arms);
+    for (; arm->variant && prev != iter; prev = list_iter(prev)) {
+      if (((match_arm_t*)prev->val)->variant == arm->variant) {
+        fprintf(stderr, "Variant %s is matched more than once\n", arm->variant->name);
+        return NULL;
+      }
+    }
+    covered++;
+  }
+  if (type == NULL) {
+    fprintf(stderr, "Match must have at least one arm\n");
+    return NULL;
+  }
+  long overlap;
+  if (type_name_is(subject->type, "Integer")) {
+    if (ast_match_cases_overlap(arms, &overlap)) {
+      fprintf(stderr, "%ld is matched more than once\n", overlap);
+      return NULL;
+    }
+    if (default_expr == NULL) {
+      fprintf(stderr, "Match on Integer needs an else arm\n");
+      return NULL;
+    }
+  } else if (default_expr == NULL && covered < subject->type->members->size) {
+    fprintf(stderr, "Match on %s does not cover every variant\n", type_to_string(subject->type));
+    return NULL;
+  }
+  match_node_t* node = (match_node_t*)malloc(sizeof(match_node_t));
+  node->node_type = NODE_MATCH;
+  node->codegen_fun = codegen_match;
+  node->graphgen_fun = graphgen_match;
+  node->free_fun = ast_match_node_free;
+  node->type = type;
+  node->subject = subject;
+  node->arms = arms;
+  node->default_expr = default_expr;
+  return node;
+}
+
+void ast_record_node_free(record_node_t* node) {
+  list_visit(node->values, (void(*)(void*))ast_expr_node_free);
+  list_free(node->values);
+  free(node);
+}
+
+record_node_t* ast_record_node_init(context_t* context, type_t* record_type, list_t* values) {
+  if (values->size != record_type->members->size) {
+    fprintf(stderr, "wrong number of fields for %s. Expected %zd, got %zd\n", type_to_string(record_type), record_type->members->size, values->size);
+    return NULL;
+  }
+  list_item_t* field_iter = list_iter_init(record_type->members);
+  list_item_t* value_iter = list_iter_init(values);
+  for (; field_iter; field_iter = list_iter(field_iter), value_iter = list_iter(value_iter)) {
+    type_member_t* field = field_iter->val;
+    expr_node_t* value = value_iter->val;
+    if (!type_equals(field->type, value->type)) {
+      fprintf(stderr, "Field %s of %s is a %s, got %s\n", field->name, type_to_string(record_type), type_to_string(field->type), type_to_string(value->type));
+      return NULL;
+    }
+  }
+  record_node_t* node = (record_node_t*)malloc(sizeof(record_node_t));
+  node->node_type = NODE_RECORD;
+  node->codegen_fun = codegen_record;
+  node->graphgen_fun = graphgen_record;
+  node->free_fun = ast_record_node_free;
+  node->type = record_type;
+  node->values = values;
+  return node;
+}
+
+void ast_field_node_free(field_node_t* node) {
+  ast_expr_node_free(node->record);
+  free(node);
+}
+
+field_node_t* ast_field_node_init(context_t* context, expr_node_t* record, char* name) {
+  if (record->type->kind != TYPE_KIND_RECORD) {
+    fprintf(stderr, "Cannot access field %s of %s\n", name, type_to_string(record->type));
+    return NULL;
+  }
+  type_member_t* field = type_member_get(record->type, name);
+  if (!field) {
+    fprintf(stderr, "%s has no field %s\n", type_to_string(record->type), name);
+    return NULL;
+  }
+  field_node_t* node = (field_node_t*)malloc(sizeof(field_node_t));
+  node->node_type = NODE_FIELD;
+  node->codegen_fun = codegen_field;
+  node->graphgen_fun = graphgen_field;
+  node->free_fun = ast_field_node_free;
+  node->type = field->type;
+  node->record = record;
+  node->field = field;
+  return node;
+}
+
+void ast_array_node_free(array_node_t* node) {
+  if (node->elements) {
+    list_visit(node->elements, (void(*)(void*))ast_expr_node_free);
+    list_free(node->elements);
+  }
+  if (node->length) {
+    ast_expr_node_free(node->length);
+  }
+  free(node);
+}
+
+array_node_t* ast_array_node_init(context_t* context, type_t* element_type, list_t* elements, expr_node_t* length) {
+  if (elements) {
+    list_item_t* iter = list_iter_init(elements);
+    for (; iter; iter = list_iter(iter)) {
+      expr_node_t* element = iter->val;
+      if (!type_equals(element->type, element_type)) {
+        fprintf(stderr, "Array of %s cannot hold a %s\n", type_to_string(element_type), type_to_string(element->type));
+        return NULL;
+      }
+    }
+  }
+  if (length && !type_name_is(length->type, "Integer")) {
+    fprintf(stderr, "Array length must be an Integer, got %s\n", type_to_string(length->type));
+    return NULL;
+  }
+  type_t* type = type_array_get(context->type_sys, element_type);
+  if (type == NULL) return NULL;
+  array_node_t* node = (array_node_t*)malloc(sizeof(array_node_t));
+  node->node_type = NODE_ARRAY;
+  node->codegen_fun = codegen_array;
+  node->graphgen_fun = graphgen_array;
+  node->free_fun = ast_array_node_free;
+  node->type = type;
+  node->elements = elements;
+  node->length = length;
+  return node;
+}
+
+void ast_index_node_free(index_node_t* node) {
+  ast_expr_node_free(node->array);
+  ast_expr_node_free(node->index);
+  free(node);
+}
+
+index_node_t* ast_index_node_init(context_t* context, expr_node_t* array, expr_node_t* index) {
+  if (array->type->kind == TYPE_KIND_VECTOR) {
+    if (index->node_type != NODE_CONST_INT ||
+        ((const_int_node_t*)index)->val < 0 ||
+        ((const_int_node_t*)index)->val >= type_vector_width(array->type)) {
+      fprintf(stderr, "Lane of %s must be a constant between 0 and %u\n",
+          type_to_string(array->type), type_vector_width(array->type) - 1);
+      return NULL;
+    }
+  } else if (array->type->kind == TYPE_KIND_MAP) {
+    if (!type_equals(index->type, type_map_key(array->type))) {
+      fprintf(stderr, "Key of %s must be a %s, got %s\n", type_to_string(array->type),
+          type_to_string(type_map_key(array->type)), type_to_string(index->type));
+      return NULL;
+    }
+  } else if (array->type->kind != TYPE_KIND_ARRAY) {
+    fprintf(stderr, "Cannot index into %s\n", type_to_string(array->type));
+    return NULL;
+  } else if (!type_name_is(index->type, "Integer")) {
+    fprintf(stderr, "Array index must be an Integer, got %s\n", type_to_string(index->type));
+    return NULL;
+  }
+  index_node_t* node = (index_node_t*)malloc(sizeof(index_node_t));
+  node->node_type = NODE_INDEX;
+  node->codegen_fun = codegen_index;
+  node->graphgen_fun = graphgen_index;
+  node->free_fun = ast_index_node_free;
+  if (array->type->kind == TYPE_KIND_VECTOR) {
+    node->type = type_vector_element(array->type);
+  } else if (array->type->kind == TYPE_KIND_MAP) {
+    node->type = type_map_value(array->type);
+  } else {
+    node->type = type_array_element(array->type);
+  }
+  node->array = array;
+  node->index = index;
+  return node;
+}
+
+void ast_length_node_free(length_node_t* node) {
+  ast_expr_node_free(node->array);
+  free(node);
+}
+
+length_node_t* ast_length_node_init(context_t* context, expr_node_t* array) {
+  length_node_t* node = (length_node_t*)malloc(sizeof(length_node_t));
+  node->node_type = NODE_LENGTH;
+  node->codegen_fun = codegen_length;
+  node->graphgen_fun = graphgen_length;
+  node->free_fun = ast_length_node_free;
+  node->type = type_get(context->type_sys, "Integer");
+  node->array = array;
+  return node;
+}
+
+map_node_t* ast_map_node_init(context_t* context, type_t* key_type, type_t* value_type) {
+  type_t* type = type_map_get(context->type_sys, key_type, value_type);
+  if (type == NULL) return NULL;
+  map_node_t* node = (map_node_t*)malloc(sizeof(map_node_t));
+  node->node_type = NODE_MAP;
+  node->codegen_fun = codegen_map;
+  node->graphgen_fun = graphgen_map;
+  node->free_fun = NULL;
+  node->type = type;
+  return node;
+}
+
+void ast_contains_node_free(contains_node_t* node) {
+  ast_expr_node_free(node->map);
+  ast_expr_node_free(node->key);
+  free(node);
+}
+
+contains_node_t* ast_contains_node_init(context_t* context, expr_node_t* map, expr_node_t* key) {
+  if (map->type->kind != TYPE_KIND_MAP) {
+    fprintf(stderr, "Cannot look up keys in %s\n", type_to_string(map->type));
+    return NULL;
+  }
+  if (!type_equals(key->type, type_map_key(map->type))) {
+    fprintf(stderr, "Key of %s must be a %s, got %s\n", type_to_string(map->type),
+        type_to_string(type_map_key(map->type)), type_to_string(key->type));
+    return NULL;
+  }
+  contains_node_t* node = (contains_node_t*)malloc(sizeof(contains_node_t));
+  node->node_type = NODE_CONTAINS;
+  node->codegen_fun = codegen_contains;
+  node->graphgen_fun = graphgen_contains;
+  node->free_fun = ast_contains_node_free;
+  node->type = type_get(context->type_sys, "Boolean");
+  node->map = map;
+  node->key = key;
+  return node;
+}
+
+void ast_vector_node_free(vector_node_t* node) {
+  list_visit(node->elements, (void(*)(void*))ast_expr_node_free);
+  list_free(node->elements);
+  free(node);
+}
+
+vector_node_t* ast_vector_node_init(context_t* context, unsigned int width, list_t* elements) {
+  if (elements->size != 1 && elements->size != width) {
+    fprintf(stderr, "Vec%u needs 1 or %u elements, got %zu\n", width, width, elements->size);
+    return NULL;
+  }
+  type_t* element_type = ((expr_node_t*)elements->head->val)->type;
+  list_item_t* iter = list_iter_init(elements);
+  for (; iter; iter = list_iter(iter)) {
+    expr_node_t* element = iter->val;
+    if (!type_equals(element->type, element_type)) {
+      fprintf(stderr, "Vector of %s cannot hold a %s\n", type_to_string(element_type), type_to_string(element->type));
+      return NULL;
+    }
+  }
+  type_t* type = type_vector_get(context->type_sys, width, element_type);
+  if (type == NULL) return NULL;
+  vector_node_t* node = (vector_node_t*)malloc(sizeof(vector_node_t));
+  node->node_type = NODE_VECTOR;
+  node->codegen_fun = codegen_vector;
+  node->graphgen_fun = graphgen_vector;
+  node->free_fun = ast_vector_node_free;
+  node->type = type;
+  node->elements = elements;
+  return node;
+}
+
+void ast_shuffle_node_free(shuffle_node_t* node) {
+  ast_expr_node_free(node->lhs);
+  if (node->rhs) {
+    ast_expr_node_free(node->rhs);
+  }
+  free(node->mask);
+  free(node);
+}
+
+shuffle_node_t* ast_shuffle_node_init(context_t* context, expr_node_t* lhs, expr_node_t* rhs, list_t* mask) {
+  if (lhs->type->kind != TYPE_KIND_VECTOR) {
+    fprintf(stderr, "Cannot shuffle %s\n", type_to_string(lhs->type));
+    return NULL;
+  }
+  if (rhs && !type_equals(lhs->type, rhs->type)) {
+    fprintf(stderr, "Cannot shuffle %s with %s\n", type_to_string(lhs->type), type_to_string(rhs->type));
+    return NULL;
+  }
+  unsigned int lanes = type_vector_width(lhs->type) * (rhs ? 2 : 1);
+  type_t* type = type_vector_get(context->type_sys, mask->size, type_vector_element(lhs->type));
+  if (type == NULL) return NULL;
+  shuffle_node_t* node = (shuffle_node_t*)malloc(sizeof(shuffle_node_t));
+  node->mask = malloc(sizeof(unsigned int) * mask->size);
+  node->mask_size = mask->size;
+  list_item_t* iter = list_iter_init(mask);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    const_int_node_t* lane = iter->val;
+    if (lane->node_type != NODE_CONST_INT || lane->val < 0 || lane->val >= lanes) {
+      fprintf(stderr, "Shuffle lanes must be constants between 0 and %u\n", lanes - 1);
+      return NULL;
+    }
+    node->mask[i] = lane->val;
+  }
+  list_visit(mask, (void(*)(void*))ast_expr_node_free);
+  list_free(mask);
+  node->node_type = NODE_SHUFFLE;
+  node->codegen_fun = codegen_shuffle;
+  node->graphgen_fun = graphgen_shuffle;
+  node->free_fun = ast_shuffle_node_free;
+  node->type = type;
+  node->lhs = lhs;
+  node->rhs = rhs;
+  return node;
+}
+
+void ast_reduce_node_free(reduce_node_t* node) {
+  ast_expr_node_free(node->vector);
+  free(node);
+}
+
+reduce_node_t* ast_reduce_node_init(context_t* context, reduce_op_t op, expr_node_t* vector) {
+  if (vector->type->kind != TYPE_KIND_VECTOR) {
+    fprintf(stderr, "Cannot reduce %s\n", type_to_string(vector->type));
+    return NULL;
+  }
+  type_t* element_type = type_vector_element(vector->type);
+  bool is_bool = type_name_is(element_type, "Boolean");
+  if (is_bool != (op == REDUCE_OP_ALL || op == REDUCE_OP_ANY)) {
+    char* op_str = reduce_op_to_string(op);
+    fprintf(stderr, "Cannot take %s of %s\n", op_str, type_to_string(vector->type));
+    free(op_str);
+    return NULL;
+  }
+  reduce_node_t* node = (reduce_node_t*)malloc(sizeof(reduce_node_t));
+  node->node_type = NODE_REDUCE;
+  node->codegen_fun = codegen_reduce;
+  node->graphgen_fun = graphgen_reduce;
+  node->free_fun = ast_reduce_node_free;
+  node->type = element_type;
+  node->op = op;
+  node->vector = vector;
+  return node;
+}
+
+annotation_t* ast_annotation_init(context_t* context, char* name, list_t* args) {
+  annotation_t* annotation = (annotation_t*)malloc(sizeof(annotation_t));
+  annotation->name = name;
+  annotation->args = args;
+  return annotation;
+}
+
+annotation_t* ast_annotation_get(list_t* annotations, char* name) {
+  if (annotations == NULL) {
+    return NULL;
+  }
+  list_item_t* iter = list_iter_init(annotations);
+  for (; iter; iter = list_iter(iter)) {
+    annotation_t* candidate = iter->val;
+    if (strcmp(candidate->name, name) == 0) {
+      return candidate;
+    }
+  }
+  return NULL;
+}
+
+void ast_annotation_free(annotation_t* annotation) {
+  list_visit(annotation->args, free);
+  list_free(annotation->args);
+  free(annotation->name);
+  free(annotation);
+}
+
+void ast_annotations_free(list_t* annotations) {
+  list_visit(annotations, (void(*)(void*))ast_annotation_free);
+  list_free(annotations);
+}
+
+static void ast_visit_list(list_t* exprs, void (*visit)(expr_node_t*, void*), void* data) {
+  list_item_t* iter = list_iter_init(exprs);
+  for (; iter; iter = list_iter(iter)) {
+    visit(iter->val, data);
+  }
+}
+
+// calls visit on each direct child of node, in evaluation order
+void ast_visit_children(expr_node_t* node, void (*visit)(expr_node_t*, void*), void* data) {
+  switch (node->node_type) {
+    case NODE_EXPR_LIST:
+      ast_visit_list(((expr_list_node_t*)node)->expressions, visit, data);
+      break;
+    case NODE_BINARY_OP:
+      // codegen evaluates the right hand side first
+      visit(((bin_op_node_t*)node)->rhs, data);
+      visit(((bin_op_node_t*)node)->lhs, data);
+      break;
+    case NODE_UNARY_OP:
+      visit(((unary_op_node_t*)node)->rhs, data);
+      break;
+    case NODE_IF: {
+      if_node_t* if_node = (if_node_t*)node;
+      visit(if_node->conditional, data);
+      visit((expr_node_t*)if_node->true_expr, data);
+      if (if_node->false_expr) {
+        visit((expr_node_t*)if_node->false_expr, data);
+      }
+      break;
+    }
+    case NODE_WHILE:
+      visit(((while_node_t*)node)->conditional, data);
+      visit((expr_node_t*)((while_node_t*)node)->body, data);
+      break;
+    case NODE_FOR:
+      visit(((for_node_t*)node)->start, data);
+      visit(((for_node_t*)node)->end, data);
+      visit((expr_node_t*)((for_node_t*)node)->body, data);
+      break;
+    case NODE_VAR_DECL:
+      visit(((var_decl_node_t*)node)->rhs, data);
+      break;
+    case NODE_BLOCK:
+      visit((expr_node_t*)((block_node_t*)node)->body, data);
+      break;
+    case NODE_FUN_CALL:
+      ast_visit_list(((fun_call_node_t*)node)->params, visit, data);
+      break;
+    case NODE_MATCH: {
+      match_node_t* match = (match_node_t*)node;
+      visit(match->subject, data);
+      list_item_t* iter = list_iter_init(match->arms);
+      for (; iter; iter = list_iter(iter)) {
+        visit((expr_node_t*)((match_arm_t*)iter->val)->body, data);
+      }
+      if (match->default_expr) {
+        visit((expr_node_t*)match->default_expr, data);
+      }
+      break;
+    }
+    case NODE_VARIANT:
+      if (((variant_node_t*)node)->payload) {
+        visit(((variant_node_t*)node)->payload, data);
+      }
+      break;
+    case NODE_RECORD:
+      ast_visit_list(((record_node_t*)node)->values, visit, data);
+      break;
+    case NODE_FIELD:
+      visit(((field_node_t*)node)->record, data);
+      break;
+    case NODE_ARRAY: {
+      array_node_t* array = (array_node_t*)node;
+      if (array->elements) {
+        ast_visit_list(array->elements, visit, data);
+      } else {
+        visit(array->length, data);
+      }
+      break;
+    }
+    case NODE_INDEX:
+      visit(((index_node_t*)node)->array, data);
+      visit(((index_node_t*)node)->index, data);
+      break;
+    case NODE_LENGTH:
+      visit(((length_node_t*)node)->array, data);
+      break;
+    case NODE_CONTAINS:
+      visit(((contains_node_t*)node)->map, data);
+      visit(((contains_node_t*)node)->key, data);
+      break;
+    case NODE_VECTOR:
+      ast_visit_list(((vector_node_t*)node)->elements, visit, data);
+      break;
+    case NODE_SHUFFLE:
+      visit(((shuffle_node_t*)node)->lhs, data);
+      if (((shuffle_node_t*)node)->rhs) {
+        visit(((shuffle_node_t*)node)->rhs, data);
+      }
+      break;
+    case NODE_REDUCE:
+      visit(((reduce_node_t*)node)->vector, data);
+      break;
+    default:
+      break;
+  }
+}
@@ -18,6 +18,12 @@ typedef struct {
   type_t* type;
 } expr_node_t;
 
+// @name or @name(arg, ...)
+typedef struct {
+  char* name;
+  list_t* args;
+} annotation_t;
+
 typedef struct expr_list_node_t {
   node_t node_type;
   void* codegen_fun;
@@ -72,9 +78,17 @@ typedef struct {
   type_t* type;
   char* name;
   list_t* params;
+  // last thing its block does, so codegen can jump or return instead of calling
+  bool tail;
+  // body to generate in place of the call, chosen by inline.c
+  struct block_node_t* inline_block;
+  // runs on the thread pool while what follows it is evaluated, chosen by parallel.c
+  bool spawn;
+  // counts the times the call is made
+  unsigned int profile_slot;
 } fun_call_node_t;
 
-typedef struct {
+typedef struct block_node_t {
   node_t node_type;
   void* codegen_fun;
   void* graphgen_fun;
@@ -82,6 +96,24 @@ typedef struct {
   type_t* type;
   expr_list_node_t* body;
   list_t* params;
+  // small enough that LLVM should inline whatever calls remain
+  bool always_inline;
+  // symbol_t of variables (and closures' environments) read from enclosing blocks, see closure.c
+  list_t* captures;
+  // the block is used as a value, so its environment can outlive the function defining it
+  bool env_escapes;
+  // entries in the table of earlier results for a @memo block, 0 for any other
+  unsigned int memo_size;
+  // fast_math_t flags from @fastmath
+  unsigned int fast_math;
+  // from @overflow(mode), or OVERFLOW_DEFAULT
+  overflow_t overflow;
+  // counts the calls entering its function
+  unsigned int profile_slot;
+  // effect_t flags of running its body, see effect.c
+  unsigned int effects;
+  // while effect.c walks the block, how many blocks deep that walk is, otherwise 0
+  unsigned int effects_depth;
 } block_node_t;
 
 typedef struct {
@@ -132,8 +164,171 @@ typedef struct {
   expr_node_t* conditional;
   expr_list_node_t* true_expr;
   expr_list_node_t* false_expr;
+  // counts the times the then arm runs, the next slot the else arm
+  unsigned int profile_slot;
 } if_node_t;
 
+// evaluates to the number of times the body ran
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* conditional;
+  expr_list_node_t* body;
+} while_node_t;
+
+// counts name from start up to (not including) end; evaluates to the number of times the body ran
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  char* name;
+  expr_node_t* start;
+  expr_node_t* end;
+  expr_list_node_t* body;
+} for_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  type_member_t* variant;
+  expr_node_t* payload;
+} variant_node_t;
+
+// lo through hi, both included
+typedef struct {
+  long lo;
+  long hi;
+} match_case_t;
+
+typedef struct {
+  type_member_t* variant;
+  // an arm of a match on an Integer has a list of match_case_t instead of a variant
+  list_t* cases;
+  // name the payload is bound to in body, or NULL
+  char* binding;
+  expr_list_node_t* body;
+} match_arm_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* subject;
+  list_t* arms;
+  expr_list_node_t* default_expr;
+} match_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  // in declaration order
+  list_t* values;
+} record_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* record;
+  type_member_t* field;
+} field_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  // [a, b, c] has elements, Array(T, n) has a length
+  list_t* elements;
+  expr_node_t* length;
+} array_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* array;
+  expr_node_t* index;
+} index_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* array;
+} length_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+} map_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* map;
+  expr_node_t* key;
+} contains_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  // one element is broadcast to every lane
+  list_t* elements;
+} vector_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  expr_node_t* lhs;
+  // NULL when shuffling a single vector
+  expr_node_t* rhs;
+  unsigned int* mask;
+  unsigned int mask_size;
+} shuffle_node_t;
+
+typedef struct {
+  node_t node_type;
+  void* codegen_fun;
+  void* graphgen_fun;
+  void* free_fun;
+  type_t* type;
+  reduce_op_t op;
+  expr_node_t* vector;
+} reduce_node_t;
+
 expr_list_node_t* ast_expr_list_node_init(context_t* context, symbol_table_t* scope);
 
 expr_list_node_t* ast_expr_list_node_add(context_t* context, expr_list_node_t* list, expr_node_t* expr);
@@ -156,10 +351,52 @@ fun_call_node_t* ast_fun_call_node_init(context_t* context, char* name, list_t*
 
 block_node_t* ast_block_node_init(context_t* context, list_t* param_list, expr_list_node_t* fun_body);
 
+void ast_mark_tail_calls(expr_node_t* node);
+
+void ast_visit_children(expr_node_t* node, void (*visit)(expr_node_t*, void*), void* data);
+
 fun_param_node_t* ast_fun_param_node_init(context_t* context, char* name, type_t* type);
 
 if_node_t* ast_if_node_init(context_t* context, expr_node_t* conditional, expr_list_node_t* true_expr, expr_list_node_t* false_expr);
 
+while_node_t* ast_while_node_init(context_t* context, expr_node_t* conditional, expr_list_node_t* body);
+
+for_node_t* ast_for_node_init(context_t* context, char* name, expr_node_t* start, expr_node_t* end, expr_list_node_t* body);
+
+variant_node_t* ast_variant_node_init(context_t* context, type_t* union_type, type_member_t* variant, expr_node_t* payload);
+
+match_arm_t* ast_match_arm_init(context_t* context, type_member_t* variant, char* binding, expr_list_node_t* body);
+
+match_arm_t* ast_match_int_arm_init(context_t* context, list_t* cases, expr_list_node_t* body);
+
+match_node_t* ast_match_node_init(context_t* context, expr_node_t* subject, list_t* arms, expr_list_node_t* default_expr);
+
+record_node_t* ast_record_node_init(context_t* context, type_t* record_type, list_t* values);
+
+field_node_t* ast_field_node_init(context_t* context, expr_node_t* record, char* name);
+
+array_node_t* ast_array_node_init(context_t* context, type_t* element_type, list_t* elements, expr_node_t* length);
+
+index_node_t* ast_index_node_init(context_t* context, expr_node_t* array, expr_node_t* index);
+
+length_node_t* ast_length_node_init(context_t* context, expr_node_t* array);
+
+map_node_t* ast_map_node_init(context_t* context, type_t* key_type, type_t* value_type);
+
+contains_node_t* ast_contains_node_init(context_t* context, expr_node_t* map, expr_node_t* key);
+
+vector_node_t* ast_vector_node_init(context_t* context, unsigned int width, list_t* elements);
+
+shuffle_node_t* ast_shuffle_node_init(context_t* context, expr_node_t* lhs, expr_node_t* rhs, list_t* mask);
+
+reduce_node_t* ast_reduce_node_init(context_t* context, reduce_op_t op, expr_node_t* vector);
+
+annotation_t* ast_annotation_init(context_t* context, char* name, list_t* args);
+
+annotation_t* ast_annotation_get(list_t* annotations, char* name);
+
+void ast_annotations_free(list_t* annotations);
+
 void ast_expr_node_free(expr_node_t* node);
 
 #endif
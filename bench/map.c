@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "runtime.h"
+
+// insert/lookup throughput of the Map(Integer, Integer) runtime table
+// usage: map-bench [keys]
+
+typedef struct {
+  long key;
+  long value;
+} slot_t;
+
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(char* name, long ops, double secs) {
+  printf("%-14s %10ld ops %8.2f ns/op %8.2f Mops/s\n", name, ops, secs * 1e9 / ops, ops / secs / 1e6);
+}
+
+int main(int argc, char const *argv[]) {
+  long n = argc > 1 ? atol(argv[1]) : 1000000;
+  // spread keys out so they don't hash in order
+  long* keys = malloc(sizeof(long) * n);
+  for (long i = 0; i < n; i++) {
+    keys[i] = i * 7919 + 13;
+  }
+
+  runtime_map_t* map = runtime_map_new(sizeof(slot_t));
+  double start = now();
+  for (long i = 0; i < n; i++) {
+    slot_t* slot = runtime_map_insert(map, keys[i]);
+    slot->value = i;
+  }
+  report("insert", n, now() - start);
+
+  long sum = 0;
+  start = now();
+  for (long i = 0; i < n; i++) {
+    slot_t* slot = runtime_map_find(map, keys[i]);
+    sum += slot->value;
+  }
+  report("lookup hit", n, now() - start);
+
+  long misses = 0;
+  start = now();
+  for (long i = 0; i < n; i++) {
+    misses += runtime_map_find(map, -keys[i]) == NULL;
+  }
+  report("lookup miss", n, now() - start);
+
+  if (sum != (n - 1) * n / 2 || misses != n || map->size != n) {
+    fprintf(stderr, "map-bench: wrong results\n");
+    return 1;
+  }
+  printf("capacity %ld, load %.2f\n", map->capacity, (double)map->size / map->capacity);
+  return 0;
+}
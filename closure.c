@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "closure.h"
+
+/*
+ * Finds the variables each block reads from enclosing scopes. Codegen copies
+ * their values into an environment where the block is defined and passes it
+ * as a hidden last parameter. Calling a block that has an environment reads
+ * it, so a block calling a closure from further out captures that closure's
+ * environment too. A block whose name is used as a value may outlive the
+ * function defining it, so its environment goes on the heap instead of that
+ * function's stack.
+ */
+
+typedef struct {
+  symbol_t* symbol;
+  block_node_t* block;
+} closure_t;
+
+typedef struct {
+  context_t* context;
+  // every block, and the ones being walked (innermost first)
+  list_t* closures;
+  list_t* open;
+  bool changed;
+  bool failed;
+} closure_state_t;
+
+closure_t* closure_for_block(closure_state_t* state, block_node_t* block) {
+  list_item_t* iter = list_iter_init(state->closures);
+  for (; iter; iter = list_iter(iter)) {
+    closure_t* closure = iter->val;
+    if (closure->block == block) return closure;
+  }
+  closure_t* closure = malloc(sizeof(closure_t));
+  closure->symbol = NULL;
+  closure->block = block;
+  list_push(state->closures, closure);
+  return closure;
+}
+
+closure_t* closure_for_symbol(closure_state_t* state, symbol_t* symbol) {
+  list_item_t* iter = list_iter_init(state->closures);
+  for (; iter; iter = list_iter(iter)) {
+    closure_t* closure = iter->val;
+    if (closure->symbol == symbol) return closure;
+  }
+  return NULL;
+}
+
+// the scope the name is declared in
+symbol_table_t* closure_owner(symbol_table_t* scope, char* name) {
+  for (; scope; scope = scope->parent) {
+    if (symbol_get_in_scope(scope, name)) return scope;
+  }
+  return NULL;
+}
+
+bool closure_owns(block_node_t* block, symbol_table_t* scope) {
+  for (; scope; scope = scope->parent) {
+    if (scope == block->body->scope) return true;
+  }
+  return false;
+}
+
+// every open block declared inside the symbol's scope has to capture it
+void closure_capture(closure_state_t* state, symbol_t* symbol) {
+  symbol_table_t* owner = closure_owner(state->context->symbol_table, symbol->name);
+  list_item_t* iter = list_iter_init(state->open);
+  for (; iter; iter = list_iter(iter)) {
+    closure_t* closure = iter->val;
+    if (closure->symbol == symbol || closure_owns(closure->block, owner)) return;
+    list_item_t* capture = list_iter_init(closure->block->captures);
+    for (; capture && capture->val != symbol; capture = list_iter(capture));
+    if (capture == NULL) {
+      printf("Block captures %s\n", symbol->name);
+      list_push(closure->block->captures, symbol);
+      state->changed = true;
+    }
+  }
+}
+
+void closure_visit(expr_node_t* node, closure_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  type_t* type_fun = type_get(context->type_sys, "Function");
+  switch (node->node_type) {
+    case NODE_EXPR_LIST:
+      context->symbol_table = ((expr_list_node_t*)node)->scope;
+      break;
+    case NODE_VAR_DECL: {
+      var_decl_node_t* var_decl = (var_decl_node_t*)node;
+      if (var_decl->rhs->node_type == NODE_BLOCK) {
+        closure_t* closure = closure_for_block(state, (block_node_t*)var_decl->rhs);
+        closure->symbol = symbol_get_in_scope(context->symbol_table, var_decl->name);
+      }
+      break;
+    }
+    case NODE_BLOCK: {
+      closure_t* closure = closure_for_block(state, (block_node_t*)node);
+      list_unshift(state->open, closure);
+      ast_visit_children(node, (void(*)(expr_node_t*, void*))closure_visit, state);
+      list_shift(state->open);
+      return;
+    }
+    case NODE_IDENT: {
+      symbol_t* symbol = symbol_get(context->symbol_table, ((ident_node_t*)node)->name);
+      if (symbol == NULL) break;
+      if (type_equals(symbol->type, type_fun)) {
+        closure_t* closure = closure_for_symbol(state, symbol);
+        if (closure && !closure->block->env_escapes) {
+          printf("Environment of %s escapes\n", symbol->name);
+          closure->block->env_escapes = true;
+        }
+      } else {
+        closure_capture(state, symbol);
+      }
+      break;
+    }
+    case NODE_BINARY_OP: {
+      bin_op_node_t* bin_op = (bin_op_node_t*)node;
+      if (bin_op->op != BIN_OP_ASSIGN || bin_op->lhs->node_type != NODE_IDENT) break;
+      char* name = ((ident_node_t*)bin_op->lhs)->name;
+      symbol_table_t* owner = closure_owner(context->symbol_table, name);
+      closure_t* innermost = state->open->head ? state->open->head->val : NULL;
+      if (innermost && owner && !closure_owns(innermost->block, owner)) {
+        // captures are copies, the assignment would be lost
+        fprintf(stderr, "Cannot assign to %s captured by a block\n", name);
+        state->failed = true;
+      }
+      break;
+    }
+    case NODE_FUN_CALL: {
+      symbol_t* symbol = symbol_get(context->symbol_table, ((fun_call_node_t*)node)->name);
+      closure_t* closure = symbol ? closure_for_symbol(state, symbol) : NULL;
+      if (closure && closure->block->captures->size > 0) {
+        closure_capture(state, symbol);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))closure_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+bool closure_analyze(context_t* context, expr_node_t* ast) {
+  closure_state_t state;
+  state.context = context;
+  state.closures = list_init();
+  state.open = list_init();
+  state.failed = false;
+  // calls can make a block capture a closure whose own captures come later
+  do {
+    state.changed = false;
+    closure_visit(ast, &state);
+  } while (state.changed && !state.failed);
+
+  list_item_t* iter = list_iter_init(state.closures);
+  for (; iter; iter = list_iter(iter)) {
+    closure_t* closure = iter->val;
+    if (closure->symbol) {
+      closure->symbol->has_env = closure->block->captures->size > 0;
+    }
+  }
+  list_visit(state.closures, free);
+  list_free(state.closures);
+  list_free(state.open);
+  return !state.failed;
+}
@@ -0,0 +1,11 @@
+#ifndef CLOSURE_H
+
+#define CLOSURE_H
+
+#include "ast.h"
+#include "context.h"
+
+// Fills in the captures of every block, see closure.c. False on an error.
+bool closure_analyze(context_t* context, expr_node_t* ast);
+
+#endif
@@ -4,6 +4,9 @@
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
+#include <llvm-c/Transforms/Vectorize.h>
+#include <llvm-c/Transforms/IPO.h>
 
 // General stuff
 #include <stdlib.h>
@@ -15,15 +18,479 @@
 
 #include "context.h"
 #include "codegen.h"
+#include "type_union.h"
+#include "type_record.h"
+#include "type_array.h"
+#include "type_vector.h"
+#include "type_map.h"
+#include "range.h"
+#include "type_fun.h"
+#include "ssa.h"
+#include "memo.h"
+#include "fastmath.h"
+#include "effect.h"
 
 static unsigned int function_index = 0;
+// > 0 while generating a body copied into its caller, where tail calls aren't tail calls
+static unsigned int inline_depth = 0;
+
+// fast_math_t flags of the function being generated
+static unsigned int fast_math = FAST_MATH_NONE;
+// and what its Integer arithmetic does on overflow
+static overflow_t overflow = OVERFLOW_WRAP;
+
+// a block whose body is being generated, and where its captured variables are
+typedef struct {
+  block_node_t* block;
+  symbol_t* self;
+  LLVMValueRef env;
+} closure_frame_t;
+// innermost first
+static list_t* closure_frames = NULL;
 
 LLVMModuleRef mod;
+// run on each block as soon as its function is complete
+LLVMPassManagerRef function_passes;
+
+// one Integer per profile slot when instrumenting for -profile-generate
+static LLVMValueRef profile_counters = NULL;
+// for the module's profile summary
+static unsigned long max_entry_count = 0;
+static unsigned int profiled_functions = 0;
 
 LLVMModuleRef get_current_module() {
   return mod;
 }
 
+void codegen_set_branch_weights(LLVMValueRef branch, unsigned int true_weight, unsigned int false_weight) {
+  LLVMValueRef weights[] = {
+    LLVMMDString("branch_weights", 14),
+    LLVMConstInt(LLVMInt32Type(), true_weight, false),
+    LLVMConstInt(LLVMInt32Type(), false_weight, false),
+  };
+  LLVMSetMetadata(branch, LLVMGetMDKindID("prof", 4), LLVMMDNode(weights, 3));
+}
+
+// an attribute without a value, such as nounwind
+void codegen_add_attribute(LLVMValueRef func, const char* name) {
+  unsigned int kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+  LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(LLVMGetGlobalContext(), kind, 0));
+}
+
+/*
+ * The execution engine's target machine is a generic one. LLVM chooses the
+ * instructions, and the vectorizers their vector width, per function from
+ * these attributes instead.
+ */
+void codegen_target_cpu(context_t* context, LLVMValueRef func) {
+  if (context->cpu == NULL) return;
+  LLVMAddTargetDependentFunctionAttr(func, "target-cpu", context->cpu);
+  if (context->cpu_features[0] != '\0') {
+    LLVMAddTargetDependentFunctionAttr(func, "target-features", context->cpu_features);
+  }
+}
+
+// adds one to a profile slot's counter, if the program is instrumented
+void codegen_count(LLVMBuilderRef builder, unsigned int slot) {
+  if (profile_counters == NULL) return;
+  LLVMValueRef indices[] = {
+    LLVMConstInt(LLVMInt64Type(), 0, false),
+    LLVMConstInt(LLVMInt64Type(), slot, false),
+  };
+  LLVMValueRef counter = LLVMBuildInBoundsGEP(builder, profile_counters, indices, 2, "counter");
+  LLVMValueRef count = LLVMBuildLoad(builder, counter, "count");
+  LLVMBuildStore(builder, LLVMBuildAdd(builder, count, LLVMConstInt(LLVMInt64Type(), 1, false), "count"), counter);
+}
+
+// weights are 32 bit, so large counts are scaled down, keeping their ratio
+void codegen_set_profile_weights(LLVMValueRef branch, unsigned long taken, unsigned long not_taken) {
+  unsigned long largest = taken > not_taken ? taken : not_taken;
+  unsigned long scale = largest / UINT_MAX + 1;
+  // one more, so an arm that never ran is unlikely rather than impossible
+  codegen_set_branch_weights(branch, taken / scale + 1, not_taken / scale + 1);
+}
+
+void codegen_set_entry_count(LLVMValueRef func, unsigned long count) {
+  LLVMContextRef llvm_context = LLVMGetGlobalContext();
+  LLVMMetadataRef entry_count[] = {
+    LLVMMDStringInContext2(llvm_context, "function_entry_count", 20),
+    LLVMValueAsMetadata(LLVMConstInt(LLVMInt64Type(), count, false)),
+  };
+  LLVMGlobalSetMetadata(func, LLVMGetMDKindID("prof", 4), LLVMMDNodeInContext2(llvm_context, entry_count, 2));
+  max_entry_count = count > max_entry_count ? count : max_entry_count;
+  profiled_functions++;
+}
+
+LLVMMetadataRef codegen_summary_field(char* name, unsigned long value) {
+  LLVMContextRef llvm_context = LLVMGetGlobalContext();
+  LLVMMetadataRef field[] = {
+    LLVMMDStringInContext2(llvm_context, name, strlen(name)),
+    LLVMValueAsMetadata(LLVMConstInt(LLVMInt64Type(), value, false)),
+  };
+  return LLVMMDNodeInContext2(llvm_context, field, 2);
+}
+
+/*
+ * Without a summary of the whole profile LLVM can't tell hot counts from
+ * cold ones, and leaves the entry counts out of its inlining and size
+ * decisions. Laid out the way LLVM's ProfileSummary::getMD writes it.
+ */
+void codegen_profile_summary(profile_t* profile) {
+  profile_summary_t summary;
+  profile_summarize(profile, &summary);
+  LLVMContextRef llvm_context = LLVMGetGlobalContext();
+
+  LLVMMetadataRef cutoffs[PROFILE_CUTOFFS];
+  for (unsigned int i = 0; i < PROFILE_CUTOFFS; i++) {
+    LLVMMetadataRef cutoff[] = {
+      LLVMValueAsMetadata(LLVMConstInt(LLVMInt32Type(), summary.cutoffs[i].cutoff, false)),
+      LLVMValueAsMetadata(LLVMConstInt(LLVMInt64Type(), summary.cutoffs[i].min_count, false)),
+      LLVMValueAsMetadata(LLVMConstInt(LLVMInt32Type(), summary.cutoffs[i].num_counts, false)),
+    };
+    cutoffs[i] = LLVMMDNodeInContext2(llvm_context, cutoff, 3);
+  }
+  LLVMMetadataRef detailed[] = {
+    LLVMMDStringInContext2(llvm_context, "DetailedSummary", 15),
+    LLVMMDNodeInContext2(llvm_context, cutoffs, PROFILE_CUTOFFS),
+  };
+  LLVMMetadataRef format[] = {
+    LLVMMDStringInContext2(llvm_context, "ProfileFormat", 13),
+    LLVMMDStringInContext2(llvm_context, "InstrProf", 9),
+  };
+  LLVMMetadataRef fields[] = {
+    LLVMMDNodeInContext2(llvm_context, format, 2),
+    codegen_summary_field("TotalCount", summary.total),
+    codegen_summary_field("MaxCount", summary.max),
+    codegen_summary_field("MaxInternalCount", summary.max),
+    codegen_summary_field("MaxFunctionCount", max_entry_count),
+    codegen_summary_field("NumCounts", summary.num_counts),
+    codegen_summary_field("NumFunctions", profiled_functions),
+    LLVMMDNodeInContext2(llvm_context, detailed, 2),
+  };
+  LLVMAddModuleFlag(mod, LLVMModuleFlagBehaviorError, "ProfileSummary", 14, LLVMMDNodeInContext2(llvm_context, fields, 8));
+}
+
+/*
+ * Float operations carry the flags themselves, see fastmath_set_flags. The
+ * backend reads some of them from these function attributes instead.
+ */
+void codegen_fast_math(LLVMValueRef func, unsigned int flags) {
+  if (flags & FAST_MATH_REASSOC) {
+    // reordering a sum already gives up on the sign of a zero result
+    LLVMAddTargetDependentFunctionAttr(func, "no-signed-zeros-fp-math", "true");
+  }
+  if (flags & FAST_MATH_CONTRACT) {
+    LLVMAddTargetDependentFunctionAttr(func, "less-precise-fpmad", "true");
+  }
+  if (flags & FAST_MATH_NNAN) {
+    LLVMAddTargetDependentFunctionAttr(func, "no-nans-fp-math", "true");
+  }
+  if (flags & FAST_MATH_NINF) {
+    LLVMAddTargetDependentFunctionAttr(func, "no-infs-fp-math", "true");
+  }
+  if (flags == FAST_MATH_ALL) {
+    LLVMAddTargetDependentFunctionAttr(func, "unsafe-fp-math", "true");
+  }
+}
+
+// declares a function from runtime.c the first time generated code calls it
+LLVMValueRef codegen_runtime_fun(char* name, LLVMTypeRef ret_type, LLVMTypeRef* param_types, unsigned int param_count) {
+  LLVMValueRef fun = LLVMGetNamedFunction(get_current_module(), name);
+  if (fun == NULL) {
+    fun = LLVMAddFunction(get_current_module(), name, LLVMFunctionType(ret_type, param_types, param_count, false));
+  }
+  return fun;
+}
+
+void codegen_bounds_check(context_t* context, LLVMBuilderRef builder, index_node_t* node, LLVMValueRef array, LLVMValueRef index) {
+  if (range_index_is_safe(context, node->array, node->index)) {
+    return;
+  }
+  LLVMValueRef length = type_array_length(node->array->type, builder, array);
+  // a negative index is a huge unsigned one, so one compare checks both ends
+  LLVMValueRef in_bounds = LLVMBuildICmp(builder, LLVMIntULT, index, length, "inbounds");
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef ok_block = LLVMAppendBasicBlock(current_fun, "inbounds");
+  LLVMBasicBlockRef error_block = LLVMAppendBasicBlock(current_fun, "outofbounds");
+  codegen_set_branch_weights(LLVMBuildCondBr(builder, in_bounds, ok_block, error_block), 2000, 1);
+
+  LLVMPositionBuilderAtEnd(builder, error_block);
+  LLVMTypeRef param_types[] = { LLVMInt64Type(), LLVMInt64Type() };
+  LLVMValueRef error_fun = codegen_runtime_fun("runtime_bounds_error", LLVMVoidType(), param_types, 2);
+  LLVMValueRef args[] = { index, length };
+  LLVMBuildCall(builder, error_fun, args, 2, "");
+  LLVMBuildUnreachable(builder);
+
+  LLVMPositionBuilderAtEnd(builder, ok_block);
+}
+
+// code after a tail call never runs, give it somewhere to go
+LLVMValueRef codegen_after_tail_call(LLVMBuilderRef builder, LLVMValueRef current_fun) {
+  LLVMBasicBlockRef dead_block = LLVMAppendBasicBlock(current_fun, "aftertail");
+  LLVMPositionBuilderAtEnd(builder, dead_block);
+  return LLVMGetUndef(LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(current_fun))));
+}
+
+LLVMValueRef codegen_entry_alloca(LLVMBuilderRef builder, LLVMTypeRef type, char* name) {
+  LLVMBuilderRef entry_builder = LLVMCreateBuilder();
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef entry = LLVMGetEntryBasicBlock(current_fun);
+  LLVMValueRef first = LLVMGetFirstInstruction(entry);
+  if (first) {
+    LLVMPositionBuilderBefore(entry_builder, first);
+  } else {
+    LLVMPositionBuilderAtEnd(entry_builder, entry);
+  }
+  LLVMValueRef alloca = LLVMBuildAlloca(entry_builder, type, name);
+  LLVMDisposeBuilder(entry_builder);
+  return alloca;
+}
+
+LLVMTypeRef codegen_env_type(context_t* context, block_node_t* block) {
+  LLVMTypeRef field_types[block->captures->size];
+  list_item_t* iter = list_iter_init(block->captures);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    symbol_t* symbol = iter->val;
+    if (type_equals(symbol->type, type_get(context->type_sys, "Function"))) {
+      // another closure's environment
+      field_types[i] = LLVMPointerType(LLVMInt8Type(), 0);
+    } else {
+      field_types[i] = type_get_ref(symbol->type);
+    }
+  }
+  return LLVMStructType(field_types, block->captures->size, false);
+}
+
+void codegen_push_closure_frame(block_node_t* block, symbol_t* self, LLVMValueRef env) {
+  closure_frame_t* frame = malloc(sizeof(closure_frame_t));
+  frame->block = block;
+  frame->self = self;
+  frame->env = env;
+  if (closure_frames == NULL) {
+    closure_frames = list_init();
+  }
+  list_unshift(closure_frames, frame);
+}
+
+void codegen_pop_closure_frame() {
+  free(list_shift(closure_frames));
+}
+
+// a variable's value, or for a block with captures its environment as an i8*
+LLVMValueRef codegen_captured(context_t* context, LLVMBuilderRef builder, symbol_t* symbol) {
+  closure_frame_t* frame = closure_frames && closure_frames->head ? closure_frames->head->val : NULL;
+  if (frame && frame->env && frame->self == symbol) {
+    return LLVMBuildBitCast(builder, frame->env, LLVMPointerType(LLVMInt8Type(), 0), "env");
+  }
+  if (frame && frame->env) {
+    list_item_t* iter = list_iter_init(frame->block->captures);
+    for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+      if (iter->val == symbol) {
+        LLVMValueRef field = LLVMBuildStructGEP(builder, frame->env, i, "");
+        return LLVMBuildLoad(builder, field, symbol->name);
+      }
+    }
+  }
+  if (type_equals(symbol->type, type_get(context->type_sys, "Function"))) {
+    return symbol->env;
+  }
+  return ssa_read(symbol, LLVMGetInsertBlock(builder));
+}
+
+// codegen_entry_alloca puts them all in the entry block
+bool codegen_has_allocas(LLVMValueRef fun) {
+  LLVMValueRef inst = LLVMGetFirstInstruction(LLVMGetEntryBasicBlock(fun));
+  for (; inst; inst = LLVMGetNextInstruction(inst)) {
+    if (LLVMIsAAllocaInst(inst)) return true;
+  }
+  return false;
+}
+
+// copies the captured values where the block is defined; escaping environments are never freed
+LLVMValueRef codegen_env_init(context_t* context, LLVMBuilderRef builder, block_node_t* block) {
+  LLVMTypeRef env_type = codegen_env_type(context, block);
+  LLVMValueRef env;
+  if (block->env_escapes) {
+    env = LLVMBuildMalloc(builder, env_type, "env");
+  } else {
+    env = codegen_entry_alloca(builder, env_type, "env");
+  }
+  list_item_t* iter = list_iter_init(block->captures);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    symbol_t* symbol = iter->val;
+    LLVMValueRef value = codegen_captured(context, builder, symbol);
+    if (value == NULL) {
+      fprintf(stderr, "Unable to capture %s\n", symbol->name);
+      return NULL;
+    }
+    LLVMBuildStore(builder, value, LLVMBuildStructGEP(builder, env, i, ""));
+  }
+  return LLVMBuildBitCast(builder, env, LLVMPointerType(LLVMInt8Type(), 0), "env");
+}
+
+void codegen_optimize_function(LLVMValueRef fun) {
+  ssa_forget_function(fun);
+  // broken IR is left for the module verifier to report
+  if (LLVMVerifyFunction(fun, LLVMReturnStatusAction)) return;
+  LLVMRunFunctionPassManager(function_passes, fun);
+}
+
+// a call running on the thread pool, see parallel.c
+typedef struct {
+  // null if the pool was busy and the call was made right away
+  LLVMValueRef task;
+  // of the call made right away
+  LLVMValueRef result;
+  // holds the arguments, then the result
+  LLVMValueRef frame;
+  // the variable a spawned declaration gives the result to
+  symbol_t* symbol;
+} codegen_task_t;
+
+/*
+ * void callee.thunk(i8* frame) calls callee with the frame's arguments and
+ * stores its result there. Every call site gets its own, constant arguments
+ * are built into it rather than passed in the frame so that LLVM can still
+ * specialize the callee for them.
+ */
+LLVMValueRef codegen_thunk(context_t* context, LLVMValueRef callee, LLVMTypeRef frame_type, LLVMValueRef* args, unsigned int arg_count) {
+  const char* callee_name = LLVMGetValueName(callee);
+  char* name = malloc(strlen(callee_name) + 7);
+  sprintf(name, "%s.thunk", callee_name);
+  LLVMTypeRef frame_ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
+  // LLVM numbers the name if another call site already took it
+  LLVMValueRef thunk = LLVMAddFunction(get_current_module(), name, LLVMFunctionType(LLVMVoidType(), &frame_ptr_type, 1, false));
+  free(name);
+  LLVMSetLinkage(thunk, LLVMInternalLinkage);
+  codegen_add_attribute(thunk, "nounwind");
+  codegen_target_cpu(context, thunk);
+
+  LLVMBuilderRef builder = LLVMCreateBuilder();
+  LLVMPositionBuilderAtEnd(builder, LLVMAppendBasicBlock(thunk, "entry"));
+  LLVMValueRef frame = LLVMBuildBitCast(builder, LLVMGetParam(thunk, 0), LLVMPointerType(frame_type, 0), "frame");
+  LLVMValueRef thunk_args[arg_count];
+  unsigned int field = 1;
+  for (unsigned int i = 0; i < arg_count; i++) {
+    if (LLVMIsConstant(args[i])) {
+      thunk_args[i] = args[i];
+    } else {
+      thunk_args[i] = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, frame, field++, ""), "");
+    }
+  }
+  LLVMValueRef result = LLVMBuildCall(builder, callee, thunk_args, arg_count, "result");
+  LLVMSetInstructionCallConv(result, LLVMGetFunctionCallConv(callee));
+  LLVMBuildStore(builder, result, LLVMBuildStructGEP(builder, frame, 0, ""));
+  LLVMBuildRetVoid(builder);
+  LLVMDisposeBuilder(builder);
+  codegen_optimize_function(thunk);
+  return thunk;
+}
+
+/*
+ * Evaluates the call's arguments, then hands the call to the thread pool,
+ * or makes it right away if the pool is busy:
+ *
+ *          br runtime_free_workers > 0, spawn, nospawn
+ * spawn:   store the arguments in the frame, task = runtime_spawn(thunk, frame)
+ * nospawn: result = call
+ * spawned: task = phi [task, spawn], [null, nospawn]
+ *          result = phi [undef, spawn], [result, nospawn]
+ */
+bool codegen_spawn(context_t* context, LLVMBuilderRef builder, fun_call_node_t* node, codegen_task_t* task) {
+  symbol_t* symbol = symbol_get(context->symbol_table, node->name);
+  if (!symbol) {
+    fprintf(stderr, "Unable to find symbol with name: %s\n", node->name);
+    return false;
+  }
+  unsigned int arg_count = node->params->size;
+  LLVMValueRef args[arg_count];
+  LLVMTypeRef field_types[arg_count + 1];
+  field_types[0] = type_get_ref(node->type);
+  unsigned int field_count = 1;
+  list_item_t* iter = list_iter_init(node->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    args[i] = codegen_expr(context, builder, iter->val);
+    if (args[i] == NULL) return false;
+    if (!LLVMIsConstant(args[i])) {
+      field_types[field_count++] = LLVMTypeOf(args[i]);
+    }
+  }
+  LLVMTypeRef frame_type = LLVMStructType(field_types, field_count, false);
+  task->frame = codegen_entry_alloca(builder, frame_type, "frame");
+  LLVMTypeRef ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
+
+  LLVMValueRef free_workers = LLVMGetNamedGlobal(get_current_module(), "runtime_free_workers");
+  if (free_workers == NULL) {
+    free_workers = LLVMAddGlobal(get_current_module(), LLVMInt64Type(), "runtime_free_workers");
+  }
+  // the pool changes it from other threads, an outdated count only costs a spawn or a call
+  LLVMValueRef free_count = LLVMBuildLoad(builder, free_workers, "freeworkers");
+  LLVMSetOrdering(free_count, LLVMAtomicOrderingMonotonic);
+  LLVMSetAlignment(free_count, 8);
+  LLVMValueRef can_spawn = LLVMBuildICmp(builder, LLVMIntSGT, free_count, LLVMConstInt(LLVMInt64Type(), 0, false), "canspawn");
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef spawn_block = LLVMAppendBasicBlock(current_fun, "spawn");
+  LLVMBasicBlockRef call_block = LLVMAppendBasicBlock(current_fun, "nospawn");
+  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(current_fun, "spawned");
+  LLVMBuildCondBr(builder, can_spawn, spawn_block, call_block);
+
+  LLVMPositionBuilderAtEnd(builder, spawn_block);
+  unsigned int field = 1;
+  for (unsigned int i = 0; i < arg_count; i++) {
+    if (!LLVMIsConstant(args[i])) {
+      LLVMBuildStore(builder, args[i], LLVMBuildStructGEP(builder, task->frame, field++, ""));
+    }
+  }
+  LLVMValueRef thunk = codegen_thunk(context, symbol->value, frame_type, args, arg_count);
+  LLVMTypeRef param_types[] = { LLVMTypeOf(thunk), ptr_type };
+  LLVMValueRef spawn_fun = codegen_runtime_fun("runtime_spawn", ptr_type, param_types, 2);
+  LLVMValueRef spawn_args[] = { thunk, LLVMBuildBitCast(builder, task->frame, ptr_type, "") };
+  LLVMValueRef spawned_task = LLVMBuildCall(builder, spawn_fun, spawn_args, 2, "task");
+  LLVMBuildBr(builder, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, call_block);
+  LLVMValueRef result = LLVMBuildCall(builder, symbol->value, args, arg_count, "fun_res");
+  LLVMSetInstructionCallConv(result, LLVMGetFunctionCallConv(symbol->value));
+  LLVMBuildBr(builder, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, merge_block);
+  task->task = LLVMBuildPhi(builder, ptr_type, "task");
+  LLVMValueRef no_task = LLVMConstNull(ptr_type);
+  LLVMAddIncoming(task->task, &spawned_task, &spawn_block, 1);
+  LLVMAddIncoming(task->task, &no_task, &call_block, 1);
+  task->result = LLVMBuildPhi(builder, field_types[0], "result");
+  LLVMValueRef no_result = LLVMGetUndef(field_types[0]);
+  LLVMAddIncoming(task->result, &no_result, &spawn_block, 1);
+  LLVMAddIncoming(task->result, &result, &call_block, 1);
+  return true;
+}
+
+// the result, once the task is done
+LLVMValueRef codegen_join(LLVMBuilderRef builder, codegen_task_t* task) {
+  LLVMBasicBlockRef from_block = LLVMGetInsertBlock(builder);
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(from_block);
+  LLVMBasicBlockRef join_block = LLVMAppendBasicBlock(current_fun, "join");
+  LLVMBasicBlockRef joined_block = LLVMAppendBasicBlock(current_fun, "joined");
+  LLVMBuildCondBr(builder, LLVMBuildIsNotNull(builder, task->task, "wasspawned"), join_block, joined_block);
+
+  LLVMPositionBuilderAtEnd(builder, join_block);
+  LLVMTypeRef ptr_type = LLVMPointerType(LLVMInt8Type(), 0);
+  LLVMValueRef join_fun = codegen_runtime_fun("runtime_join", LLVMVoidType(), &ptr_type, 1);
+  LLVMBuildCall(builder, join_fun, &task->task, 1, "");
+  LLVMValueRef loaded = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, task->frame, 0, ""), "joined");
+  LLVMBuildBr(builder, joined_block);
+
+  LLVMPositionBuilderAtEnd(builder, joined_block);
+  LLVMValueRef result = LLVMBuildPhi(builder, LLVMTypeOf(loaded), "result");
+  LLVMAddIncoming(result, &task->result, &from_block, 1);
+  LLVMAddIncoming(result, &loaded, &join_block, 1);
+  return result;
+}
+
+bool codegen_is_spawned(expr_node_t* node) {
+  return node->node_type == NODE_FUN_CALL && ((fun_call_node_t*)node)->spawn;
+}
+
 LLVMValueRef codegen_expr(context_t* context, LLVMBuilderRef builder, expr_node_t* node) {
   LLVMValueRef (*fun)() = node->codegen_fun;
   return fun(context, builder, node);
@@ -34,12 +501,29 @@ LLVMValueRef codegen_expr_list(context_t* context, LLVMBuilderRef builder, expr_
   context->symbol_table = node->scope;
 
   LLVMValueRef ret = NULL;
+  // declarations whose calls were spawned, joined once the next expression has run alongside them
+  list_t* spawned = list_init();
   list_item_t* iter = list_iter_init(node->expressions);
   for (; iter; iter = list_iter(iter)) {
-    ret = codegen_expr(context, builder, iter->val);
+    expr_node_t* expr = iter->val;
+    if (expr->node_type == NODE_VAR_DECL && codegen_is_spawned(((var_decl_node_t*)expr)->rhs)) {
+      var_decl_node_t* decl = (var_decl_node_t*)expr;
+      codegen_task_t* task = malloc(sizeof(codegen_task_t));
+      task->symbol = symbol_get(context->symbol_table, decl->name);
+      list_push(spawned, task);
+      if (!codegen_spawn(context, builder, (fun_call_node_t*)decl->rhs, task)) return NULL;
+      continue;
+    }
+    ret = codegen_expr(context, builder, expr);
     if (ret == NULL) return NULL;
     LLVMDumpValue(ret);
+    codegen_task_t* task;
+    while ((task = list_shift(spawned))) {
+      ssa_write(task->symbol, LLVMGetInsertBlock(builder), codegen_join(builder, task));
+      free(task);
+    }
   }
+  list_free(spawned);
 
   printf("Restoring parent scope: %p\n", parent_scope);
   context->symbol_table = parent_scope;
@@ -47,15 +531,15 @@ LLVMValueRef codegen_expr_list(context_t* context, LLVMBuilderRef builder, expr_
 }
 
 LLVMValueRef codegen_const_int(context_t* context, LLVMBuilderRef builder, const_int_node_t* node) {
-  return LLVMConstInt(node->type->get_ref(), node->val, 0);
+  return LLVMConstInt(type_get_ref(node->type), node->val, 0);
 }
 
 LLVMValueRef codegen_const_float(context_t* context, LLVMBuilderRef builder, const_float_node_t* node) {
-  return LLVMConstReal(node->type->get_ref(), node->val);
+  return LLVMConstReal(type_get_ref(node->type), node->val);
 }
 
 LLVMValueRef codegen_const_bool(context_t* context, LLVMBuilderRef builder, const_bool_node_t* node) {
-  return LLVMConstInt(node->type->get_ref(), node->val ? 1 : 0, 0);
+  return LLVMConstInt(type_get_ref(node->type), node->val ? 1 : 0, 0);
 }
 
 LLVMValueRef codegen_ident(context_t* context, LLVMBuilderRef builder, ident_node_t* node) {
@@ -65,14 +549,16 @@ LLVMValueRef codegen_ident(context_t* context, LLVMBuilderRef builder, ident_nod
     return NULL;
   }
   printf("Loading %s\n", node->name);
-  LLVMDumpValue(symbol->value);
-  if (!symbol->is_param) {
-    LLVMValueRef load = LLVMBuildLoad(builder, symbol->value, node->name);
-    printf("loaded:\n");
-    LLVMDumpValue(load);
-    return load;
+  if (type_equals(symbol->type, type_get(context->type_sys, "Function"))) {
+    return symbol->value;
+  }
+  LLVMValueRef value = codegen_captured(context, builder, symbol);
+  if (value == NULL) {
+    fprintf(stderr, "Unable to use %s from outside the block\n", node->name);
+    return NULL;
   }
-  return symbol->value;
+  LLVMDumpValue(value);
+  return value;
 }
 
 LLVMValueRef codegen_fun_decl(context_t* context, LLVMBuilderRef builder, var_decl_node_t* node) {
@@ -104,28 +590,100 @@ LLVMValueRef codegen_var_decl(context_t* context, LLVMBuilderRef builder, var_de
   if (type_equals(node->type, type_get(context->type_sys, "Function"))) {
     return codegen_fun_decl(context, builder, node);
   }
-  LLVMTypeRef type = type_get_ref(node->type);
-  if (type == NULL) {
+  if (type_get_ref(node->type) == NULL) {
     fprintf(stderr, "Unrecognized type: %s\n", type_to_string(node->type));
     return NULL;
   }
-  LLVMValueRef alloca = LLVMBuildAlloca(builder, type, node->name);
   LLVMValueRef value = codegen_expr(context, builder, node->rhs);
   if (value == NULL) return NULL;
-  LLVMBuildStore(builder, value, alloca); // yields {void}
   symbol_t* symbol = symbol_get(context->symbol_table, node->name);
   if (!symbol) {
     fprintf(stderr, "Unable to find symbol: %s\n", node->name);
     return NULL;
   }
-  symbol->value = alloca;
+  // no memory involved, the value is the variable until it's reassigned
+  ssa_write(symbol, LLVMGetInsertBlock(builder), value);
+  range_declare(context, symbol, node->rhs);
   return value;
 }
 
+bool codegen_is_speculatable(expr_node_t* node, unsigned int* cost);
+
+/*
+ * a && b and a || b only evaluate b when a doesn't decide the result:
+ *
+ * entry: a, br a, rhs, end    (|| goes to end when a is true)
+ * rhs:   b, br end
+ * end:   phi [a, entry], [b, rhs]
+ *
+ * When b is cheap and safe to evaluate anyway both sides are simply and'ed
+ * or or'ed, so compound conditions don't turn into chains of branches.
+ */
+LLVMValueRef codegen_logical_op(context_t* context, LLVMBuilderRef builder, bin_op_node_t* node) {
+  bool is_and = node->op == BIN_OP_AND;
+  LLVMValueRef lhs = codegen_expr(context, builder, node->lhs);
+  if (lhs == NULL) return NULL;
+  unsigned int cost = 0;
+  // lane masks can't branch
+  if (node->type->kind == TYPE_KIND_VECTOR ||
+      (codegen_is_speculatable(node->rhs, &cost) && cost <= context->select_cost)) {
+    LLVMValueRef rhs = codegen_expr(context, builder, node->rhs);
+    if (rhs == NULL) return NULL;
+    if (is_and) {
+      return LLVMBuildAnd(builder, lhs, rhs, "andop");
+    }
+    return LLVMBuildOr(builder, lhs, rhs, "orop");
+  }
+
+  LLVMBasicBlockRef lhs_block = LLVMGetInsertBlock(builder);
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(lhs_block);
+  LLVMBasicBlockRef rhs_block = LLVMAppendBasicBlock(current_fun, is_and ? "andrhs" : "orrhs");
+  LLVMBasicBlockRef end_block = LLVMAppendBasicBlock(current_fun, is_and ? "andend" : "orend");
+  ssa_unseal(end_block);
+  if (is_and) {
+    LLVMBuildCondBr(builder, lhs, rhs_block, end_block);
+  } else {
+    LLVMBuildCondBr(builder, lhs, end_block, rhs_block);
+  }
+
+  LLVMPositionBuilderAtEnd(builder, rhs_block);
+  // b only runs when a was true for && and false for ||
+  list_t* assumed = range_assume(context, node->lhs, is_and);
+  LLVMValueRef rhs = codegen_expr(context, builder, node->rhs);
+  range_restore(assumed);
+  if (rhs == NULL) return NULL;
+  rhs_block = LLVMGetInsertBlock(builder);
+  LLVMBuildBr(builder, end_block);
+  ssa_seal(end_block);
+
+  LLVMPositionBuilderAtEnd(builder, end_block);
+  LLVMValueRef phi = LLVMBuildPhi(builder, LLVMTypeOf(lhs), is_and ? "and" : "or");
+  LLVMAddIncoming(phi, &lhs, &lhs_block, 1);
+  LLVMAddIncoming(phi, &rhs, &rhs_block, 1);
+  return phi;
+}
+
 LLVMValueRef codegen_bin_op(context_t* context, LLVMBuilderRef builder, bin_op_node_t* node) {
+  if (node->op == BIN_OP_AND || node->op == BIN_OP_OR) {
+    return codegen_logical_op(context, builder, node);
+  }
   LLVMValueRef rhs = codegen_expr(context, builder, node->rhs);
   if (rhs == NULL) return NULL;
   if (node->op == BIN_OP_ASSIGN) {
+    if (node->lhs->node_type == NODE_INDEX) {
+      index_node_t* index_node = (index_node_t*)node->lhs;
+      LLVMValueRef array = codegen_expr(context, builder, index_node->array);
+      if (array == NULL) return NULL;
+      LLVMValueRef index = codegen_expr(context, builder, index_node->index);
+      if (index == NULL) return NULL;
+      if (index_node->array->type->kind == TYPE_KIND_MAP) {
+        type_map_store(index_node->array->type, builder, array, index, rhs);
+        return rhs;
+      }
+      codegen_bounds_check(context, builder, index_node, array, index);
+      type_array_store(index_node->array->type, builder, array, index, rhs);
+      return rhs;
+    }
     if (node->lhs->node_type != NODE_IDENT) {
       fprintf(stderr, "Left hand side of assignment must be an identifier\n");
       return NULL;
@@ -136,16 +694,30 @@ LLVMValueRef codegen_bin_op(context_t* context, LLVMBuilderRef builder, bin_op_n
       fprintf(stderr, "codegen_bin_op: Unable to find symbol with name: %s\n", ident_node->name);
       return NULL;
     }
-    LLVMBuildStore(builder, rhs, symbol->value);
-    return symbol->value;
+    ssa_write(symbol, LLVMGetInsertBlock(builder), rhs);
+    return rhs;
   }
   LLVMValueRef lhs = codegen_expr(context, builder, node->lhs);
   if (lhs == NULL) return NULL;
+  type_t* type_int = type_get(context->type_sys, "Integer");
+  type_t* type_float = type_get(context->type_sys, "Float");
+  if (node->lhs->type->kind == TYPE_KIND_VECTOR || node->rhs->type->kind == TYPE_KIND_VECTOR) {
+    type_t* vector_type = node->lhs->type->kind == TYPE_KIND_VECTOR ? node->lhs->type : node->rhs->type;
+    if (node->lhs->type->kind != TYPE_KIND_VECTOR) {
+      lhs = type_vector_splat(vector_type, builder, lhs);
+    } else if (node->rhs->type->kind != TYPE_KIND_VECTOR) {
+      rhs = type_vector_splat(vector_type, builder, rhs);
+    }
+    type_t* element_type = type_vector_element(vector_type);
+    if (type_name_is(element_type, "Boolean")) {
+      fprintf(stderr, "Unable to perform binary operation on non-numeric operands\n");
+      return NULL;
+    }
+    return codegen_arith_op(builder, node->op, type_equals(element_type, type_int), lhs, rhs);
+  }
   // cast both to float if their types don't match
   type_t* numeric_res_type;
 
-  type_t* type_int = type_get(context->type_sys, "Integer");
-  type_t* type_float = type_get(context->type_sys, "Float");
   bool lhs_is_int = type_equals(node->lhs->type, type_int);
   bool lhs_is_float = type_equals(node->lhs->type, type_float);
   bool rhs_is_int = type_equals(node->rhs->type, type_int);
@@ -173,7 +745,69 @@ LLVMValueRef codegen_bin_op(context_t* context, LLVMBuilderRef builder, bin_op_n
     return NULL;
   }
   bool res_is_int = type_equals(numeric_res_type, type_int);
-  switch(node->op) {
+  if (res_is_int && (node->op == BIN_OP_PLUS || node->op == BIN_OP_MINUS || node->op == BIN_OP_MULT)) {
+    return codegen_int_arith(builder, node->op, lhs, rhs);
+  }
+  return codegen_arith_op(builder, node->op, res_is_int, lhs, rhs);
+}
+
+/*
+ * Integer +, - or * in the current overflow mode. Trapping and saturating
+ * use llvm.s*.with.overflow, which gives the wrapped result and whether it
+ * overflowed. Only the check stays in the hot path, the error call is
+ * weighted like a failed bounds check so it's laid out of the way.
+ */
+LLVMValueRef codegen_int_arith(LLVMBuilderRef builder, bin_op_t op, LLVMValueRef lhs, LLVMValueRef rhs) {
+  if (overflow == OVERFLOW_NSW) {
+    switch (op) {
+      case BIN_OP_PLUS: return LLVMBuildNSWAdd(builder, lhs, rhs, "addop");
+      case BIN_OP_MINUS: return LLVMBuildNSWSub(builder, lhs, rhs, "subop");
+      default: return LLVMBuildNSWMul(builder, lhs, rhs, "mulop");
+    }
+  }
+  if (overflow != OVERFLOW_TRAP && overflow != OVERFLOW_SATURATE) {
+    return codegen_arith_op(builder, op, true, lhs, rhs);
+  }
+
+  char* intrinsic = op == BIN_OP_PLUS ? "llvm.sadd.with.overflow.i64" :
+    op == BIN_OP_MINUS ? "llvm.ssub.with.overflow.i64" : "llvm.smul.with.overflow.i64";
+  LLVMTypeRef int_type = LLVMTypeOf(lhs);
+  LLVMTypeRef result_types[] = { int_type, LLVMInt1Type() };
+  LLVMTypeRef param_types[] = { int_type, int_type };
+  LLVMValueRef fun = codegen_runtime_fun(intrinsic, LLVMStructType(result_types, 2, false), param_types, 2);
+  LLVMValueRef args[] = { lhs, rhs };
+  LLVMValueRef checked = LLVMBuildCall(builder, fun, args, 2, "checked");
+  LLVMValueRef result = LLVMBuildExtractValue(builder, checked, 0, "result");
+  LLVMValueRef overflowed = LLVMBuildExtractValue(builder, checked, 1, "overflowed");
+
+  if (overflow == OVERFLOW_SATURATE) {
+    // past the end on lhs's side for + and -, on the side of the product's sign for *
+    LLVMValueRef sign = op == BIN_OP_MULT ? LLVMBuildXor(builder, lhs, rhs, "productsign") : lhs;
+    LLVMValueRef negative = LLVMBuildICmp(builder, LLVMIntSLT, sign, LLVMConstInt(int_type, 0, false), "negative");
+    LLVMValueRef limit = LLVMBuildSelect(builder, negative,
+        LLVMConstInt(int_type, LONG_MIN, true), LLVMConstInt(int_type, LONG_MAX, true), "limit");
+    return LLVMBuildSelect(builder, overflowed, limit, result, "saturated");
+  }
+
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef ok_block = LLVMAppendBasicBlock(current_fun, "nooverflow");
+  LLVMBasicBlockRef error_block = LLVMAppendBasicBlock(current_fun, "overflow");
+  codegen_set_branch_weights(LLVMBuildCondBr(builder, overflowed, error_block, ok_block), 1, 2000);
+
+  LLVMPositionBuilderAtEnd(builder, error_block);
+  LLVMTypeRef error_param_types[] = { int_type, int_type, LLVMInt32Type() };
+  LLVMValueRef error_fun = codegen_runtime_fun("runtime_overflow_error", LLVMVoidType(), error_param_types, 3);
+  char op_char = op == BIN_OP_PLUS ? '+' : op == BIN_OP_MINUS ? '-' : '*';
+  LLVMValueRef error_args[] = { lhs, rhs, LLVMConstInt(LLVMInt32Type(), op_char, false) };
+  LLVMBuildCall(builder, error_fun, error_args, 3, "");
+  LLVMBuildUnreachable(builder);
+
+  LLVMPositionBuilderAtEnd(builder, ok_block);
+  return result;
+}
+
+LLVMValueRef codegen_build_arith_op(LLVMBuilderRef builder, bin_op_t op, bool res_is_int, LLVMValueRef lhs, LLVMValueRef rhs) {
+  switch(op) {
     case BIN_OP_PLUS:
       if (res_is_int) {
         return LLVMBuildAdd(builder, lhs, rhs, "addop");
@@ -240,15 +874,43 @@ LLVMValueRef codegen_bin_op(context_t* context, LLVMBuilderRef builder, bin_op_n
   }
 }
 
+// works on scalars and lane-wise on vectors alike
+LLVMValueRef codegen_arith_op(LLVMBuilderRef builder, bin_op_t op, bool res_is_int, LLVMValueRef lhs, LLVMValueRef rhs) {
+  LLVMValueRef result = codegen_build_arith_op(builder, op, res_is_int, lhs, rhs);
+  if (result != NULL && !res_is_int) {
+    fastmath_set_flags(result, fast_math);
+  }
+  return result;
+}
+
 LLVMValueRef codegen_unary_op(context_t* context, LLVMBuilderRef builder, unary_op_node_t* node) {
+  if (node->op == UNARY_OP_NOT) {
+    LLVMValueRef rhs = codegen_expr(context, builder, node->rhs);
+    if (rhs == NULL) return NULL;
+    return LLVMBuildNot(builder, rhs, "not");
+  }
   if (node->op == UNARY_OP_NEGATE) {
     LLVMValueRef rhs = codegen_expr(context, builder, node->rhs);
     if (rhs == NULL) return NULL;
     // TODO - codegen negate in type
+    if (node->rhs->type->kind == TYPE_KIND_VECTOR) {
+      type_t* element_type = type_vector_element(node->rhs->type);
+      if (type_name_is(element_type, "Integer")) {
+        return LLVMBuildNeg(builder, rhs, "negative");
+      } else if (type_name_is(element_type, "Float")) {
+        LLVMValueRef negative = LLVMBuildFNeg(builder, rhs, "negative");
+        fastmath_set_flags(negative, fast_math);
+        return negative;
+      }
+      fprintf(stderr, "Could not negate non-numeric type\n");
+      return NULL;
+    }
     if (type_equals(node->rhs->type, type_get(context->type_sys, "Integer"))) {
-      return LLVMBuildSub(builder, LLVMConstInt(LLVMInt64Type(), 0, 0), rhs, "negative");
+      return codegen_int_arith(builder, BIN_OP_MINUS, LLVMConstInt(LLVMInt64Type(), 0, 0), rhs);
     } else if (type_equals(node->rhs->type, type_get(context->type_sys, "Float"))) {
-      return LLVMBuildFSub(builder, LLVMConstReal(LLVMDoubleType(), 0), rhs, "negative");
+      LLVMValueRef negative = LLVMBuildFSub(builder, LLVMConstReal(LLVMDoubleType(), 0), rhs, "negative");
+      fastmath_set_flags(negative, fast_math);
+      return negative;
     } else {
       fprintf(stderr, "Could not negate non-numeric type\n");
       return NULL;
@@ -258,6 +920,164 @@ LLVMValueRef codegen_unary_op(context_t* context, LLVMBuilderRef builder, unary_
   return NULL;
 }
 
+// a Function parameter stands for whatever block the current call bound to it
+symbol_t* codegen_bound(symbol_t* symbol) {
+  while (symbol->bound_to != NULL) {
+    symbol = symbol->bound_to;
+  }
+  return symbol;
+}
+
+bool codegen_param_is_block(context_t* context, fun_param_node_t* param) {
+  return type_equals(param->type, type_get(context->type_sys, "Function"));
+}
+
+// takes a block as a parameter, so it can only be generated once a call says which
+bool codegen_block_is_generic(context_t* context, block_node_t* block) {
+  list_item_t* iter = list_iter_init(block->params);
+  for (; iter; iter = list_iter(iter)) {
+    if (codegen_param_is_block(context, iter->val)) return true;
+  }
+  return false;
+}
+
+// generates the callee's body in place, with its parameters bound to the arguments
+LLVMValueRef codegen_inline_call(context_t* context, LLVMBuilderRef builder, fun_call_node_t* node, symbol_t* callee, LLVMValueRef* args, symbol_t** bound) {
+  block_node_t* block = node->inline_block;
+  LLVMValueRef env = NULL;
+  if (callee->has_env) {
+    env = codegen_captured(context, builder, callee);
+    if (env == NULL) return NULL;
+    env = LLVMBuildBitCast(builder, env, LLVMPointerType(codegen_env_type(context, block), 0), "env");
+  }
+  symbol_t* symbols[block->params->size];
+  list_item_t* iter = list_iter_init(block->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    fun_param_node_t* param = iter->val;
+    symbols[i] = symbol_get_in_scope(block->body->scope, param->name);
+    if (!symbols[i]) {
+      fprintf(stderr, "Could not find symbol for parameter: %s\n", param->name);
+      return NULL;
+    }
+    if (bound[i] != NULL) {
+      // restored below, the callee may be inlined again with another block
+      symbol_t* outer = symbols[i]->bound_to;
+      symbols[i]->bound_to = bound[i];
+      bound[i] = outer;
+    } else {
+      ssa_write(symbols[i], LLVMGetInsertBlock(builder), args[i]);
+    }
+  }
+  // the callee's arithmetic keeps its own overflow mode wherever it lands
+  overflow_t outer_overflow = overflow;
+  overflow = block->overflow != OVERFLOW_DEFAULT ? block->overflow : context->overflow;
+  inline_depth++;
+  codegen_push_closure_frame(block, callee, env);
+  LLVMValueRef res = codegen_expr_list(context, builder, block->body);
+  codegen_pop_closure_frame();
+  inline_depth--;
+  overflow = outer_overflow;
+  iter = list_iter_init(block->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    if (codegen_param_is_block(context, iter->val)) {
+      symbols[i]->bound_to = bound[i];
+    }
+  }
+  return res;
+}
+
+// a copy of a generic block for one set of blocks bound to its Function parameters
+typedef struct {
+  block_node_t* block;
+  symbol_t** bound;
+  LLVMValueRef fun;
+} specialization_t;
+
+static list_t* specializations = NULL;
+
+LLVMValueRef codegen_block_declare(context_t* context, block_node_t* node, char* function_name);
+
+LLVMValueRef codegen_block_body(context_t* context, LLVMBuilderRef builder, block_node_t* node, symbol_t* self, LLVMValueRef func);
+
+LLVMValueRef codegen_specialize(context_t* context, LLVMBuilderRef builder, symbol_t* callee, symbol_t** bound) {
+  block_node_t* block = callee->block;
+  size_t count = block->params->size;
+  if (specializations == NULL) {
+    specializations = list_init();
+  }
+  list_item_t* iter = list_iter_init(specializations);
+  for (; iter; iter = list_iter(iter)) {
+    specialization_t* spec = iter->val;
+    if (spec->block == block && memcmp(spec->bound, bound, count * sizeof(symbol_t*)) == 0) {
+      return spec->fun;
+    }
+  }
+
+  size_t name_length = strlen(callee->name) + 1;
+  for (unsigned int i = 0; i < count; i++) {
+    if (bound[i]) name_length += strlen(bound[i]->name) + 1;
+  }
+  char* name = malloc(name_length);
+  strcpy(name, callee->name);
+  for (unsigned int i = 0; i < count; i++) {
+    if (bound[i]) {
+      strcat(name, ".");
+      strcat(name, bound[i]->name);
+    }
+  }
+  specialization_t* spec = malloc(sizeof(specialization_t));
+  spec->block = block;
+  spec->bound = malloc(count * sizeof(symbol_t*));
+  memcpy(spec->bound, bound, count * sizeof(symbol_t*));
+  // cached before the body, which may call the same specialization
+  spec->fun = codegen_block_declare(context, block, name);
+  list_push(specializations, spec);
+  free(name);
+
+  symbol_t* outer[count];
+  iter = list_iter_init(block->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    fun_param_node_t* param = iter->val;
+    if (bound[i] == NULL) continue;
+    symbol_t* symbol = symbol_get_in_scope(block->body->scope, param->name);
+    outer[i] = symbol->bound_to;
+    symbol->bound_to = bound[i];
+  }
+  LLVMValueRef fun = codegen_block_body(context, builder, block, callee, spec->fun);
+  iter = list_iter_init(block->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    fun_param_node_t* param = iter->val;
+    if (bound[i] == NULL) continue;
+    symbol_get_in_scope(block->body->scope, param->name)->bound_to = outer[i];
+  }
+  return fun == NULL ? NULL : spec->fun;
+}
+
+// the block an argument for a Function parameter names
+symbol_t* codegen_bind_arg(context_t* context, fun_call_node_t* node, fun_param_node_t* param, expr_node_t* arg) {
+  if (arg->node_type != NODE_IDENT) {
+    fprintf(stderr, "%s takes a block for %s, pass one by name\n", node->name, param->name);
+    return NULL;
+  }
+  symbol_t* symbol = symbol_get(context->symbol_table, ((ident_node_t*)arg)->name);
+  if (symbol == NULL || !type_equals(symbol->type, type_get(context->type_sys, "Function"))) {
+    fprintf(stderr, "%s takes a block for %s, %s is not one\n", node->name, param->name, ((ident_node_t*)arg)->name);
+    return NULL;
+  }
+  symbol = codegen_bound(symbol);
+  if (symbol->has_env) {
+    // its environment only exists in the function defining it
+    fprintf(stderr, "Cannot pass %s to %s, it captures variables\n", symbol->name, node->name);
+    return NULL;
+  }
+  type_t* ret_type = type_fun_ret(param->type);
+  if (!type_equals(symbol->ret_type, ret_type)) {
+    fprintf(stderr, "%s takes a block returning %s for %s, %s returns %s\n", node->name, type_to_string(ret_type), param->name, symbol->name, type_to_string(symbol->ret_type));
+    return NULL;
+  }
+  return symbol;
+}
+
 LLVMValueRef codegen_fun_call(context_t* context, LLVMBuilderRef builder, fun_call_node_t* node) {
   printf("function call\n");
   symbol_t* symbol = symbol_get(context->symbol_table, node->name);
@@ -271,77 +1091,298 @@ LLVMValueRef codegen_fun_call(context_t* context, LLVMBuilderRef builder, fun_ca
     fprintf(stderr, "%s is not a function\n", node->name);
     return NULL;
   }
+  symbol = codegen_bound(symbol);
+  if (symbol->block == NULL) {
+    fprintf(stderr, "%s is not bound to a block\n", node->name);
+    return NULL;
+  }
+  if (symbol->num_params != node->params->size) {
+    fprintf(stderr, "wrong number of parameters calling %s (as %s). Expected %zd, got %zd\n", symbol->name, node->name, symbol->num_params, node->params->size);
+    return NULL;
+  }
 
-  LLVMValueRef params[node->params->size];
+  // spawned arguments run on the thread pool while the others are evaluated
+  codegen_task_t tasks[node->params->size];
   list_item_t* iter = list_iter_init(node->params);
   for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    tasks[i].task = NULL;
+    if (codegen_is_spawned(iter->val) && !codegen_spawn(context, builder, iter->val, &tasks[i])) return NULL;
+  }
+
+  // by position; blocks passed for Function parameters go in bound instead
+  LLVMValueRef params[node->params->size];
+  symbol_t* bound[node->params->size];
+  iter = list_iter_init(node->params);
+  list_item_t* param_iter = list_iter_init(symbol->block->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), param_iter = list_iter(param_iter), i++) {
     expr_node_t* param_expr = iter->val;
+    params[i] = NULL;
+    bound[i] = NULL;
+    if (tasks[i].task != NULL) continue;
+    if (codegen_param_is_block(context, param_iter->val)) {
+      bound[i] = codegen_bind_arg(context, node, param_iter->val, param_expr);
+      if (bound[i] == NULL) return NULL;
+      continue;
+    }
     params[i] = codegen_expr(context, builder, param_expr);
+    if (params[i] == NULL) return NULL;
+  }
+  for (unsigned int i = 0; i < node->params->size; i++) {
+    if (tasks[i].task != NULL) {
+      params[i] = codegen_join(builder, &tasks[i]);
+    }
   }
+  codegen_count(builder, node->profile_slot);
+  if (node->inline_block != NULL) {
+    return codegen_inline_call(context, builder, node, symbol, params, bound);
+  }
+
+  LLVMValueRef callee = symbol->value;
+  if (codegen_block_is_generic(context, symbol->block)) {
+    callee = codegen_specialize(context, builder, symbol, bound);
+    if (callee == NULL) return NULL;
+  }
+  // plus the environment, for a block with captures
+  LLVMValueRef args[node->params->size + 1];
+  unsigned int arg_count = 0;
+  for (unsigned int i = 0; i < node->params->size; i++) {
+    if (params[i] != NULL) {
+      args[arg_count++] = params[i];
+    }
+  }
+
+  bool tail = node->tail && inline_depth == 0;
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  if (tail && callee == current_fun) {
+    // self tail call: feed the arguments back into the parameter phis and loop
+    LLVMBasicBlockRef header = LLVMGetNextBasicBlock(LLVMGetEntryBasicBlock(current_fun));
+    LLVMBasicBlockRef from_block = LLVMGetInsertBlock(builder);
+    LLVMValueRef phi = LLVMGetFirstInstruction(header);
+    for (unsigned int i = 0; i < arg_count; i++, phi = LLVMGetNextInstruction(phi)) {
+      LLVMAddIncoming(phi, &args[i], &from_block, 1);
+    }
+    LLVMBuildBr(builder, header);
+    return codegen_after_tail_call(builder, current_fun);
+  }
+
+  if (symbol->has_env) {
+    args[arg_count] = codegen_captured(context, builder, symbol);
+    if (args[arg_count] == NULL) {
+      fprintf(stderr, "Unable to find the environment of %s\n", node->name);
+      return NULL;
+    }
+    arg_count++;
+  }
+
   printf("building call\n");
-  return LLVMBuildCall(builder, symbol->value, params, node->params->size, "fun_res");
+  LLVMValueRef call = LLVMBuildCall(builder, callee, args, arg_count, "fun_res");
+  LLVMSetInstructionCallConv(call, LLVMGetFunctionCallConv(callee));
+  LLVMTypeRef ret_type = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(current_fun)));
+  if (tail && LLVMTypeOf(call) == ret_type) {
+    // a tail call must not be given the caller's stack, which the environment may be on
+    if (!symbol->has_env || !codegen_has_allocas(current_fun)) {
+      LLVMSetTailCall(call, true);
+    }
+    LLVMBuildRet(builder, call);
+    return codegen_after_tail_call(builder, current_fun);
+  }
+  return call;
 }
 
-LLVMTypeRef codegen_get_fun_type_ref(type_system_t* type_sys, block_node_t* block) {
+LLVMTypeRef codegen_get_fun_type_ref(context_t* context, block_node_t* block) {
   printf("Getting function type\n");
+  type_system_t* type_sys = context->type_sys;
   LLVMTypeRef ret_type = type_get_ref(block->body->type);
   if (ret_type == NULL && type_equals(block->body->type, type_get(type_sys, "Funtion"))) {
     expr_list_node_t* expr_list = block->body;
     list_item_t* iter = list_iter_init(expr_list->expressions);
     for (; iter && list_iter(iter); iter = list_iter(iter));
-    ret_type = codegen_get_fun_type_ref(type_sys, (block_node_t*)iter->val);
+    ret_type = codegen_get_fun_type_ref(context, (block_node_t*)iter->val);
   } else if (ret_type == NULL) {
     fprintf(stderr, "Unknown type: %s\n", type_to_string(block->body->type));
     return NULL;
   }
-  size_t param_count = block->params->size;
-  LLVMTypeRef param_types[param_count];
+  size_t param_count = 0;
+  LLVMTypeRef param_types[block->params->size + 1];
   list_item_t* iter = list_iter_init(block->params);
-  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+  for (; iter; iter = list_iter(iter)) {
     fun_param_node_t* param = iter->val;
-    param_types[i] = type_get_ref(param->type);
+    // bound when specialized, see codegen_specialize
+    if (codegen_param_is_block(context, param)) continue;
+    param_types[param_count++] = type_get_ref(param->type);
+  }
+  if (block->captures->size > 0) {
+    // last, so the tail call phis still line up with the parameters
+    param_types[param_count++] = LLVMPointerType(LLVMInt8Type(), 0);
   }
   return LLVMFunctionType(ret_type, param_types, param_count, false);
 }
 
-LLVMValueRef codegen_block(context_t* context, LLVMBuilderRef builder, block_node_t* node, char* function_name) {
-  if (function_name == NULL) {
-    function_name = malloc(sizeof(char) * 512);
-    sprintf(function_name, "function%d", function_index);
-    function_index++;
+/*
+ * Nothing generated code runs can unwind, runtime errors exit instead. The
+ * rest follows from the block's effects. LLVM would infer some of it, but
+ * not past a call into the runtime or a loop it can't prove finite.
+ */
+void codegen_effect_attributes(context_t* context, LLVMValueRef func, unsigned int effects) {
+  codegen_add_attribute(func, "nounwind");
+  // instrumented code counts in a global, and spawning or joining a call
+  // touches the thread pool from any block that may lead to one
+  bool touches_globals = profile_counters != NULL || context->spawns;
+  if (!(effects & (EFFECT_READ | EFFECT_WRITE)) && !touches_globals) {
+    codegen_add_attribute(func, "readnone");
+  } else if (!(effects & EFFECT_WRITE) && !touches_globals) {
+    codegen_add_attribute(func, "readonly");
+  }
+  if (!(effects & EFFECT_DIVERGE)) {
+    codegen_add_attribute(func, "willreturn");
   }
+}
 
+LLVMValueRef codegen_block_declare(context_t* context, block_node_t* node, char* function_name) {
+  LLVMTypeRef function_type = codegen_get_fun_type_ref(context, node);
+  LLVMValueRef func = LLVMAddFunction(get_current_module(), function_name, function_type);
+  if (context->whole_program) {
+    // blocks are only called from generated code, so they can use the cheaper convention
+    LLVMSetFunctionCallConv(func, LLVMFastCallConv);
+    LLVMSetLinkage(func, LLVMInternalLinkage);
+    codegen_effect_attributes(context, func, effect_of_block(context, node));
+  }
+  codegen_target_cpu(context, func);
+  if (node->always_inline) {
+    codegen_add_attribute(func, "alwaysinline");
+  }
+  return func;
+}
+
+LLVMValueRef codegen_block_body(context_t* context, LLVMBuilderRef builder, block_node_t* node, symbol_t* self, LLVMValueRef func) {
   printf("codegen_block\n");
   LLVMBasicBlockRef prev_block = LLVMGetInsertBlock(builder);
 
-  LLVMTypeRef function_type = codegen_get_fun_type_ref(context->type_sys, node);
-  LLVMValueRef func = LLVMAddFunction(get_current_module(), function_name, function_type);
-
-  LLVMValueRef* params = malloc(node->params->size * sizeof(params));
+  LLVMBasicBlockRef entry = LLVMAppendBasicBlock(func, "entry");
+  // self tail calls jump back here with new arguments, see codegen_fun_call
+  LLVMBasicBlockRef header = LLVMAppendBasicBlock(func, "tailrecurse");
+  LLVMPositionBuilderAtEnd(builder, entry);
+  unsigned int param_count = LLVMCountParams(func);
+  LLVMValueRef* params = malloc(param_count * sizeof(LLVMValueRef));
   LLVMGetParams(func, params);
+  LLVMValueRef env = NULL;
+  if (node->captures->size > 0) {
+    env = params[param_count - 1];
+    LLVMSetValueName(env, "env");
+    env = LLVMBuildBitCast(builder, env, LLVMPointerType(codegen_env_type(context, node), 0), "captures");
+  }
+  // in the entry, self tail calls loop without entering again
+  codegen_count(builder, node->profile_slot);
+  if (context->profile) {
+    codegen_set_entry_count(func, context->profile->counts[node->profile_slot]);
+  }
+  LLVMBuildBr(builder, header);
+  LLVMPositionBuilderAtEnd(builder, header);
+  unsigned int outer_fast_math = fast_math;
+  fast_math = context->fast_math | node->fast_math;
+  codegen_fast_math(func, fast_math);
+  overflow_t outer_overflow = overflow;
+  overflow = node->overflow != OVERFLOW_DEFAULT ? node->overflow : context->overflow;
+
   list_item_t* iter = list_iter_init(node->params);
-  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+  for (unsigned int i = 0; iter; iter = list_iter(iter)) {
     fun_param_node_t* param = iter->val;
-    LLVMValueRef param_value = params[i];
+    if (codegen_param_is_block(context, param)) continue;
+    LLVMValueRef param_value = params[i++];
     LLVMSetValueName(param_value, param->name);
     symbol_t* symbol = symbol_get(node->body->scope, param->name);
     if (!symbol) {
       fprintf(stderr, "Could not find symbol for parameter: %s\n", param->name);
       return NULL;
     }
-    symbol->value = param_value;
+    LLVMValueRef phi = LLVMBuildPhi(builder, LLVMTypeOf(param_value), param->name);
+    LLVMAddIncoming(phi, &param_value, &entry, 1);
+    ssa_write(symbol, header, phi);
   }
-  LLVMSetFunctionCallConv(func, LLVMCCallConv);
-
-  LLVMBasicBlockRef entry = LLVMAppendBasicBlock(func, "entry");
-  LLVMPositionBuilderAtEnd(builder, entry);
+  free(params);
 
+  codegen_push_closure_frame(node, self, env);
   LLVMValueRef body = codegen_expr_list(context, builder, node->body);
+  codegen_pop_closure_frame();
+  fast_math = outer_fast_math;
+  overflow = outer_overflow;
   if (!body) return NULL;
 
   LLVMBuildRet(builder, body);
+  codegen_optimize_function(func);
 
   LLVMPositionBuilderAtEnd(builder, prev_block);
+  return func;
+}
+
+// a block's result can be kept if it only depends on Integer and Boolean arguments
+bool codegen_memo_allowed(context_t* context, block_node_t* node, char* function_name) {
+  if (node->captures->size > 0) {
+    fprintf(stderr, "@memo block %s cannot use variables from outside it\n", function_name);
+    return false;
+  }
+  if (node->params->size == 0) {
+    fprintf(stderr, "@memo block %s needs parameters\n", function_name);
+    return false;
+  }
+  list_item_t* iter = list_iter_init(node->params);
+  for (; iter; iter = list_iter(iter)) {
+    fun_param_node_t* param = iter->val;
+    if (!type_name_is(param->type, "Integer") && !type_name_is(param->type, "Boolean")) {
+      fprintf(stderr, "@memo block %s takes %s, only Integer and Boolean parameters can be keys\n", function_name, type_to_string(param->type));
+      return false;
+    }
+  }
+  // a cache hit hands back the stored value, so it can't be an object the caller may change
+  type_t* ret_type = node->body->type;
+  if (!type_name_is(ret_type, "Integer") && !type_name_is(ret_type, "Float") && !type_name_is(ret_type, "Boolean") &&
+      ret_type->kind != TYPE_KIND_VECTOR) {
+    fprintf(stderr, "@memo block %s returns %s, only Integer, Float, Boolean and vector results can be kept\n", function_name, type_to_string(ret_type));
+    return false;
+  }
+  return true;
+}
+
+LLVMValueRef codegen_block(context_t* context, LLVMBuilderRef builder, block_node_t* node, char* function_name) {
+  symbol_t* self = NULL;
+  if (function_name != NULL) {
+    self = symbol_get(context->symbol_table, function_name);
+  } else {
+    function_name = malloc(sizeof(char) * 512);
+    sprintf(function_name, "function%d", function_index);
+    function_index++;
+  }
+
+  LLVMValueRef func;
+  if (codegen_block_is_generic(context, node)) {
+    // nothing to generate until calls bind its Function parameters, see codegen_specialize
+    func = LLVMConstNull(LLVMPointerType(LLVMInt8Type(), 0));
+  } else {
+    func = codegen_block_declare(context, node, function_name);
+    if (self != NULL) {
+      // visible to calls in its own body
+      self->value = func;
+    }
+    LLVMValueRef body_func = func;
+    if (node->memo_size > 0) {
+      if (!codegen_memo_allowed(context, node, function_name)) return NULL;
+      // recursive calls still go through func, and so through the table
+      char* body_name = malloc(strlen(function_name) + 10);
+      sprintf(body_name, "%s.uncached", function_name);
+      body_func = codegen_block_declare(context, node, body_name);
+      free(body_name);
+    }
+    if (codegen_block_body(context, builder, node, self, body_func) == NULL) return NULL;
+    if (body_func != func) {
+      memo_build(func, body_func, node->memo_size);
+      codegen_optimize_function(func);
+    }
+  }
+
+  if (self != NULL && self->has_env) {
+    self->env = codegen_env_init(context, builder, node);
+    if (self->env == NULL) return NULL;
+  }
 
   return func;
 }
@@ -350,11 +1391,82 @@ LLVMValueRef codegen_fun_param(context_t* context, LLVMBuilderRef builder, fun_p
   return NULL;
 }
 
+// Integer +, - and * stop the program on overflow in the trap mode, vectors always wrap
+bool codegen_may_trap_on_overflow(type_t* type) {
+  return overflow == OVERFLOW_TRAP && type_name_is(type, "Integer");
+}
+
+// whether node can be evaluated even when its if arm isn't taken, adding its size to cost
+bool codegen_is_speculatable(expr_node_t* node, unsigned int* cost) {
+  (*cost)++;
+  switch (node->node_type) {
+    case NODE_CONST_INT:
+    case NODE_CONST_FLOAT:
+    case NODE_CONST_BOOL:
+    case NODE_IDENT:
+      return true;
+    case NODE_UNARY_OP: {
+      unary_op_node_t* unary_op = (unary_op_node_t*)node;
+      if (unary_op->op == UNARY_OP_NEGATE && codegen_may_trap_on_overflow(unary_op->rhs->type)) return false;
+      return codegen_is_speculatable(unary_op->rhs, cost);
+    }
+    case NODE_BINARY_OP: {
+      bin_op_node_t* bin_op = (bin_op_node_t*)node;
+      if (bin_op->op == BIN_OP_ASSIGN) return false;
+      if ((bin_op->op == BIN_OP_PLUS || bin_op->op == BIN_OP_MINUS || bin_op->op == BIN_OP_MULT) &&
+          codegen_may_trap_on_overflow(bin_op->type)) {
+        return false;
+      }
+      if ((bin_op->op == BIN_OP_DIV || bin_op->op == BIN_OP_MOD) &&
+          type_name_is(bin_op->lhs->type, "Integer") && type_name_is(bin_op->rhs->type, "Integer")) {
+        // integer division by 0 (or of the smallest Integer by -1) traps
+        if (bin_op->rhs->node_type != NODE_CONST_INT) return false;
+        long divisor = ((const_int_node_t*)bin_op->rhs)->val;
+        if (divisor == 0 || divisor == -1) return false;
+      }
+      return codegen_is_speculatable(bin_op->lhs, cost) && codegen_is_speculatable(bin_op->rhs, cost);
+    }
+    case NODE_FIELD:
+      return codegen_is_speculatable(((field_node_t*)node)->record, cost);
+    case NODE_LENGTH:
+      return codegen_is_speculatable(((length_node_t*)node)->array, cost);
+    case NODE_IF: {
+      if_node_t* if_node = (if_node_t*)node;
+      return if_node->false_expr != NULL
+        && codegen_is_speculatable(if_node->conditional, cost)
+        && codegen_is_speculatable((expr_node_t*)if_node->true_expr, cost)
+        && codegen_is_speculatable((expr_node_t*)if_node->false_expr, cost);
+    }
+    case NODE_EXPR_LIST: {
+      list_item_t* iter = list_iter_init(((expr_list_node_t*)node)->expressions);
+      for (; iter; iter = list_iter(iter)) {
+        if (!codegen_is_speculatable(iter->val, cost)) return false;
+      }
+      return true;
+    }
+    default:
+      // calls, declarations, anything that allocates, stores or checks bounds
+      return false;
+  }
+}
+
+// both arms are cheap and safe to run, so run both and pick one instead of branching
+bool codegen_if_is_select(context_t* context, if_node_t* node) {
+  if (node->false_expr == NULL || !type_equals(node->true_expr->type, node->false_expr->type)) {
+    return false;
+  }
+  // counting needs the branch, and a predictable branch is cheaper than running both arms
+  if (profile_counters != NULL || (context->profile && profile_is_predictable(context->profile, node->profile_slot))) {
+    return false;
+  }
+  unsigned int cost = 0;
+  return codegen_is_speculatable((expr_node_t*)node->true_expr, &cost)
+    && codegen_is_speculatable((expr_node_t*)node->false_expr, &cost)
+    && cost <= context->select_cost;
+}
+
 LLVMValueRef codegen_if(context_t* context, LLVMBuilderRef builder, if_node_t* node) {
   printf("codegen_if\n");
-  LLVMBasicBlockRef prev_block = LLVMGetInsertBlock(builder);
-  LLVMValueRef current_fun = LLVMGetBasicBlockParent(prev_block);
-
   type_t* bool_type = type_get(context->type_sys, "Boolean");
   LLVMValueRef cond_res = codegen_expr(context, builder, node->conditional);
   if (!cond_res) return NULL;
@@ -364,39 +1476,484 @@ LLVMValueRef codegen_if(context_t* context, LLVMBuilderRef builder, if_node_t* n
     return NULL;
   }
 
+  if (codegen_if_is_select(context, node)) {
+    LLVMValueRef then_res = codegen_expr_list(context, builder, node->true_expr);
+    if (!then_res) return NULL;
+    LLVMValueRef else_res = codegen_expr_list(context, builder, node->false_expr);
+    if (!else_res) return NULL;
+    return LLVMBuildSelect(builder, cond_res, then_res, else_res, "select");
+  }
+
+  LLVMBasicBlockRef prev_block = LLVMGetInsertBlock(builder);
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(prev_block);
   LLVMBasicBlockRef then_block = LLVMAppendBasicBlock(current_fun, "then");
   LLVMBasicBlockRef else_block = LLVMAppendBasicBlock(current_fun, "else");
   LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(current_fun, "merge");
+  ssa_unseal(merge_block);
 
   LLVMValueRef br_res = LLVMBuildCondBr(builder, cond_res, then_block, else_block);
+  if (context->profile) {
+    codegen_set_profile_weights(br_res, context->profile->counts[node->profile_slot], context->profile->counts[node->profile_slot + 1]);
+  }
 
   LLVMPositionBuilderAtEnd(builder, then_block);
+  codegen_count(builder, node->profile_slot);
+  list_t* assumed = range_assume(context, node->conditional, true);
   LLVMValueRef then_res = codegen_expr_list(context, builder, node->true_expr);
+  range_restore(assumed);
   if (!then_res) return NULL;
+  // the arm may have ended in a different block than it started in
+  then_block = LLVMGetInsertBlock(builder);
   LLVMValueRef then_br = LLVMBuildBr(builder, merge_block);
 
   LLVMPositionBuilderAtEnd(builder, else_block);
+  codegen_count(builder, node->profile_slot + 1);
+  assumed = range_assume(context, node->conditional, false);
   LLVMValueRef else_res = codegen_expr_list(context, builder, node->false_expr);
+  range_restore(assumed);
   if (!else_res) return NULL;
+  else_block = LLVMGetInsertBlock(builder);
   LLVMValueRef else_br = LLVMBuildBr(builder, merge_block);
+  ssa_seal(merge_block);
 
   LLVMPositionBuilderAtEnd(builder, merge_block);
 
   printf("phi node type: %s\n", type_to_string(node->type));
   printf("then type: %s\n", type_to_string(node->true_expr->type));
   printf("else type: %s\n", type_to_string(node->false_expr->type));
-  LLVMValueRef phi_node = LLVMBuildPhi(builder, node->type->get_ref(), "phi");
+  LLVMValueRef phi_node = LLVMBuildPhi(builder, type_get_ref(node->type), "phi");
   LLVMAddIncoming(phi_node, &then_res, &then_block, 1);
   LLVMAddIncoming(phi_node, &else_res, &else_block, 1);
 
   return phi_node;
 }
 
+/*
+ * header: count = phi [0, preheader], [count + 1, latch]
+ *         br cond, body, exit
+ * body ... latch: br header
+ *
+ * Loop rotation turns this into a guarded do-while at -O1 and above.
+ */
+LLVMValueRef codegen_while(context_t* context, LLVMBuilderRef builder, while_node_t* node) {
+  printf("codegen_while\n");
+  LLVMBasicBlockRef preheader = LLVMGetInsertBlock(builder);
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(preheader);
+  LLVMBasicBlockRef header = LLVMAppendBasicBlock(current_fun, "while");
+  LLVMBasicBlockRef body_block = LLVMAppendBasicBlock(current_fun, "whilebody");
+  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(current_fun, "endwhile");
+  // the latch isn't known until the body has been generated
+  ssa_unseal(header);
+  LLVMBuildBr(builder, header);
+
+  LLVMPositionBuilderAtEnd(builder, header);
+  LLVMTypeRef int_type = type_get_ref(node->type);
+  LLVMValueRef count = LLVMBuildPhi(builder, int_type, "count");
+  LLVMValueRef zero = LLVMConstInt(int_type, 0, false);
+  LLVMAddIncoming(count, &zero, &preheader, 1);
+  LLVMValueRef cond_res = codegen_expr(context, builder, node->conditional);
+  if (!cond_res) return NULL;
+  LLVMBuildCondBr(builder, cond_res, body_block, exit_block);
+
+  LLVMPositionBuilderAtEnd(builder, body_block);
+  if (!codegen_expr_list(context, builder, node->body)) return NULL;
+  LLVMBasicBlockRef latch = LLVMGetInsertBlock(builder);
+  LLVMValueRef next_count = LLVMBuildNSWAdd(builder, count, LLVMConstInt(int_type, 1, false), "nextcount");
+  LLVMAddIncoming(count, &next_count, &latch, 1);
+  LLVMBuildBr(builder, header);
+  ssa_seal(header);
+
+  LLVMPositionBuilderAtEnd(builder, exit_block);
+  return count;
+}
+
+/*
+ * Generated already rotated, so the trip count is end - start:
+ *
+ * preheader: br start < end, body, exit
+ * body: counter = phi [start, preheader], [next, latch]
+ *       ...
+ * latch: next = counter + 1 (nsw, it stays below end)
+ *        br next < end, body, exit
+ */
+LLVMValueRef codegen_for(context_t* context, LLVMBuilderRef builder, for_node_t* node) {
+  printf("codegen_for\n");
+  symbol_t* counter = symbol_get_in_scope(node->body->scope, node->name);
+  if (!counter) {
+    fprintf(stderr, "Could not find symbol for loop variable: %s\n", node->name);
+    return NULL;
+  }
+  LLVMValueRef start = codegen_expr(context, builder, node->start);
+  if (!start) return NULL;
+  LLVMValueRef end = codegen_expr(context, builder, node->end);
+  if (!end) return NULL;
+
+  LLVMBasicBlockRef preheader = LLVMGetInsertBlock(builder);
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(preheader);
+  LLVMBasicBlockRef body_block = LLVMAppendBasicBlock(current_fun, "for");
+  LLVMBasicBlockRef exit_block = LLVMAppendBasicBlock(current_fun, "endfor");
+  ssa_unseal(body_block);
+  LLVMValueRef guard = LLVMBuildICmp(builder, LLVMIntSLT, start, end, "guard");
+  LLVMBuildCondBr(builder, guard, body_block, exit_block);
+
+  LLVMPositionBuilderAtEnd(builder, body_block);
+  LLVMValueRef counter_value = LLVMBuildPhi(builder, LLVMTypeOf(start), node->name);
+  LLVMAddIncoming(counter_value, &start, &preheader, 1);
+  ssa_write(counter, body_block, counter_value);
+  list_t* assumed = range_assume_counter(context, counter, node->start, node->end);
+  LLVMValueRef body = codegen_expr_list(context, builder, node->body);
+  range_restore(assumed);
+  if (!body) return NULL;
+
+  LLVMBasicBlockRef latch = LLVMGetInsertBlock(builder);
+  LLVMValueRef next = LLVMBuildNSWAdd(builder, counter_value, LLVMConstInt(LLVMTypeOf(start), 1, false), "next");
+  LLVMAddIncoming(counter_value, &next, &latch, 1);
+  LLVMValueRef more = LLVMBuildICmp(builder, LLVMIntSLT, next, end, "more");
+  LLVMBuildCondBr(builder, more, body_block, exit_block);
+  ssa_seal(body_block);
+
+  LLVMPositionBuilderAtEnd(builder, exit_block);
+  LLVMValueRef trip_count = LLVMBuildSub(builder, end, start, "tripcount");
+  return LLVMBuildSelect(builder, guard, trip_count, LLVMConstInt(LLVMTypeOf(start), 0, false), "count");
+}
+
+LLVMValueRef codegen_variant(context_t* context, LLVMBuilderRef builder, variant_node_t* node) {
+  LLVMValueRef payload = NULL;
+  if (node->payload) {
+    payload = codegen_expr(context, builder, node->payload);
+    if (!payload) return NULL;
+  }
+  return type_union_build(node->type, builder, node->variant, payload);
+}
+
+// generates every arm, the default and the phi they meet in, once the dispatch is built
+LLVMValueRef codegen_match_arms(context_t* context, LLVMBuilderRef builder, match_node_t* node,
+    LLVMValueRef subject, LLVMBasicBlockRef* arm_blocks, LLVMBasicBlockRef default_block, LLVMBasicBlockRef merge_block) {
+  size_t num_arms = node->arms->size;
+  LLVMValueRef results[num_arms + 1];
+  LLVMBasicBlockRef result_blocks[num_arms + 1];
+  unsigned int num_results = 0;
+  list_item_t* iter = list_iter_init(node->arms);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    match_arm_t* arm = iter->val;
+    LLVMPositionBuilderAtEnd(builder, arm_blocks[i]);
+    if (arm->binding) {
+      symbol_t* symbol = symbol_get_in_scope(arm->body->scope, arm->binding);
+      if (!symbol) {
+        fprintf(stderr, "Could not find symbol for binding: %s\n", arm->binding);
+        return NULL;
+      }
+      ssa_write(symbol, arm_blocks[i], type_union_get_payload(node->subject->type, builder, arm->variant, subject));
+    }
+    LLVMValueRef arm_res = codegen_expr_list(context, builder, arm->body);
+    if (!arm_res) return NULL;
+    results[num_results] = arm_res;
+    result_blocks[num_results] = LLVMGetInsertBlock(builder);
+    num_results++;
+    LLVMBuildBr(builder, merge_block);
+  }
+
+  LLVMPositionBuilderAtEnd(builder, default_block);
+  if (node->default_expr) {
+    LLVMValueRef default_res = codegen_expr_list(context, builder, node->default_expr);
+    if (!default_res) return NULL;
+    results[num_results] = default_res;
+    result_blocks[num_results] = LLVMGetInsertBlock(builder);
+    num_results++;
+    LLVMBuildBr(builder, merge_block);
+  } else {
+    LLVMBuildUnreachable(builder);
+  }
+  ssa_seal(merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, merge_block);
+  LLVMValueRef phi_node = LLVMBuildPhi(builder, type_get_ref(node->type), "phi");
+  LLVMAddIncoming(phi_node, results, result_blocks, num_results);
+  return phi_node;
+}
+
+// ranges wider than this are compared against rather than getting a case per value
+#define MATCH_MAX_RANGE_CASES 64
+
+/*
+ * Each value of a narrow case becomes a case of one switch, which LLVM turns
+ * into a jump table or a binary search. Wide ranges are checked before it
+ * with (subject - lo) <= (hi - lo) unsigned. Cases never overlap, so the
+ * order they're checked in doesn't matter.
+ */
+LLVMValueRef codegen_match_int(context_t* context, LLVMBuilderRef builder, match_node_t* node) {
+  LLVMValueRef subject = codegen_expr(context, builder, node->subject);
+  if (!subject) return NULL;
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMTypeRef int_type = LLVMTypeOf(subject);
+
+  size_t num_arms = node->arms->size;
+  LLVMBasicBlockRef arm_blocks[num_arms];
+  unsigned int num_cases = 0;
+  list_item_t* iter = list_iter_init(node->arms);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    arm_blocks[i] = LLVMAppendBasicBlock(current_fun, "case");
+    list_item_t* case_iter = list_iter_init(((match_arm_t*)iter->val)->cases);
+    for (; case_iter; case_iter = list_iter(case_iter)) {
+      match_case_t* match_case = case_iter->val;
+      unsigned long width = (unsigned long)match_case->hi - (unsigned long)match_case->lo;
+      if (width < MATCH_MAX_RANGE_CASES) {
+        num_cases += width + 1;
+        continue;
+      }
+      LLVMBasicBlockRef next_block = LLVMAppendBasicBlock(current_fun, "notinrange");
+      LLVMValueRef offset = LLVMBuildSub(builder, subject, LLVMConstInt(int_type, match_case->lo, true), "offset");
+      LLVMValueRef in_range = LLVMBuildICmp(builder, LLVMIntULE, offset, LLVMConstInt(int_type, width, false), "inrange");
+      LLVMBuildCondBr(builder, in_range, arm_blocks[i], next_block);
+      LLVMPositionBuilderAtEnd(builder, next_block);
+    }
+  }
+  LLVMBasicBlockRef default_block = LLVMAppendBasicBlock(current_fun, "default");
+  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(current_fun, "merge");
+  ssa_unseal(merge_block);
+
+  LLVMValueRef switch_inst = LLVMBuildSwitch(builder, subject, default_block, num_cases);
+  iter = list_iter_init(node->arms);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    list_item_t* case_iter = list_iter_init(((match_arm_t*)iter->val)->cases);
+    for (; case_iter; case_iter = list_iter(case_iter)) {
+      match_case_t* match_case = case_iter->val;
+      unsigned long width = (unsigned long)match_case->hi - (unsigned long)match_case->lo;
+      for (unsigned long j = 0; width < MATCH_MAX_RANGE_CASES && j <= width; j++) {
+        LLVMAddCase(switch_inst, LLVMConstInt(int_type, match_case->lo + j, true), arm_blocks[i]);
+      }
+    }
+  }
+  return codegen_match_arms(context, builder, node, subject, arm_blocks, default_block, merge_block);
+}
+
+LLVMValueRef codegen_match(context_t* context, LLVMBuilderRef builder, match_node_t* node) {
+  printf("codegen_match\n");
+  if (type_name_is(node->subject->type, "Integer")) {
+    return codegen_match_int(context, builder, node);
+  }
+  LLVMValueRef subject = codegen_expr(context, builder, node->subject);
+  if (!subject) return NULL;
+  type_t* subject_type = node->subject->type;
+  LLVMValueRef current_fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+
+  size_t num_arms = node->arms->size;
+  LLVMBasicBlockRef arm_blocks[num_arms];
+  list_item_t* iter = list_iter_init(node->arms);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    arm_blocks[i] = LLVMAppendBasicBlock(current_fun, ((match_arm_t*)iter->val)->variant->name);
+  }
+  LLVMBasicBlockRef default_block = LLVMAppendBasicBlock(current_fun, "default");
+  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(current_fun, "merge");
+  ssa_unseal(merge_block);
+
+  // every variant gets a case, except the one a niche layout leaves as the default
+  size_t num_variants = subject_type->members->size;
+  LLVMValueRef case_values[num_variants];
+  LLVMBasicBlockRef case_blocks[num_variants];
+  LLVMBasicBlockRef switch_default = default_block;
+  unsigned int num_cases = 0;
+  list_item_t* variant_iter = list_iter_init(subject_type->members);
+  for (; variant_iter; variant_iter = list_iter(variant_iter)) {
+    type_member_t* variant = variant_iter->val;
+    LLVMBasicBlockRef dest = default_block;
+    iter = list_iter_init(node->arms);
+    for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+      if (((match_arm_t*)iter->val)->variant == variant) dest = arm_blocks[i];
+    }
+    LLVMValueRef case_value = type_union_case_value(subject_type, variant);
+    if (case_value == NULL) {
+      switch_default = dest;
+    } else {
+      case_values[num_cases] = case_value;
+      case_blocks[num_cases] = dest;
+      num_cases++;
+    }
+  }
+  LLVMValueRef discriminant = type_union_discriminant(subject_type, builder, subject);
+  LLVMValueRef switch_inst = LLVMBuildSwitch(builder, discriminant, switch_default, num_cases);
+  for (unsigned int i = 0; i < num_cases; i++) {
+    LLVMAddCase(switch_inst, case_values[i], case_blocks[i]);
+  }
+  return codegen_match_arms(context, builder, node, subject, arm_blocks, default_block, merge_block);
+}
+
+LLVMValueRef codegen_record(context_t* context, LLVMBuilderRef builder, record_node_t* node) {
+  LLVMValueRef values[node->values->size];
+  list_item_t* iter = list_iter_init(node->values);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    values[i] = codegen_expr(context, builder, iter->val);
+    if (!values[i]) return NULL;
+  }
+  return type_record_build(node->type, builder, values);
+}
+
+LLVMValueRef codegen_field(context_t* context, LLVMBuilderRef builder, field_node_t* node) {
+  if (node->record->node_type == NODE_INDEX &&
+      ((index_node_t*)node->record)->array->type->kind == TYPE_KIND_ARRAY) {
+    // load just the field rather than the whole element
+    index_node_t* index_node = (index_node_t*)node->record;
+    LLVMValueRef array = codegen_expr(context, builder, index_node->array);
+    if (array == NULL) return NULL;
+    LLVMValueRef index = codegen_expr(context, builder, index_node->index);
+    if (index == NULL) return NULL;
+    codegen_bounds_check(context, builder, index_node, array, index);
+    return type_array_load_field(index_node->array->type, builder, array, index, node->field);
+  }
+  LLVMValueRef record = codegen_expr(context, builder, node->record);
+  if (!record) return NULL;
+  return type_record_get_field(node->record->type, builder, record, node->field);
+}
+
+LLVMValueRef codegen_array(context_t* context, LLVMBuilderRef builder, array_node_t* node) {
+  LLVMValueRef length;
+  if (node->elements) {
+    length = LLVMConstInt(LLVMInt64Type(), node->elements->size, false);
+  } else {
+    length = codegen_expr(context, builder, node->length);
+    if (length == NULL) return NULL;
+  }
+  LLVMValueRef array = type_array_build(node->type, builder, length);
+  if (node->elements) {
+    list_item_t* iter = list_iter_init(node->elements);
+    for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+      LLVMValueRef element = codegen_expr(context, builder, iter->val);
+      if (element == NULL) return NULL;
+      type_array_store(node->type, builder, array, LLVMConstInt(LLVMInt64Type(), i, false), element);
+    }
+  }
+  return array;
+}
+
+LLVMValueRef codegen_index(context_t* context, LLVMBuilderRef builder, index_node_t* node) {
+  LLVMValueRef array = codegen_expr(context, builder, node->array);
+  if (array == NULL) return NULL;
+  if (node->array->type->kind == TYPE_KIND_VECTOR) {
+    // the lane is a constant checked when parsing
+    long lane = ((const_int_node_t*)node->index)->val;
+    return LLVMBuildExtractElement(builder, array, LLVMConstInt(LLVMInt32Type(), lane, false), "lane");
+  }
+  LLVMValueRef index = codegen_expr(context, builder, node->index);
+  if (index == NULL) return NULL;
+  if (node->array->type->kind == TYPE_KIND_MAP) {
+    return type_map_load(node->array->type, builder, array, index);
+  }
+  codegen_bounds_check(context, builder, node, array, index);
+  return type_array_load(node->array->type, builder, array, index);
+}
+
+LLVMValueRef codegen_length(context_t* context, LLVMBuilderRef builder, length_node_t* node) {
+  LLVMValueRef array = codegen_expr(context, builder, node->array);
+  if (array == NULL) return NULL;
+  if (node->array->type->kind == TYPE_KIND_MAP) {
+    return type_map_length(node->array->type, builder, array);
+  }
+  return type_array_length(node->array->type, builder, array);
+}
+
+LLVMValueRef codegen_map(context_t* context, LLVMBuilderRef builder, map_node_t* node) {
+  return type_map_build(node->type, builder);
+}
+
+LLVMValueRef codegen_contains(context_t* context, LLVMBuilderRef builder, contains_node_t* node) {
+  LLVMValueRef map = codegen_expr(context, builder, node->map);
+  if (map == NULL) return NULL;
+  LLVMValueRef key = codegen_expr(context, builder, node->key);
+  if (key == NULL) return NULL;
+  return type_map_contains(node->map->type, builder, map, key);
+}
+
+LLVMValueRef codegen_vector(context_t* context, LLVMBuilderRef builder, vector_node_t* node) {
+  if (node->elements->size == 1) {
+    LLVMValueRef element = codegen_expr(context, builder, node->elements->head->val);
+    if (element == NULL) return NULL;
+    return type_vector_splat(node->type, builder, element);
+  }
+  LLVMValueRef elements[node->elements->size];
+  list_item_t* iter = list_iter_init(node->elements);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    elements[i] = codegen_expr(context, builder, iter->val);
+    if (elements[i] == NULL) return NULL;
+  }
+  return type_vector_build(node->type, builder, elements);
+}
+
+LLVMValueRef codegen_shuffle(context_t* context, LLVMBuilderRef builder, shuffle_node_t* node) {
+  LLVMValueRef lhs = codegen_expr(context, builder, node->lhs);
+  if (lhs == NULL) return NULL;
+  LLVMValueRef rhs = NULL;
+  if (node->rhs) {
+    rhs = codegen_expr(context, builder, node->rhs);
+    if (rhs == NULL) return NULL;
+  }
+  return type_vector_shuffle(builder, lhs, rhs, node->mask, node->mask_size);
+}
+
+LLVMValueRef codegen_reduce(context_t* context, LLVMBuilderRef builder, reduce_node_t* node) {
+  LLVMValueRef vector = codegen_expr(context, builder, node->vector);
+  if (vector == NULL) return NULL;
+  return type_vector_reduce(node->vector->type, builder, node->op, vector);
+}
+
+// the standard pipeline for the -O level, populates both the function and module passes
+LLVMPassManagerBuilderRef codegen_pass_builder(context_t* context) {
+  LLVMPassManagerBuilderRef pass_builder = LLVMPassManagerBuilderCreate();
+  LLVMPassManagerBuilderSetOptLevel(pass_builder, context->opt_level);
+  LLVMPassManagerBuilderSetSizeLevel(pass_builder, context->size_level);
+  // same thresholds as clang
+  if (context->size_level > 0) {
+    LLVMPassManagerBuilderUseInlinerWithThreshold(pass_builder, 75);
+  } else if (context->opt_level > 2) {
+    LLVMPassManagerBuilderUseInlinerWithThreshold(pass_builder, 275);
+  } else if (context->opt_level > 1) {
+    LLVMPassManagerBuilderUseInlinerWithThreshold(pass_builder, 225);
+  }
+  // unrolled after vectorizing instead, see codegen_add_loop_passes
+  LLVMPassManagerBuilderSetDisableUnrollLoops(pass_builder, true);
+  return pass_builder;
+}
+
+// every caller is in the module, so constants and unused arguments can cross calls
+void codegen_add_whole_program_passes(context_t* context, LLVMPassManagerRef pass) {
+  if (!context->whole_program || context->opt_level == 0) return;
+  LLVMAddIPSCCPPass(pass);
+  LLVMAddGlobalDCEPass(pass);
+  LLVMAddDeadArgEliminationPass(pass);
+  LLVMAddFunctionAttrsPass(pass);
+}
+
+// the builder has no switch for the vectorizers, so they follow its pipeline like in clang's
+void codegen_add_loop_passes(context_t* context, LLVMPassManagerRef pass) {
+  if (context->opt_level < 2) return;
+  LLVMAddLoopVectorizePass(pass);
+  if (context->size_level == 0) {
+    LLVMAddSLPVectorizePass(pass);
+  }
+  LLVMAddInstructionCombiningPass(pass);
+  if (context->size_level == 0) {
+    LLVMAddLoopUnrollPass(pass);
+  }
+  LLVMAddCFGSimplificationPass(pass);
+  LLVMAddInstructionCombiningPass(pass);
+}
+
 LLVMModuleRef codegen(context_t* context, expr_node_t* ast) {
   // compile it
   LLVMBuilderRef builder = LLVMCreateBuilder();
 
   mod = LLVMModuleCreateWithName("tool_mod");
+  if (context->profile_generate) {
+    // external, so the optimizer keeps the counters it can't see being read
+    LLVMTypeRef counters_type = LLVMArrayType(LLVMInt64Type(), context->profile_slots);
+    profile_counters = LLVMAddGlobal(mod, counters_type, "profile_counters");
+    LLVMSetInitializer(profile_counters, LLVMConstNull(counters_type));
+  }
+
+  LLVMPassManagerBuilderRef pass_builder = codegen_pass_builder(context);
+  function_passes = LLVMCreateFunctionPassManagerForModule(mod);
+  LLVMPassManagerBuilderPopulateFunctionPassManager(pass_builder, function_passes);
+  LLVMPassManagerBuilderDispose(pass_builder);
+  LLVMInitializeFunctionPassManager(function_passes);
 
   char* node_str = node_to_string(ast->node_type);
   printf("Node type: %s\n", node_str);
@@ -411,6 +1968,16 @@ LLVMModuleRef codegen(context_t* context, expr_node_t* ast) {
   }
   LLVMValueRef main_func = LLVMAddFunction(mod, "main", LLVMFunctionType(ret_type, main_args, 0, 0));
   LLVMSetFunctionCallConv(main_func, LLVMCCallConv);
+  codegen_target_cpu(context, main_func);
+  if (context->whole_program) {
+    codegen_add_attribute(main_func, "nounwind");
+  }
+  fast_math = context->fast_math;
+  codegen_fast_math(main_func, fast_math);
+  overflow = context->overflow;
+  if (context->profile) {
+    codegen_set_entry_count(main_func, 1);
+  }
 
   LLVMBasicBlockRef entry = LLVMAppendBasicBlock(main_func, "entry");
 
@@ -420,6 +1987,12 @@ LLVMModuleRef codegen(context_t* context, expr_node_t* ast) {
   if (ret_value == NULL) return NULL;
 
   LLVMBuildRet(builder, ret_value);
+  codegen_optimize_function(main_func);
+  if (context->profile) {
+    codegen_profile_summary(context->profile);
+  }
+  LLVMFinalizeFunctionPassManager(function_passes);
+  LLVMDisposePassManager(function_passes);
 
   printf("Dumping module before verifier\n");
   LLVMDumpModule(mod);
@@ -4,6 +4,7 @@
 #define CODEGEN_H
 
 #include <llvm-c/Core.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
 
 #include "context.h"
 #include "ast.h"
@@ -34,6 +35,48 @@ LLVMValueRef codegen_fun_param(context_t* context, LLVMBuilderRef builder, fun_p
 
 LLVMValueRef codegen_if(context_t* context, LLVMBuilderRef builder, if_node_t* node);
 
+LLVMValueRef codegen_while(context_t* context, LLVMBuilderRef builder, while_node_t* node);
+
+LLVMValueRef codegen_for(context_t* context, LLVMBuilderRef builder, for_node_t* node);
+
+LLVMValueRef codegen_variant(context_t* context, LLVMBuilderRef builder, variant_node_t* node);
+
+LLVMValueRef codegen_match(context_t* context, LLVMBuilderRef builder, match_node_t* node);
+
+LLVMValueRef codegen_record(context_t* context, LLVMBuilderRef builder, record_node_t* node);
+
+LLVMValueRef codegen_field(context_t* context, LLVMBuilderRef builder, field_node_t* node);
+
+LLVMValueRef codegen_array(context_t* context, LLVMBuilderRef builder, array_node_t* node);
+
+LLVMValueRef codegen_index(context_t* context, LLVMBuilderRef builder, index_node_t* node);
+
+LLVMValueRef codegen_length(context_t* context, LLVMBuilderRef builder, length_node_t* node);
+
+LLVMValueRef codegen_map(context_t* context, LLVMBuilderRef builder, map_node_t* node);
+
+LLVMValueRef codegen_contains(context_t* context, LLVMBuilderRef builder, contains_node_t* node);
+
+LLVMValueRef codegen_vector(context_t* context, LLVMBuilderRef builder, vector_node_t* node);
+
+LLVMValueRef codegen_shuffle(context_t* context, LLVMBuilderRef builder, shuffle_node_t* node);
+
+LLVMValueRef codegen_reduce(context_t* context, LLVMBuilderRef builder, reduce_node_t* node);
+
+LLVMValueRef codegen_arith_op(LLVMBuilderRef builder, bin_op_t op, bool res_is_int, LLVMValueRef lhs, LLVMValueRef rhs);
+
+LLVMValueRef codegen_int_arith(LLVMBuilderRef builder, bin_op_t op, LLVMValueRef lhs, LLVMValueRef rhs);
+
+void codegen_set_branch_weights(LLVMValueRef branch, unsigned int true_weight, unsigned int false_weight);
+
+LLVMValueRef codegen_runtime_fun(char* name, LLVMTypeRef ret_type, LLVMTypeRef* param_types, unsigned int param_count);
+
+LLVMPassManagerBuilderRef codegen_pass_builder(context_t* context);
+
+void codegen_add_loop_passes(context_t* context, LLVMPassManagerRef pass);
+
+void codegen_add_whole_program_passes(context_t* context, LLVMPassManagerRef pass);
+
 LLVMModuleRef codegen(context_t* context, expr_node_t* ast);
 
 #endif
@@ -6,11 +6,27 @@ context_t* context_init() {
   context_t* context = malloc(sizeof(context_t));
   context->symbol_table = symbol_init();
   context->type_sys = type_init();
+  context->opt_level = 2;
+  context->size_level = 0;
+  context->select_cost = 10;
+  context->fast_math = FAST_MATH_NONE;
+  context->overflow = OVERFLOW_WRAP;
+  context->profile_slots = 0;
+  context->profile_generate = NULL;
+  context->profile = NULL;
+  context->cpu = NULL;
+  context->cpu_features = "";
+  context->whole_program = true;
+  context->parallel_cost = 100000;
+  context->spawns = false;
   return context;
 }
 
 void context_free(context_t* context) {
   symbol_table_free(context->symbol_table);
   type_system_free(context->type_sys);
+  if (context->profile) {
+    profile_free(context->profile);
+  }
   free(context);
 }
@@ -4,10 +4,36 @@
 
 #include "symbol.h"
 #include "type.h"
+#include "profile.h"
 
 typedef struct context_t {
   symbol_table_t* symbol_table;
   type_system_t* type_sys;
+  // -O0 to -O3, and 1 for -Os
+  unsigned int opt_level;
+  unsigned int size_level;
+  // an if whose arms add up to at most this many AST nodes becomes a select, see codegen_if
+  unsigned int select_cost;
+  // fast_math_t flags for Float arithmetic in every block, @fastmath adds to them per block
+  unsigned int fast_math;
+  // Integer overflow in blocks without their own @overflow
+  overflow_t overflow;
+  // profile counters handed out to ifs, calls and blocks so far, see profile.h
+  unsigned int profile_slots;
+  // where an instrumented program writes its counts, from -profile-generate
+  const char* profile_generate;
+  // counts from an earlier run, from -profile-use
+  profile_t* profile;
+  // CPU to generate code for, the host's unless -mcpu pins one
+  const char* cpu;
+  // as "+avx2,-avx512f,...", empty to take them all from cpu
+  const char* cpu_features;
+  // the module holds every caller of every block, off with -no-whole-program
+  bool whole_program;
+  // a call estimated to run at least this many AST nodes may run in parallel, 0 for none, see parallel.c
+  unsigned long parallel_cost;
+  // parallel.c marked a call to run on the thread pool
+  bool spawns;
 } context_t;
 
 context_t* context_init();
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "effect.h"
+
+/*
+ * Works out from the AST what a block may do when called, so codegen can
+ * tell LLVM about functions it can't see through, e.g. because a bounds
+ * check calls into the runtime. Anything that touches memory reads or
+ * writes it, and anything that can stop the program or run forever
+ * diverges. Calls add their callee's effects; a block called through a
+ * Function parameter could be any block, so it may do anything. Node types
+ * not listed here are assumed to do everything.
+ *
+ * A call back into a block that is still being walked gets the effects
+ * found so far. The block is walked again until they stop growing, and
+ * blocks whose effects were worked out from another block's unfinished
+ * ones aren't kept, since they may be missing some.
+ */
+
+typedef struct {
+  context_t* context;
+  // of the block being walked, trapping arithmetic can stop the program
+  overflow_t overflow;
+  unsigned int effects;
+  // the outermost block being walked whose unfinished effects were used, 0 for none
+  unsigned int pending_depth;
+} effect_state_t;
+
+// blocks whose walk is in progress
+static unsigned int effect_depth = 0;
+
+static unsigned int effect_block(context_t* context, block_node_t* block, unsigned int* pending_depth);
+
+static bool effect_may_trap(effect_state_t* state, expr_node_t* node) {
+  return state->overflow == OVERFLOW_TRAP && type_name_is(node->type, "Integer");
+}
+
+static unsigned int effect_of_call(effect_state_t* state, fun_call_node_t* call) {
+  symbol_t* symbol = symbol_get(state->context->symbol_table, call->name);
+  if (symbol == NULL || symbol->is_param || symbol->block == NULL) {
+    return EFFECT_ALL;
+  }
+  return effect_block(state->context, symbol->block, &state->pending_depth);
+}
+
+static void effect_visit(expr_node_t* node, effect_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  switch (node->node_type) {
+    case NODE_EXPR_LIST:
+      context->symbol_table = ((expr_list_node_t*)node)->scope;
+      break;
+    case NODE_BLOCK: {
+      // its body runs when it's called, here it only gets its environment
+      block_node_t* block = (block_node_t*)node;
+      if (block->env_escapes && block->captures->size > 0) {
+        state->effects |= EFFECT_WRITE;
+      }
+      return;
+    }
+    case NODE_CONST_INT:
+    case NODE_CONST_FLOAT:
+    case NODE_CONST_BOOL:
+    case NODE_IDENT:
+    case NODE_IF:
+    case NODE_FOR:
+    case NODE_VAR_DECL:
+    case NODE_MATCH:
+    case NODE_VARIANT:
+    case NODE_VECTOR:
+    case NODE_SHUFFLE:
+    case NODE_REDUCE:
+      break;
+    case NODE_WHILE:
+      state->effects |= EFFECT_DIVERGE;
+      break;
+    case NODE_UNARY_OP:
+      if (((unary_op_node_t*)node)->op == UNARY_OP_NEGATE && effect_may_trap(state, node)) {
+        state->effects |= EFFECT_DIVERGE;
+      }
+      break;
+    case NODE_BINARY_OP: {
+      bin_op_node_t* bin_op = (bin_op_node_t*)node;
+      if (bin_op->op == BIN_OP_ASSIGN) {
+        // reassigning a variable only changes which value the name has
+        if (bin_op->lhs->node_type != NODE_IDENT) {
+          state->effects |= EFFECT_WRITE;
+        }
+      } else if ((bin_op->op == BIN_OP_PLUS || bin_op->op == BIN_OP_MINUS || bin_op->op == BIN_OP_MULT) &&
+          effect_may_trap(state, node)) {
+        state->effects |= EFFECT_DIVERGE;
+      }
+      break;
+    }
+    case NODE_INDEX: {
+      type_kind_t kind = ((index_node_t*)node)->array->type->kind;
+      if (kind == TYPE_KIND_ARRAY) {
+        // the bounds check stops the program
+        state->effects |= EFFECT_READ | EFFECT_DIVERGE;
+      } else if (kind == TYPE_KIND_MAP) {
+        state->effects |= EFFECT_READ;
+      }
+      break;
+    }
+    case NODE_FIELD:
+    case NODE_LENGTH:
+    case NODE_CONTAINS:
+      state->effects |= EFFECT_READ;
+      break;
+    case NODE_RECORD:
+    case NODE_MAP:
+      state->effects |= EFFECT_WRITE;
+      break;
+    case NODE_ARRAY:
+      // a negative length or a failed allocation stops the program
+      state->effects |= EFFECT_WRITE | EFFECT_DIVERGE;
+      break;
+    case NODE_FUN_CALL:
+      state->effects |= effect_of_call(state, (fun_call_node_t*)node);
+      break;
+    default:
+      state->effects |= EFFECT_ALL;
+      break;
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))effect_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+unsigned int effect_of(context_t* context, expr_node_t* node) {
+  effect_state_t state;
+  state.context = context;
+  state.overflow = context->overflow;
+  state.effects = EFFECT_NONE;
+  state.pending_depth = 0;
+  symbol_table_t* scope = context->symbol_table;
+  effect_visit(node, &state);
+  context->symbol_table = scope;
+  return state.effects;
+}
+
+static unsigned int effect_block(context_t* context, block_node_t* block, unsigned int* pending_depth) {
+  if (block->effects_depth > 0) {
+    if (*pending_depth == 0 || block->effects_depth < *pending_depth) {
+      *pending_depth = block->effects_depth;
+    }
+    return block->effects;
+  }
+  if (block->effects != EFFECT_UNKNOWN) return block->effects;
+
+  unsigned int own_effects = EFFECT_NONE;
+  if (block->captures->size > 0) {
+    own_effects |= EFFECT_READ;
+  }
+  if (block->memo_size > 0) {
+    // its table of earlier results
+    own_effects |= EFFECT_READ | EFFECT_WRITE;
+  }
+  // what a call back into the block finds at first, recursion may not end
+  block->effects = own_effects | EFFECT_DIVERGE;
+  unsigned int depth = ++effect_depth;
+  block->effects_depth = depth;
+
+  effect_state_t state;
+  state.context = context;
+  state.overflow = block->overflow != OVERFLOW_DEFAULT ? block->overflow : context->overflow;
+  symbol_table_t* scope = context->symbol_table;
+  while (true) {
+    state.effects = own_effects;
+    state.pending_depth = 0;
+    effect_visit((expr_node_t*)block->body, &state);
+    context->symbol_table = scope;
+    if (state.pending_depth == 0) break;
+    // calls back into the block saw too little, walk it again
+    if ((block->effects | state.effects) == block->effects) break;
+    block->effects |= state.effects;
+  }
+
+  effect_depth--;
+  block->effects_depth = 0;
+  unsigned int effects = state.pending_depth == 0 ? state.effects : block->effects;
+  if (state.pending_depth != 0 && state.pending_depth < depth) {
+    // based on an outer block's unfinished effects, worked out again once that's done
+    block->effects = EFFECT_UNKNOWN;
+    if (*pending_depth == 0 || state.pending_depth < *pending_depth) {
+      *pending_depth = state.pending_depth;
+    }
+  } else {
+    block->effects = effects;
+  }
+  return effects;
+}
+
+unsigned int effect_of_block(context_t* context, block_node_t* block) {
+  unsigned int pending_depth = 0;
+  return effect_block(context, block, &pending_depth);
+}
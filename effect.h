@@ -0,0 +1,14 @@
+#ifndef EFFECT_H
+
+#define EFFECT_H
+
+#include "ast.h"
+#include "context.h"
+
+// effect_t flags of calling block, worked out once and kept in the block
+unsigned int effect_of_block(context_t* context, block_node_t* block);
+
+// effect_t flags of evaluating node in the program's top level
+unsigned int effect_of(context_t* context, expr_node_t* node);
+
+#endif
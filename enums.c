@@ -1,6 +1,7 @@
 #include "enums.h"
 #include "stdlib.h"
 #include "stdio.h"
+#include "string.h"
 
 char* token_to_string(token_t token) {
   char* buf = malloc(sizeof(char) * 4096);
@@ -35,6 +36,12 @@ char* token_to_string(token_t token) {
     case TOKEN_ASSIGN:
       sprintf(buf, "=");
       break;
+    case TOKEN_AT:
+      sprintf(buf, "@");
+      break;
+    case TOKEN_DOT:
+      sprintf(buf, ".");
+      break;
     case TOKEN_EQUAL:
       sprintf(buf, "==");
       break;
@@ -50,6 +57,12 @@ char* token_to_string(token_t token) {
     case TOKEN_CLOSE_BRACE:
       sprintf(buf, "}");
       break;
+    case TOKEN_OPEN_BRACKET:
+      sprintf(buf, "[");
+      break;
+    case TOKEN_CLOSE_BRACKET:
+      sprintf(buf, "]");
+      break;
     case TOKEN_SEMI:
       sprintf(buf, ";");
       break;
@@ -71,6 +84,36 @@ char* token_to_string(token_t token) {
     case TOKEN_ELSE:
       sprintf(buf, "else");
       break;
+    case TOKEN_MATCH:
+      sprintf(buf, "match");
+      break;
+    case TOKEN_UNION:
+      sprintf(buf, "union");
+      break;
+    case TOKEN_RECORD:
+      sprintf(buf, "record");
+      break;
+    case TOKEN_WHILE:
+      sprintf(buf, "while");
+      break;
+    case TOKEN_FOR:
+      sprintf(buf, "for");
+      break;
+    case TOKEN_IN:
+      sprintf(buf, "in");
+      break;
+    case TOKEN_DOTDOT:
+      sprintf(buf, "..");
+      break;
+    case TOKEN_AND:
+      sprintf(buf, "&&");
+      break;
+    case TOKEN_OR:
+      sprintf(buf, "||");
+      break;
+    case TOKEN_BANG:
+      sprintf(buf, "!");
+      break;
     case TOKEN_INVALID:
     default:
       sprintf(buf, "invalid token");
@@ -82,6 +125,9 @@ char* token_to_string(token_t token) {
 char* node_to_string(node_t node) {
   char* buf = malloc(sizeof(char) * 4096);
   switch(node) {
+    case NODE_ARRAY:
+      sprintf(buf, "array");
+      break;
     case NODE_BINARY_OP:
       sprintf(buf, "binary operation");
       break;
@@ -94,6 +140,9 @@ char* node_to_string(node_t node) {
     case NODE_EXPR_LIST:
       sprintf(buf, "expression list");
       break;
+    case NODE_FIELD:
+      sprintf(buf, "field");
+      break;
     case NODE_FUN_CALL:
       sprintf(buf, "function call");
       break;
@@ -106,6 +155,39 @@ char* node_to_string(node_t node) {
     case NODE_IF:
       sprintf(buf, "if");
       break;
+    case NODE_WHILE:
+      sprintf(buf, "while");
+      break;
+    case NODE_FOR:
+      sprintf(buf, "for");
+      break;
+    case NODE_INDEX:
+      sprintf(buf, "index");
+      break;
+    case NODE_LENGTH:
+      sprintf(buf, "length");
+      break;
+    case NODE_MATCH:
+      sprintf(buf, "match");
+      break;
+    case NODE_RECORD:
+      sprintf(buf, "record");
+      break;
+    case NODE_MAP:
+      sprintf(buf, "map");
+      break;
+    case NODE_CONTAINS:
+      sprintf(buf, "contains");
+      break;
+    case NODE_REDUCE:
+      sprintf(buf, "reduce");
+      break;
+    case NODE_SHUFFLE:
+      sprintf(buf, "shuffle");
+      break;
+    case NODE_VECTOR:
+      sprintf(buf, "vector");
+      break;
     case NODE_IDENT:
       sprintf(buf, "ident");
       break;
@@ -115,6 +197,9 @@ char* node_to_string(node_t node) {
     case NODE_VAR_DECL:
       sprintf(buf, "declaration");
       break;
+    case NODE_VARIANT:
+      sprintf(buf, "variant");
+      break;
     case NODE_INVALID:
     default:
       sprintf(buf, "invalid node");
@@ -159,6 +244,12 @@ char* bin_op_to_string(bin_op_t op) {
     case BIN_OP_GTE:
       sprintf(buf, ">=");
       break;
+    case BIN_OP_AND:
+      sprintf(buf, "&&");
+      break;
+    case BIN_OP_OR:
+      sprintf(buf, "||");
+      break;
     case BIN_OP_INVALID:
     default:
       sprintf(buf, "invalid binop");
@@ -173,6 +264,9 @@ char* unary_op_to_string(unary_op_t op) {
     case UNARY_OP_NEGATE:
       sprintf(buf, "-");
       break;
+    case UNARY_OP_NOT:
+      sprintf(buf, "!");
+      break;
     case UNARY_OP_INVALID:
     default:
       sprintf(buf, "invalid unary op");
@@ -180,3 +274,59 @@ char* unary_op_to_string(unary_op_t op) {
   }
   return buf;
 }
+
+char* reduce_op_to_string(reduce_op_t op) {
+  char* buf = malloc(sizeof(char) * 512);
+  switch(op) {
+    case REDUCE_OP_ALL:
+      sprintf(buf, "all");
+      break;
+    case REDUCE_OP_ANY:
+      sprintf(buf, "any");
+      break;
+    case REDUCE_OP_MAX:
+      sprintf(buf, "max");
+      break;
+    case REDUCE_OP_MIN:
+      sprintf(buf, "min");
+      break;
+    case REDUCE_OP_PRODUCT:
+      sprintf(buf, "product");
+      break;
+    case REDUCE_OP_SUM:
+      sprintf(buf, "sum");
+      break;
+    case REDUCE_OP_INVALID:
+    default:
+      sprintf(buf, "invalid reduce op");
+      break;
+  }
+  return buf;
+}
+
+fast_math_t fast_math_from_string(char* name) {
+  if (strcmp(name, "reassoc") == 0) return FAST_MATH_REASSOC;
+  if (strcmp(name, "contract") == 0) return FAST_MATH_CONTRACT;
+  if (strcmp(name, "nnan") == 0) return FAST_MATH_NNAN;
+  if (strcmp(name, "ninf") == 0) return FAST_MATH_NINF;
+  if (strcmp(name, "fast") == 0) return FAST_MATH_ALL;
+  return FAST_MATH_NONE;
+}
+
+overflow_t overflow_from_string(char* name) {
+  if (strcmp(name, "wrap") == 0) return OVERFLOW_WRAP;
+  if (strcmp(name, "nsw") == 0) return OVERFLOW_NSW;
+  if (strcmp(name, "trap") == 0) return OVERFLOW_TRAP;
+  if (strcmp(name, "saturate") == 0) return OVERFLOW_SATURATE;
+  return OVERFLOW_DEFAULT;
+}
+
+reduce_op_t reduce_op_from_string(char* name) {
+  for (reduce_op_t op = REDUCE_OP_ALL; op <= REDUCE_OP_SUM; op++) {
+    char* op_name = reduce_op_to_string(op);
+    int cmp = strcmp(op_name, name);
+    free(op_name);
+    if (cmp == 0) return op;
+  }
+  return REDUCE_OP_INVALID;
+}
@@ -7,28 +7,48 @@
 
 typedef enum {
   NODE_INVALID,
+  NODE_ARRAY,
   NODE_BINARY_OP,
   NODE_BLOCK,
   NODE_CONST_BOOL,
   NODE_CONST_FLOAT,
   NODE_CONST_INT,
+  NODE_CONTAINS,
   NODE_EXPR_LIST,
+  NODE_FIELD,
+  NODE_FOR,
   NODE_FUN_CALL,
   NODE_FUN_PARAM,
   NODE_IDENT,
   NODE_IF,
+  NODE_INDEX,
+  NODE_LENGTH,
+  NODE_MAP,
+  NODE_MATCH,
+  NODE_RECORD,
+  NODE_REDUCE,
+  NODE_SHUFFLE,
   NODE_UNARY_OP,
   NODE_VAR_DECL,
+  NODE_VARIANT,
+  NODE_VECTOR,
+  NODE_WHILE,
 } node_t;
 
 typedef enum {
   TOKEN_INVALID,
+  TOKEN_AND,
   TOKEN_ASSIGN,
+  TOKEN_AT,
+  TOKEN_BANG,
   TOKEN_CLOSE_BRACE,
+  TOKEN_CLOSE_BRACKET,
   TOKEN_CLOSE_PAREN,
   TOKEN_COLON,
   TOKEN_COMMA,
   TOKEN_DASH,
+  TOKEN_DOT,
+  TOKEN_DOTDOT,
   TOKEN_ELSE,
   TOKEN_EOF,
   TOKEN_EQUAL,
@@ -38,21 +58,30 @@ typedef enum {
   TOKEN_LTE,
   TOKEN_FALSE,
   TOKEN_FLOAT,
+  TOKEN_FOR,
   TOKEN_FORWARD_SLASH,
   TOKEN_IDENT,
   TOKEN_IF,
+  TOKEN_IN,
   TOKEN_INTEGER,
+  TOKEN_MATCH,
   TOKEN_OPEN_BRACE,
+  TOKEN_OPEN_BRACKET,
   TOKEN_OPEN_PAREN,
+  TOKEN_OR,
   TOKEN_PERCENT,
   TOKEN_PLUS,
+  TOKEN_RECORD,
   TOKEN_SEMI,
   TOKEN_STAR,
   TOKEN_TRUE,
+  TOKEN_UNION,
+  TOKEN_WHILE,
 } token_t;
 
 typedef enum {
   BIN_OP_INVALID,
+  BIN_OP_AND,
   BIN_OP_ASSIGN,
   BIN_OP_DIV,
   BIN_OP_EQ,
@@ -63,14 +92,66 @@ typedef enum {
   BIN_OP_MINUS,
   BIN_OP_MOD,
   BIN_OP_MULT,
+  BIN_OP_OR,
   BIN_OP_PLUS,
 } bin_op_t;
 
 typedef enum {
   UNARY_OP_INVALID,
   UNARY_OP_NEGATE,
+  UNARY_OP_NOT,
 } unary_op_t;
 
+typedef enum {
+  REDUCE_OP_INVALID,
+  REDUCE_OP_ALL,
+  REDUCE_OP_ANY,
+  REDUCE_OP_MAX,
+  REDUCE_OP_MIN,
+  REDUCE_OP_PRODUCT,
+  REDUCE_OP_SUM,
+} reduce_op_t;
+
+// what Float arithmetic may assume, combined as flags
+typedef enum {
+  FAST_MATH_NONE = 0,
+  // (a + b) + c may become a + (b + c), e.g. to sum in vector lanes
+  FAST_MATH_REASSOC = 1,
+  // a * b + c may become a fused multiply-add
+  FAST_MATH_CONTRACT = 2,
+  FAST_MATH_NNAN = 4,
+  FAST_MATH_NINF = 8,
+  FAST_MATH_ALL = 15,
+} fast_math_t;
+
+// what Integer +, - and * do when the result doesn't fit, vectors always wrap
+typedef enum {
+  // a block without @overflow follows the program's mode
+  OVERFLOW_DEFAULT,
+  // two's complement wrap around
+  OVERFLOW_WRAP,
+  // assumed never to happen, so LLVM can reason about induction variables
+  OVERFLOW_NSW,
+  // stop with an error
+  OVERFLOW_TRAP,
+  // clamp to the smallest or largest Integer
+  OVERFLOW_SATURATE,
+} overflow_t;
+
+// what running an expression may do besides computing its value, combined as flags
+typedef enum {
+  EFFECT_NONE = 0,
+  // loads from an array, record, map or closure environment
+  EFFECT_READ = 1,
+  // stores or allocates
+  EFFECT_WRITE = 2,
+  // may never return: loops with while, recurses, or stops on a runtime error
+  EFFECT_DIVERGE = 4,
+  EFFECT_ALL = 7,
+  // not worked out yet
+  EFFECT_UNKNOWN = 8,
+} effect_t;
+
 char* token_to_string(token_t);
 
 char* node_to_string(node_t);
@@ -79,4 +160,14 @@ char* bin_op_to_string(bin_op_t);
 
 char* unary_op_to_string(unary_op_t);
 
+char* reduce_op_to_string(reduce_op_t);
+
+reduce_op_t reduce_op_from_string(char*);
+
+// reassoc, contract, nnan, ninf or fast for all of them, FAST_MATH_NONE if unknown
+fast_math_t fast_math_from_string(char*);
+
+// wrap, nsw, trap or saturate, OVERFLOW_DEFAULT if unknown
+overflow_t overflow_from_string(char*);
+
 #endif
@@ -0,0 +1,318 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "eval.h"
+#include "fold.h"
+
+/*
+ * Runs a call at compile time by interpreting the callee's AST, with
+ * const_int_node_t, const_float_node_t and const_bool_node_t as values.
+ * Each call gets a frame binding the symbols of its parameters and
+ * variables to their values. Anything the interpreter doesn't know gives
+ * up, which makes it a purity check too: a variable from outside the
+ * block isn't in the frame, and nothing it runs can touch memory. So do
+ * arithmetic that overflows or divides by zero, whose outcome depends on
+ * the block's modes at run time, and running out of steps or depth. The
+ * call then stays as it was.
+ */
+
+typedef struct {
+  symbol_t* symbol;
+  expr_node_t* value;
+} eval_binding_t;
+
+typedef struct {
+  context_t* context;
+  unsigned long steps;
+  unsigned int depth;
+} eval_state_t;
+
+static expr_node_t* eval_expr(eval_state_t* state, list_t* frame, expr_node_t* node);
+
+static bool eval_is_const(expr_node_t* node) {
+  return node->node_type == NODE_CONST_INT || node->node_type == NODE_CONST_FLOAT ||
+    node->node_type == NODE_CONST_BOOL;
+}
+
+static expr_node_t* eval_copy(context_t* context, expr_node_t* value) {
+  switch (value->node_type) {
+    case NODE_CONST_INT:
+      return (expr_node_t*)ast_const_int_node_init(context, ((const_int_node_t*)value)->val);
+    case NODE_CONST_FLOAT:
+      return (expr_node_t*)ast_const_float_node_init(context, ((const_float_node_t*)value)->val);
+    default:
+      return (expr_node_t*)ast_const_bool_node_init(context, ((const_bool_node_t*)value)->val);
+  }
+}
+
+static eval_binding_t* eval_lookup(list_t* frame, symbol_t* symbol) {
+  list_item_t* iter = list_iter_init(frame);
+  for (; iter; iter = list_iter(iter)) {
+    eval_binding_t* binding = iter->val;
+    if (binding->symbol == symbol) return binding;
+  }
+  return NULL;
+}
+
+// takes value over
+static void eval_bind(list_t* frame, symbol_t* symbol, expr_node_t* value) {
+  eval_binding_t* binding = eval_lookup(frame, symbol);
+  if (binding == NULL) {
+    binding = malloc(sizeof(eval_binding_t));
+    binding->symbol = symbol;
+    list_push(frame, binding);
+  } else {
+    ast_expr_node_free(binding->value);
+  }
+  binding->value = value;
+}
+
+static void eval_frame_free(list_t* frame) {
+  eval_binding_t* binding;
+  while ((binding = list_shift(frame))) {
+    ast_expr_node_free(binding->value);
+    free(binding);
+  }
+  list_free(frame);
+}
+
+static bool eval_truth(expr_node_t* value, bool* truth) {
+  if (value->node_type != NODE_CONST_BOOL) return false;
+  *truth = ((const_bool_node_t*)value)->val;
+  return true;
+}
+
+static expr_node_t* eval_expr_list(eval_state_t* state, list_t* frame, expr_list_node_t* node) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  context->symbol_table = node->scope;
+  expr_node_t* value = NULL;
+  list_item_t* iter = list_iter_init(node->expressions);
+  for (; iter; iter = list_iter(iter)) {
+    if (value) ast_expr_node_free(value);
+    value = eval_expr(state, frame, iter->val);
+    if (value == NULL) break;
+  }
+  context->symbol_table = parent_scope;
+  return value;
+}
+
+static expr_node_t* eval_ident(eval_state_t* state, list_t* frame, ident_node_t* node) {
+  eval_binding_t* binding = eval_lookup(frame, symbol_get(state->context->symbol_table, node->name));
+  if (binding == NULL) return NULL;
+  return eval_copy(state->context, binding->value);
+}
+
+static expr_node_t* eval_bin_op(eval_state_t* state, list_t* frame, bin_op_node_t* node) {
+  context_t* context = state->context;
+  if (node->op == BIN_OP_ASSIGN) {
+    if (node->lhs->node_type != NODE_IDENT) return NULL;
+    expr_node_t* value = eval_expr(state, frame, node->rhs);
+    if (value == NULL) return NULL;
+    symbol_t* symbol = symbol_get(context->symbol_table, ((ident_node_t*)node->lhs)->name);
+    eval_bind(frame, symbol, eval_copy(context, value));
+    return value;
+  }
+  expr_node_t* lhs = eval_expr(state, frame, node->lhs);
+  if (lhs == NULL) return NULL;
+  bool truth;
+  if ((node->op == BIN_OP_AND || node->op == BIN_OP_OR) && eval_truth(lhs, &truth) &&
+      truth == (node->op == BIN_OP_OR)) {
+    // decided without running the right hand side, like codegen_logical_op
+    return lhs;
+  }
+  expr_node_t* rhs = eval_expr(state, frame, node->rhs);
+  if (rhs == NULL) {
+    ast_expr_node_free(lhs);
+    return NULL;
+  }
+  bin_op_node_t operands = *node;
+  operands.lhs = lhs;
+  operands.rhs = rhs;
+  expr_node_t* value = fold_bin_op_constants(context, &operands);
+  ast_expr_node_free(lhs);
+  ast_expr_node_free(rhs);
+  return value;
+}
+
+static expr_node_t* eval_unary_op(eval_state_t* state, list_t* frame, unary_op_node_t* node) {
+  context_t* context = state->context;
+  expr_node_t* operand = eval_expr(state, frame, node->rhs);
+  if (operand == NULL) return NULL;
+  expr_node_t* value = NULL;
+  if (node->op == UNARY_OP_NOT && operand->node_type == NODE_CONST_BOOL) {
+    value = (expr_node_t*)ast_const_bool_node_init(context, !((const_bool_node_t*)operand)->val);
+  } else if (node->op == UNARY_OP_NEGATE && operand->node_type == NODE_CONST_INT &&
+      ((const_int_node_t*)operand)->val != LONG_MIN) {
+    value = (expr_node_t*)ast_const_int_node_init(context, -((const_int_node_t*)operand)->val);
+  } else if (node->op == UNARY_OP_NEGATE && operand->node_type == NODE_CONST_FLOAT) {
+    value = (expr_node_t*)ast_const_float_node_init(context, -((const_float_node_t*)operand)->val);
+  }
+  ast_expr_node_free(operand);
+  return value;
+}
+
+static expr_node_t* eval_if(eval_state_t* state, list_t* frame, if_node_t* node) {
+  expr_node_t* condition = eval_expr(state, frame, node->conditional);
+  if (condition == NULL) return NULL;
+  bool truth;
+  bool known = eval_truth(condition, &truth);
+  ast_expr_node_free(condition);
+  if (!known) return NULL;
+  expr_list_node_t* arm = truth ? node->true_expr : node->false_expr;
+  // an if without an else has no value when it isn't taken
+  if (arm == NULL) return NULL;
+  return eval_expr_list(state, frame, arm);
+}
+
+static expr_node_t* eval_while(eval_state_t* state, list_t* frame, while_node_t* node) {
+  long count = 0;
+  while (true) {
+    expr_node_t* condition = eval_expr(state, frame, node->conditional);
+    if (condition == NULL) return NULL;
+    bool truth;
+    bool known = eval_truth(condition, &truth);
+    ast_expr_node_free(condition);
+    if (!known) return NULL;
+    if (!truth) break;
+    expr_node_t* body = eval_expr_list(state, frame, node->body);
+    if (body == NULL) return NULL;
+    ast_expr_node_free(body);
+    count++;
+  }
+  return (expr_node_t*)ast_const_int_node_init(state->context, count);
+}
+
+static expr_node_t* eval_for(eval_state_t* state, list_t* frame, for_node_t* node) {
+  context_t* context = state->context;
+  expr_node_t* start = eval_expr(state, frame, node->start);
+  if (start == NULL) return NULL;
+  expr_node_t* end = eval_expr(state, frame, node->end);
+  if (end == NULL || start->node_type != NODE_CONST_INT || end->node_type != NODE_CONST_INT) {
+    ast_expr_node_free(start);
+    if (end) ast_expr_node_free(end);
+    return NULL;
+  }
+  long from = ((const_int_node_t*)start)->val;
+  long to = ((const_int_node_t*)end)->val;
+  ast_expr_node_free(start);
+  ast_expr_node_free(end);
+  symbol_t* counter = symbol_get_in_scope(node->body->scope, node->name);
+  for (long i = from; i < to; i++) {
+    eval_bind(frame, counter, (expr_node_t*)ast_const_int_node_init(context, i));
+    expr_node_t* body = eval_expr_list(state, frame, node->body);
+    if (body == NULL) return NULL;
+    ast_expr_node_free(body);
+  }
+  // codegen_for's trip count wraps
+  long count = from < to ? (long)((unsigned long)to - (unsigned long)from) : 0;
+  return (expr_node_t*)ast_const_int_node_init(context, count);
+}
+
+static expr_node_t* eval_var_decl(eval_state_t* state, list_t* frame, var_decl_node_t* node) {
+  expr_node_t* value = eval_expr(state, frame, node->rhs);
+  if (value == NULL) return NULL;
+  eval_bind(frame, symbol_get(state->context->symbol_table, node->name), eval_copy(state->context, value));
+  return value;
+}
+
+// runs block with args, which it takes over
+static expr_node_t* eval_block(eval_state_t* state, block_node_t* block, expr_node_t** args) {
+  if (state->depth == EVAL_MAX_DEPTH) {
+    for (unsigned int i = 0; i < block->params->size; i++) {
+      ast_expr_node_free(args[i]);
+    }
+    return NULL;
+  }
+  state->depth++;
+  list_t* frame = list_init();
+  list_item_t* iter = list_iter_init(block->params);
+  bool bound = true;
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    symbol_t* param = symbol_get_in_scope(block->body->scope, ((fun_param_node_t*)iter->val)->name);
+    if (param == NULL || !type_equals(param->type, args[i]->type)) {
+      bound = false;
+    }
+    eval_bind(frame, param, args[i]);
+  }
+  expr_node_t* value = bound ? eval_expr_list(state, frame, block->body) : NULL;
+  eval_frame_free(frame);
+  state->depth--;
+  return value;
+}
+
+static block_node_t* eval_callee(context_t* context, fun_call_node_t* call) {
+  symbol_t* symbol = symbol_get(context->symbol_table, call->name);
+  if (symbol == NULL || symbol->is_param || symbol->block == NULL ||
+      symbol->block->params->size != call->params->size) {
+    return NULL;
+  }
+  return symbol->block;
+}
+
+static expr_node_t* eval_fun_call(eval_state_t* state, list_t* frame, fun_call_node_t* node) {
+  block_node_t* block = eval_callee(state->context, node);
+  if (block == NULL) return NULL;
+  expr_node_t* args[node->params->size];
+  list_item_t* iter = list_iter_init(node->params);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    args[i] = eval_expr(state, frame, iter->val);
+    if (args[i] == NULL) {
+      while (i > 0) ast_expr_node_free(args[--i]);
+      return NULL;
+    }
+  }
+  return eval_block(state, block, args);
+}
+
+static expr_node_t* eval_expr(eval_state_t* state, list_t* frame, expr_node_t* node) {
+  if (++state->steps > EVAL_MAX_STEPS) return NULL;
+  switch (node->node_type) {
+    case NODE_CONST_INT:
+    case NODE_CONST_FLOAT:
+    case NODE_CONST_BOOL:
+      return eval_copy(state->context, node);
+    case NODE_EXPR_LIST:
+      return eval_expr_list(state, frame, (expr_list_node_t*)node);
+    case NODE_IDENT:
+      return eval_ident(state, frame, (ident_node_t*)node);
+    case NODE_BINARY_OP:
+      return eval_bin_op(state, frame, (bin_op_node_t*)node);
+    case NODE_UNARY_OP:
+      return eval_unary_op(state, frame, (unary_op_node_t*)node);
+    case NODE_IF:
+      return eval_if(state, frame, (if_node_t*)node);
+    case NODE_WHILE:
+      return eval_while(state, frame, (while_node_t*)node);
+    case NODE_FOR:
+      return eval_for(state, frame, (for_node_t*)node);
+    case NODE_VAR_DECL:
+      return eval_var_decl(state, frame, (var_decl_node_t*)node);
+    case NODE_FUN_CALL:
+      return eval_fun_call(state, frame, (fun_call_node_t*)node);
+    default:
+      return NULL;
+  }
+}
+
+expr_node_t* eval_call(context_t* context, fun_call_node_t* call) {
+  block_node_t* block = eval_callee(context, call);
+  if (block == NULL) return NULL;
+  list_item_t* iter = list_iter_init(call->params);
+  for (; iter; iter = list_iter(iter)) {
+    if (!eval_is_const(iter->val)) return NULL;
+  }
+  eval_state_t state;
+  state.context = context;
+  state.steps = 0;
+  state.depth = 0;
+  symbol_table_t* scope = context->symbol_table;
+  expr_node_t* value = eval_fun_call(&state, NULL, call);
+  context->symbol_table = scope;
+  if (value != NULL && !type_equals(value->type, call->type)) {
+    ast_expr_node_free(value);
+    return NULL;
+  }
+  return value;
+}
@@ -0,0 +1,16 @@
+#ifndef EVAL_H
+
+#define EVAL_H
+
+#include "ast.h"
+#include "context.h"
+
+// interpreting a call gives up after this many nodes
+#define EVAL_MAX_STEPS 100000
+// or this many calls deep
+#define EVAL_MAX_DEPTH 256
+
+// The constant a call with constant arguments evaluates to, or NULL, see eval.c
+expr_node_t* eval_call(context_t* context, fun_call_node_t* call);
+
+#endif
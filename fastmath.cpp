@@ -0,0 +1,32 @@
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Operator.h>
+
+#include "fastmath.h"
+#include "enums.h"
+
+using namespace llvm;
+
+void fastmath_set_flags(LLVMValueRef value, unsigned int flags) {
+  // constant operands fold the operation into a constant
+  Instruction* inst = dyn_cast<Instruction>(unwrap(value));
+  if (inst == NULL || !isa<FPMathOperator>(inst)) return;
+  FastMathFlags fmf;
+  if (flags == FAST_MATH_ALL) {
+    fmf.setFast();
+  }
+  if (flags & FAST_MATH_REASSOC) {
+    fmf.setAllowReassoc();
+    // reordering a sum already gives up on the sign of a zero result
+    fmf.setNoSignedZeros();
+  }
+  if (flags & FAST_MATH_CONTRACT) {
+    fmf.setAllowContract();
+  }
+  if (flags & FAST_MATH_NNAN) {
+    fmf.setNoNaNs();
+  }
+  if (flags & FAST_MATH_NINF) {
+    fmf.setNoInfs();
+  }
+  inst->setFastMathFlags(fmf);
+}
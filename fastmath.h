@@ -0,0 +1,23 @@
+#ifndef FASTMATH_H
+
+#define FASTMATH_H
+
+#include <llvm-c/Core.h>
+
+/*
+ * LLVM's C API has no way to put fast-math flags on an instruction, so this
+ * one function is written in C++ against the API it wraps.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// gives a Float operation the fast_math_t flags, anything else is left alone
+void fastmath_set_flags(LLVMValueRef value, unsigned int flags);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
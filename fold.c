@@ -0,0 +1,348 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "fold.h"
+#include "eval.h"
+
+void fold_list(context_t* context, list_t* exprs) {
+  list_item_t* iter = list_iter_init(exprs);
+  for (; iter; iter = list_iter(iter)) {
+    iter->val = fold(context, iter->val);
+  }
+}
+
+expr_list_node_t* fold_expr_list(context_t* context, expr_list_node_t* node) {
+  if (node) {
+    // calls find their callee by name
+    symbol_table_t* parent_scope = context->symbol_table;
+    context->symbol_table = node->scope;
+    fold_list(context, node->expressions);
+    context->symbol_table = parent_scope;
+  }
+  return node;
+}
+
+bool fold_is_number(expr_node_t* node) {
+  return node->node_type == NODE_CONST_INT || node->node_type == NODE_CONST_FLOAT;
+}
+
+double fold_float_val(expr_node_t* node) {
+  if (node->node_type == NODE_CONST_INT) {
+    return ((const_int_node_t*)node)->val;
+  }
+  return ((const_float_node_t*)node)->val;
+}
+
+// true if node is the Integer or Float constant val
+bool fold_is_const(expr_node_t* node, long val) {
+  return fold_is_number(node) && fold_float_val(node) == val;
+}
+
+expr_node_t* fold_int_op(context_t* context, bin_op_t op, long lhs, long rhs) {
+  // what overflow does depends on the block's mode, so it's left to codegen_int_arith
+  long res;
+  switch (op) {
+    case BIN_OP_PLUS:
+      if (__builtin_add_overflow(lhs, rhs, &res)) return NULL;
+      return (expr_node_t*)ast_const_int_node_init(context, res);
+    case BIN_OP_MINUS:
+      if (__builtin_sub_overflow(lhs, rhs, &res)) return NULL;
+      return (expr_node_t*)ast_const_int_node_init(context, res);
+    case BIN_OP_MULT:
+      if (__builtin_mul_overflow(lhs, rhs, &res)) return NULL;
+      return (expr_node_t*)ast_const_int_node_init(context, res);
+    case BIN_OP_DIV:
+    case BIN_OP_MOD:
+      // leave traps to run time
+      if (rhs == 0 || (lhs == LONG_MIN && rhs == -1)) return NULL;
+      return (expr_node_t*)ast_const_int_node_init(context, op == BIN_OP_DIV ? lhs / rhs : lhs % rhs);
+    case BIN_OP_EQ: return (expr_node_t*)ast_const_bool_node_init(context, lhs == rhs);
+    case BIN_OP_GT: return (expr_node_t*)ast_const_bool_node_init(context, lhs > rhs);
+    case BIN_OP_LT: return (expr_node_t*)ast_const_bool_node_init(context, lhs < rhs);
+    case BIN_OP_GTE: return (expr_node_t*)ast_const_bool_node_init(context, lhs >= rhs);
+    case BIN_OP_LTE: return (expr_node_t*)ast_const_bool_node_init(context, lhs <= rhs);
+    default: return NULL;
+  }
+}
+
+expr_node_t* fold_float_op(context_t* context, bin_op_t op, double lhs, double rhs) {
+  switch (op) {
+    case BIN_OP_PLUS: return (expr_node_t*)ast_const_float_node_init(context, lhs + rhs);
+    case BIN_OP_MINUS: return (expr_node_t*)ast_const_float_node_init(context, lhs - rhs);
+    case BIN_OP_MULT: return (expr_node_t*)ast_const_float_node_init(context, lhs * rhs);
+    case BIN_OP_DIV: return (expr_node_t*)ast_const_float_node_init(context, lhs / rhs);
+    case BIN_OP_MOD: return (expr_node_t*)ast_const_float_node_init(context, fmod(lhs, rhs));
+    case BIN_OP_EQ: return (expr_node_t*)ast_const_bool_node_init(context, lhs == rhs);
+    case BIN_OP_GT: return (expr_node_t*)ast_const_bool_node_init(context, lhs > rhs);
+    case BIN_OP_LT: return (expr_node_t*)ast_const_bool_node_init(context, lhs < rhs);
+    case BIN_OP_GTE: return (expr_node_t*)ast_const_bool_node_init(context, lhs >= rhs);
+    case BIN_OP_LTE: return (expr_node_t*)ast_const_bool_node_init(context, lhs <= rhs);
+    default: return NULL;
+  }
+}
+
+// both sides constant; mixed Integer and Float promotes to Float like codegen_bin_op
+expr_node_t* fold_bin_op_constants(context_t* context, bin_op_node_t* node) {
+  expr_node_t* lhs = node->lhs;
+  expr_node_t* rhs = node->rhs;
+  if (lhs->node_type == NODE_CONST_BOOL && rhs->node_type == NODE_CONST_BOOL) {
+    bool a = ((const_bool_node_t*)lhs)->val, b = ((const_bool_node_t*)rhs)->val;
+    switch (node->op) {
+      case BIN_OP_EQ: return (expr_node_t*)ast_const_bool_node_init(context, a == b);
+      case BIN_OP_AND: return (expr_node_t*)ast_const_bool_node_init(context, a && b);
+      case BIN_OP_OR: return (expr_node_t*)ast_const_bool_node_init(context, a || b);
+      default: return NULL;
+    }
+  }
+  if (!fold_is_number(lhs) || !fold_is_number(rhs)) {
+    return NULL;
+  }
+  if (lhs->node_type == NODE_CONST_INT && rhs->node_type == NODE_CONST_INT) {
+    return fold_int_op(context, node->op, ((const_int_node_t*)lhs)->val, ((const_int_node_t*)rhs)->val);
+  }
+  return fold_float_op(context, node->op, fold_float_val(lhs), fold_float_val(rhs));
+}
+
+/*
+ * The side of the operation the result is equal to, or NULL:
+ *
+ * x + 0, 0 + x, x - 0, x * 1, 1 * x, x / 1 -> x
+ *
+ * true && x, x && true, false || x, x || false -> x
+ * false && x -> false, true || x -> true (x never runs anyway)
+ *
+ * Only when x already has the result's type, so Integer x * 1.0 stays a
+ * Float multiply. Float x + 0.0 is left alone since -0.0 + 0.0 is 0.0.
+ */
+expr_node_t* fold_bin_op_identity(bin_op_node_t* node) {
+  expr_node_t* lhs = node->lhs;
+  expr_node_t* rhs = node->rhs;
+  bool is_int = type_name_is(node->type, "Integer");
+  expr_node_t* kept = NULL;
+  switch (node->op) {
+    case BIN_OP_PLUS:
+      if (!is_int) break;
+      if (fold_is_const(rhs, 0)) kept = lhs;
+      else if (fold_is_const(lhs, 0)) kept = rhs;
+      break;
+    case BIN_OP_MINUS:
+      if (fold_is_const(rhs, 0)) kept = lhs;
+      break;
+    case BIN_OP_MULT:
+      if (fold_is_const(rhs, 1)) kept = lhs;
+      else if (fold_is_const(lhs, 1)) kept = rhs;
+      break;
+    case BIN_OP_DIV:
+      if (fold_is_const(rhs, 1)) kept = lhs;
+      break;
+    case BIN_OP_AND:
+    case BIN_OP_OR:
+      if (lhs->node_type == NODE_CONST_BOOL) {
+        // the constant decides the result for false && x and true || x
+        bool decides = ((const_bool_node_t*)lhs)->val == (node->op == BIN_OP_OR);
+        kept = decides ? lhs : rhs;
+      } else if (rhs->node_type == NODE_CONST_BOOL &&
+          ((const_bool_node_t*)rhs)->val == (node->op == BIN_OP_AND)) {
+        kept = lhs;
+      }
+      break;
+    default:
+      break;
+  }
+  if (kept && type_equals(kept->type, node->type)) {
+    return kept;
+  }
+  return NULL;
+}
+
+bool fold_same_ident(expr_node_t* lhs, expr_node_t* rhs) {
+  return lhs->node_type == NODE_IDENT && rhs->node_type == NODE_IDENT &&
+    strcmp(((ident_node_t*)lhs)->name, ((ident_node_t*)rhs)->name) == 0;
+}
+
+expr_node_t* fold_bin_op(context_t* context, bin_op_node_t* node) {
+  node->lhs = fold(context, node->lhs);
+  node->rhs = fold(context, node->rhs);
+  if (node->op == BIN_OP_ASSIGN || node->type->kind == TYPE_KIND_VECTOR) {
+    return (expr_node_t*)node;
+  }
+  expr_node_t* folded = fold_bin_op_constants(context, node);
+  if (folded == NULL && type_name_is(node->type, "Integer")) {
+    // reading a variable has no side effects, so these don't need it
+    if (node->op == BIN_OP_MINUS && fold_same_ident(node->lhs, node->rhs)) {
+      folded = (expr_node_t*)ast_const_int_node_init(context, 0);
+    } else if (node->op == BIN_OP_MULT && ((node->lhs->node_type == NODE_IDENT && fold_is_const(node->rhs, 0)) ||
+          (node->rhs->node_type == NODE_IDENT && fold_is_const(node->lhs, 0)))) {
+      folded = (expr_node_t*)ast_const_int_node_init(context, 0);
+    }
+  }
+  if (folded) {
+    ast_expr_node_free((expr_node_t*)node);
+    return folded;
+  }
+  expr_node_t* kept = fold_bin_op_identity(node);
+  if (kept) {
+    ast_expr_node_free(kept == node->lhs ? node->rhs : node->lhs);
+    free(node);
+    return kept;
+  }
+  return (expr_node_t*)node;
+}
+
+expr_node_t* fold_unary_op(context_t* context, unary_op_node_t* node) {
+  node->rhs = fold(context, node->rhs);
+  expr_node_t* folded = NULL;
+  if (node->op == UNARY_OP_NOT && node->rhs->node_type == NODE_CONST_BOOL) {
+    folded = (expr_node_t*)ast_const_bool_node_init(context, !((const_bool_node_t*)node->rhs)->val);
+  } else if (node->op == UNARY_OP_NEGATE && node->rhs->node_type == NODE_CONST_INT &&
+      ((const_int_node_t*)node->rhs)->val != LONG_MIN) {
+    folded = (expr_node_t*)ast_const_int_node_init(context, -((const_int_node_t*)node->rhs)->val);
+  } else if (node->op == UNARY_OP_NEGATE && node->rhs->node_type == NODE_CONST_FLOAT) {
+    folded = (expr_node_t*)ast_const_float_node_init(context, -((const_float_node_t*)node->rhs)->val);
+  }
+  if (folded) {
+    ast_expr_node_free((expr_node_t*)node);
+    return folded;
+  }
+  return (expr_node_t*)node;
+}
+
+// a constant condition keeps only the branch that runs
+expr_node_t* fold_if(context_t* context, if_node_t* node) {
+  node->conditional = fold(context, node->conditional);
+  fold_expr_list(context, node->true_expr);
+  fold_expr_list(context, node->false_expr);
+  if (node->conditional->node_type != NODE_CONST_BOOL) {
+    return (expr_node_t*)node;
+  }
+  bool truth = ((const_bool_node_t*)node->conditional)->val;
+  expr_list_node_t* taken = truth ? node->true_expr : node->false_expr;
+  expr_list_node_t* untaken = truth ? node->false_expr : node->true_expr;
+  if (taken == NULL || !type_equals(taken->type, node->type)) {
+    return (expr_node_t*)node;
+  }
+  ast_expr_node_free(node->conditional);
+  if (untaken) {
+    ast_expr_node_free((expr_node_t*)untaken);
+  }
+  free(node);
+  return (expr_node_t*)taken;
+}
+
+expr_node_t* fold(context_t* context, expr_node_t* node) {
+  switch (node->node_type) {
+    case NODE_EXPR_LIST:
+      fold_expr_list(context, (expr_list_node_t*)node);
+      return node;
+    case NODE_BINARY_OP:
+      return fold_bin_op(context, (bin_op_node_t*)node);
+    case NODE_UNARY_OP:
+      return fold_unary_op(context, (unary_op_node_t*)node);
+    case NODE_IF:
+      return fold_if(context, (if_node_t*)node);
+    case NODE_WHILE: {
+      while_node_t* while_node = (while_node_t*)node;
+      while_node->conditional = fold(context, while_node->conditional);
+      fold_expr_list(context, while_node->body);
+      return node;
+    }
+    case NODE_FOR: {
+      for_node_t* for_node = (for_node_t*)node;
+      for_node->start = fold(context, for_node->start);
+      for_node->end = fold(context, for_node->end);
+      fold_expr_list(context, for_node->body);
+      return node;
+    }
+    case NODE_VAR_DECL: {
+      var_decl_node_t* var_decl = (var_decl_node_t*)node;
+      var_decl->rhs = fold(context, var_decl->rhs);
+      return node;
+    }
+    case NODE_BLOCK:
+      fold_expr_list(context, ((block_node_t*)node)->body);
+      return node;
+    case NODE_FUN_CALL: {
+      fun_call_node_t* call = (fun_call_node_t*)node;
+      fold_list(context, call->params);
+      // -O0 keeps every call as written
+      expr_node_t* value = context->opt_level > 0 ? eval_call(context, call) : NULL;
+      if (value) {
+        ast_expr_node_free(node);
+        return value;
+      }
+      return node;
+    }
+    case NODE_MATCH: {
+      match_node_t* match = (match_node_t*)node;
+      match->subject = fold(context, match->subject);
+      list_item_t* iter = list_iter_init(match->arms);
+      for (; iter; iter = list_iter(iter)) {
+        fold_expr_list(context, ((match_arm_t*)iter->val)->body);
+      }
+      fold_expr_list(context, match->default_expr);
+      return node;
+    }
+    case NODE_VARIANT: {
+      variant_node_t* variant = (variant_node_t*)node;
+      if (variant->payload) {
+        variant->payload = fold(context, variant->payload);
+      }
+      return node;
+    }
+    case NODE_RECORD:
+      fold_list(context, ((record_node_t*)node)->values);
+      return node;
+    case NODE_FIELD: {
+      field_node_t* field = (field_node_t*)node;
+      field->record = fold(context, field->record);
+      return node;
+    }
+    case NODE_ARRAY: {
+      array_node_t* array = (array_node_t*)node;
+      if (array->elements) {
+        fold_list(context, array->elements);
+      } else {
+        array->length = fold(context, array->length);
+      }
+      return node;
+    }
+    case NODE_INDEX: {
+      index_node_t* index = (index_node_t*)node;
+      index->array = fold(context, index->array);
+      index->index = fold(context, index->index);
+      return node;
+    }
+    case NODE_LENGTH: {
+      length_node_t* length = (length_node_t*)node;
+      length->array = fold(context, length->array);
+      return node;
+    }
+    case NODE_VECTOR:
+      fold_list(context, ((vector_node_t*)node)->elements);
+      return node;
+    case NODE_SHUFFLE: {
+      shuffle_node_t* shuffle = (shuffle_node_t*)node;
+      shuffle->lhs = fold(context, shuffle->lhs);
+      if (shuffle->rhs) {
+        shuffle->rhs = fold(context, shuffle->rhs);
+      }
+      return node;
+    }
+    case NODE_REDUCE: {
+      reduce_node_t* reduce = (reduce_node_t*)node;
+      reduce->vector = fold(context, reduce->vector);
+      return node;
+    }
+    case NODE_CONTAINS: {
+      contains_node_t* contains = (contains_node_t*)node;
+      contains->map = fold(context, contains->map);
+      contains->key = fold(context, contains->key);
+      return node;
+    }
+    default:
+      return node;
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef FOLD_H
+
+#define FOLD_H
+
+#include "ast.h"
+#include "context.h"
+
+// Simplify the typed AST before codegen. Returns the (possibly replaced) node.
+expr_node_t* fold(context_t* context, expr_node_t* node);
+
+// the constant the operation gives on constant operands, or NULL
+expr_node_t* fold_bin_op_constants(context_t* context, bin_op_node_t* node);
+
+#endif
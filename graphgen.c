@@ -194,6 +194,208 @@ graph_vertex_t* graphgen_if(graph_t* graph, if_node_t* node) {
   return if_vertex;
 }
 
+graph_vertex_t* graphgen_while(graph_t* graph, while_node_t* node) {
+  char* label = node_to_string(node->node_type);
+  graph_vertex_t* while_vertex = graph_vertex_init(graph, label);
+  graph_edge_init(graph, while_vertex, graphgen_expr(graph, node->conditional));
+  graph_edge_init(graph, while_vertex, graphgen_expr_list(graph, node->body));
+  return while_vertex;
+}
+
+graph_vertex_t* graphgen_for(graph_t* graph, for_node_t* node) {
+  const char* format_str = "for %s";
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 2 + strlen(node->name) + 1));
+  sprintf(label, format_str, node->name);
+  graph_vertex_t* for_vertex = graph_vertex_init(graph, label);
+  graph_edge_init(graph, for_vertex, graphgen_expr(graph, node->start));
+  graph_edge_init(graph, for_vertex, graphgen_expr(graph, node->end));
+  graph_edge_init(graph, for_vertex, graphgen_expr_list(graph, node->body));
+  return for_vertex;
+}
+
+graph_vertex_t* graphgen_variant(graph_t* graph, variant_node_t* node) {
+  const char* format_str = "%s (%s)";
+  char* type_str = type_to_string(node->type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 4 + strlen(node->variant->name) + strlen(type_str) + 1));
+  sprintf(label, format_str, node->variant->name, type_str);
+
+  graph_vertex_t* variant_vertex = graph_vertex_init(graph, label);
+  if (node->payload) {
+    graph_vertex_t* payload_vertex = graphgen_expr(graph, node->payload);
+    graph_edge_init(graph, variant_vertex, payload_vertex);
+  }
+  return variant_vertex;
+}
+
+graph_vertex_t* graphgen_match(graph_t* graph, match_node_t* node) {
+  const char* format_str = "%s (%s)";
+  char* type_str = type_to_string(node->type);
+  char* node_str = node_to_string(node->node_type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 4 + strlen(type_str) + strlen(node_str) + 1));
+  sprintf(label, format_str, node_str, type_str);
+  free(node_str);
+
+  graph_vertex_t* match_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* subject_vertex = graphgen_expr(graph, node->subject);
+  graph_edge_init(graph, match_vertex, subject_vertex);
+
+  list_item_t* iter = list_iter_init(node->arms);
+  for (; iter; iter = list_iter(iter)) {
+    match_arm_t* arm = iter->val;
+    graph_vertex_t* arm_vertex = graphgen_expr_list(graph, arm->body);
+    graph_edge_init(graph, match_vertex, arm_vertex);
+  }
+  if (node->default_expr) {
+    graph_vertex_t* default_vertex = graphgen_expr_list(graph, node->default_expr);
+    graph_edge_init(graph, match_vertex, default_vertex);
+  }
+  return match_vertex;
+}
+
+graph_vertex_t* graphgen_record(graph_t* graph, record_node_t* node) {
+  const char* format_str = "%s (%s)";
+  char* type_str = type_to_string(node->type);
+  char* node_str = node_to_string(node->node_type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 4 + strlen(type_str) + strlen(node_str) + 1));
+  sprintf(label, format_str, node_str, type_str);
+  free(node_str);
+
+  graph_vertex_t* record_vertex = graph_vertex_init(graph, label);
+  unsigned int rank = graph->rank_counter++;
+  list_item_t* iter = list_iter_init(node->values);
+  for (; iter; iter = list_iter(iter)) {
+    graph_vertex_t* value_vertex = graphgen_expr(graph, iter->val);
+    value_vertex->rank = rank;
+    graph_edge_init(graph, record_vertex, value_vertex);
+  }
+  return record_vertex;
+}
+
+graph_vertex_t* graphgen_field(graph_t* graph, field_node_t* node) {
+  const char* format_str = ".%s (%s)";
+  char* type_str = type_to_string(node->type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 4 + strlen(node->field->name) + strlen(type_str) + 1));
+  sprintf(label, format_str, node->field->name, type_str);
+
+  graph_vertex_t* field_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* record_vertex = graphgen_expr(graph, node->record);
+  graph_edge_init(graph, field_vertex, record_vertex);
+  return field_vertex;
+}
+
+graph_vertex_t* graphgen_array(graph_t* graph, array_node_t* node) {
+  const char* format_str = "%s (%s)";
+  char* type_str = type_to_string(node->type);
+  char* node_str = node_to_string(node->node_type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 4 + strlen(type_str) + strlen(node_str) + 1));
+  sprintf(label, format_str, node_str, type_str);
+  free(node_str);
+
+  graph_vertex_t* array_vertex = graph_vertex_init(graph, label);
+  if (node->elements) {
+    unsigned int rank = graph->rank_counter++;
+    list_item_t* iter = list_iter_init(node->elements);
+    for (; iter; iter = list_iter(iter)) {
+      graph_vertex_t* element_vertex = graphgen_expr(graph, iter->val);
+      element_vertex->rank = rank;
+      graph_edge_init(graph, array_vertex, element_vertex);
+    }
+  } else {
+    graph_vertex_t* length_vertex = graphgen_expr(graph, node->length);
+    graph_edge_init(graph, array_vertex, length_vertex);
+  }
+  return array_vertex;
+}
+
+graph_vertex_t* graphgen_index(graph_t* graph, index_node_t* node) {
+  const char* format_str = "[] (%s)";
+  char* type_str = type_to_string(node->type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 2 + strlen(type_str) + 1));
+  sprintf(label, format_str, type_str);
+
+  graph_vertex_t* index_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* array_vertex = graphgen_expr(graph, node->array);
+  graph_vertex_t* position_vertex = graphgen_expr(graph, node->index);
+  graph_edge_init(graph, index_vertex, array_vertex);
+  graph_edge_init(graph, index_vertex, position_vertex);
+  return index_vertex;
+}
+
+graph_vertex_t* graphgen_length(graph_t* graph, length_node_t* node) {
+  const char* format_str = ".length (%s)";
+  char* type_str = type_to_string(node->type);
+  char* label = malloc(sizeof(char) * (strlen(format_str) - 2 + strlen(type_str) + 1));
+  sprintf(label, format_str, type_str);
+
+  graph_vertex_t* length_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* array_vertex = graphgen_expr(graph, node->array);
+  graph_edge_init(graph, length_vertex, array_vertex);
+  return length_vertex;
+}
+
+graph_vertex_t* graphgen_map(graph_t* graph, map_node_t* node) {
+  return graph_vertex_init(graph, strdup(type_to_string(node->type)));
+}
+
+graph_vertex_t* graphgen_contains(graph_t* graph, contains_node_t* node) {
+  graph_vertex_t* contains_vertex = graph_vertex_init(graph, strdup("has"));
+  graph_vertex_t* map_vertex = graphgen_expr(graph, node->map);
+  graph_vertex_t* key_vertex = graphgen_expr(graph, node->key);
+  graph_edge_init(graph, contains_vertex, map_vertex);
+  graph_edge_init(graph, contains_vertex, key_vertex);
+  return contains_vertex;
+}
+
+graph_vertex_t* graphgen_vector(graph_t* graph, vector_node_t* node) {
+  char* label = strdup(type_to_string(node->type));
+  graph_vertex_t* vector_vertex = graph_vertex_init(graph, label);
+  unsigned int rank = graph->rank_counter++;
+  list_item_t* iter = list_iter_init(node->elements);
+  for (; iter; iter = list_iter(iter)) {
+    graph_vertex_t* element_vertex = graphgen_expr(graph, iter->val);
+    element_vertex->rank = rank;
+    graph_edge_init(graph, vector_vertex, element_vertex);
+  }
+  return vector_vertex;
+}
+
+graph_vertex_t* graphgen_shuffle(graph_t* graph, shuffle_node_t* node) {
+  char* label = malloc(sizeof(char) * (strlen("shuffle") + node->mask_size * 4 + 1));
+  char* end = label + sprintf(label, "shuffle");
+  for (unsigned int i = 0; i < node->mask_size; i++) {
+    end += sprintf(end, " %u", node->mask[i]);
+  }
+
+  graph_vertex_t* shuffle_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* lhs_vertex = graphgen_expr(graph, node->lhs);
+  graph_edge_init(graph, shuffle_vertex, lhs_vertex);
+  if (node->rhs) {
+    graph_vertex_t* rhs_vertex = graphgen_expr(graph, node->rhs);
+    graph_edge_init(graph, shuffle_vertex, rhs_vertex);
+  }
+  return shuffle_vertex;
+}
+
+graph_vertex_t* graphgen_reduce(graph_t* graph, reduce_node_t* node) {
+  char* label = reduce_op_to_string(node->op);
+  graph_vertex_t* reduce_vertex = graph_vertex_init(graph, label);
+  graph_vertex_t* vector_vertex = graphgen_expr(graph, node->vector);
+  graph_edge_init(graph, reduce_vertex, vector_vertex);
+  return reduce_vertex;
+}
+
+// appends str to buffer, doubling its size until both fit
+void graphgen_append(char** buffer, size_t* size, const char* str) {
+  size_t length = strlen(*buffer) + strlen(str) + 1;
+  if (length > *size) {
+    while (length > *size) {
+      *size *= 2;
+    }
+    *buffer = realloc(*buffer, sizeof(char) * *size);
+  }
+  strcat(*buffer, str);
+}
+
 char* graphgen(context_t* context, expr_node_t* ast) {
   graph_t* graph = (graph_t*)malloc(sizeof(graph_t));
   graph->id_counter = 1;
@@ -207,8 +409,9 @@ char* graphgen(context_t* context, expr_node_t* ast) {
 
   // ranks keep some vertices on the same level (horizontally)
   // (like expression lists, param lists)
-  char* ranks = malloc(sizeof(char) * 4096);
-  sprintf(ranks, "");
+  size_t ranks_size = 4096;
+  char* ranks = malloc(sizeof(char) * ranks_size);
+  ranks[0] = '\0';
   // partition vertices by rank
   list_t** vertices_by_rank = malloc(sizeof(list_t**) * graph->rank_counter);
   for (unsigned int i = 0; i < graph->rank_counter; i++) {
@@ -224,23 +427,17 @@ char* graphgen(context_t* context, expr_node_t* ast) {
   for (unsigned int i = 1; i < graph->rank_counter; i++) {
     list_t* vertices_for_rank = vertices_by_rank[i];
     if (vertices_for_rank->size > 1) {
-      char* rank_str = malloc(sizeof(char) * 512);
-      char* vertices_for_rank_str = malloc(sizeof(char) * 512);
-      sprintf(vertices_for_rank_str, "");
+      graphgen_append(&ranks, &ranks_size, "\t{ rank = same; ");
       list_item_t* vertex_for_rank_iter = list_iter_init(vertices_for_rank);;
       for (; vertex_for_rank_iter;
           vertex_for_rank_iter = list_iter(vertex_for_rank_iter)) {
         graph_vertex_t* curr_vertex = vertex_for_rank_iter->val;
 
-        char* vertex_str = malloc(sizeof(char) * 512);
+        char vertex_str[32];
         sprintf(vertex_str, "node%d;", curr_vertex->id);
-        strncat(vertices_for_rank_str, vertex_str, strlen(vertex_str));
-        free(vertex_str);
+        graphgen_append(&ranks, &ranks_size, vertex_str);
       }
-      sprintf(rank_str, "\t{ rank = same; %s}\n", vertices_for_rank_str);
-      free(vertices_for_rank_str);
-      strncat(ranks, rank_str, strlen(rank_str));
-      free(rank_str);
+      graphgen_append(&ranks, &ranks_size, "}\n");
     }
   }
   for (unsigned int i = 0; i < graph->rank_counter; i++) {
@@ -249,38 +446,31 @@ char* graphgen(context_t* context, expr_node_t* ast) {
   free(vertices_by_rank);
 
   // add vertices
-  char* vertices = malloc(sizeof(char) * 4096);
-  sprintf(vertices, "");
+  size_t vertices_size = 4096;
+  char* vertices = malloc(sizeof(char) * vertices_size);
+  vertices[0] = '\0';
   list_item_t* vertex_iter = list_iter_init(graph->vertices);
   for (; vertex_iter; vertex_iter = list_iter(vertex_iter)) {
     graph_vertex_t* curr_vertex = vertex_iter->val;
-    char* vertex_str = malloc(sizeof(char) * 512);
+    char* vertex_str = malloc(sizeof(char) * (strlen(curr_vertex->label) + 64));
     sprintf(vertex_str, "\tnode%d[label=\"%s\"];\n", curr_vertex->id, curr_vertex->label);
-    if (strlen(vertices) + strlen(vertex_str) >= 4095) {
-      fprintf(stderr, "Buffer not big enough for vertices\n");
-      exit(1);
-    }
-    strncat(vertices, vertex_str, strlen(vertex_str));
+    graphgen_append(&vertices, &vertices_size, vertex_str);
     free(vertex_str);
   }
 
   // add edges
-  char* edges = malloc(sizeof(char) * 4096);
-  sprintf(edges, "");
+  size_t edges_size = 4096;
+  char* edges = malloc(sizeof(char) * edges_size);
+  edges[0] = '\0';
   list_item_t* edge_iter = list_iter_init(graph->edges);
   for (; edge_iter; edge_iter = list_iter(edge_iter)) {
     graph_edge_t* curr_edge = edge_iter->val;
-    char* edge_str = malloc(sizeof(char) * 512);
+    char edge_str[64];
     sprintf(edge_str, "\tnode%d -> node%d;\n", curr_edge->start->id, curr_edge->end->id);
-    if (strlen(edges) + strlen(edge_str) >= 4095) {
-      fprintf(stderr, "Buffer not big enough for edges\n");
-      exit(1);
-    }
-    strncat(edges, edge_str, strlen(edge_str));
-    free(edge_str);
+    graphgen_append(&edges, &edges_size, edge_str);
   }
 
-  char* dot = malloc(sizeof(char) * (strlen(vertices) + strlen(edges) + 256));
+  char* dot = malloc(sizeof(char) * (strlen(ranks) + strlen(vertices) + strlen(edges) + 256));
   sprintf(dot, "digraph{\n%s\n%s\n%s\n}", ranks, vertices, edges);
   free(ranks);
   free(vertices);
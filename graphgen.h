@@ -51,6 +51,36 @@ graph_vertex_t* graphgen_fun_param(graph_t* builder, fun_param_node_t* node);
 
 graph_vertex_t* graphgen_if(graph_t* builder, if_node_t* node);
 
+graph_vertex_t* graphgen_while(graph_t* builder, while_node_t* node);
+
+graph_vertex_t* graphgen_for(graph_t* builder, for_node_t* node);
+
+graph_vertex_t* graphgen_variant(graph_t* builder, variant_node_t* node);
+
+graph_vertex_t* graphgen_match(graph_t* builder, match_node_t* node);
+
+graph_vertex_t* graphgen_record(graph_t* builder, record_node_t* node);
+
+graph_vertex_t* graphgen_field(graph_t* builder, field_node_t* node);
+
+graph_vertex_t* graphgen_array(graph_t* builder, array_node_t* node);
+
+graph_vertex_t* graphgen_index(graph_t* builder, index_node_t* node);
+
+graph_vertex_t* graphgen_length(graph_t* builder, length_node_t* node);
+
+graph_vertex_t* graphgen_map(graph_t* builder, map_node_t* node);
+
+graph_vertex_t* graphgen_contains(graph_t* builder, contains_node_t* node);
+
+graph_vertex_t* graphgen_vector(graph_t* builder, vector_node_t* node);
+
+graph_vertex_t* graphgen_shuffle(graph_t* builder, shuffle_node_t* node);
+
+graph_vertex_t* graphgen_reduce(graph_t* builder, reduce_node_t* node);
+
+void graphgen_append(char** buffer, size_t* size, const char* str);
+
 char* graphgen(context_t* context, expr_node_t* ast);
 
 #endif
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "inline.h"
+
+/*
+ * Every block assigned to a name is a candidate, costing one per AST node in
+ * its body. Calls to a block under the small threshold are always inlined,
+ * the only call to a block under the single call threshold too. Blocks that
+ * call themselves or define blocks of their own stay out of line.
+ *
+ * With a profile (-profile-use) the single call threshold also goes to hot
+ * calls, those made at least 1/INLINE_HOT_FRACTION as often as the busiest
+ * one, and calls that never ran are only inlined when small, keeping the
+ * code that does run together.
+ */
+
+#define INLINE_HOT_FRACTION 100
+
+typedef struct {
+  symbol_t* symbol;
+  block_node_t* block;
+  unsigned int cost;
+  unsigned int calls;
+  bool inlinable;
+} inline_candidate_t;
+
+typedef struct {
+  context_t* context;
+  list_t* candidates;
+  // counting call sites on the first walk, marking them on the second
+  bool marking;
+  unsigned int small_threshold;
+  unsigned int single_call_threshold;
+  // count of the busiest call in the profile
+  unsigned long max_calls;
+} inline_state_t;
+
+inline_candidate_t* inline_candidate_get(inline_state_t* state, symbol_t* symbol) {
+  list_item_t* iter = list_iter_init(state->candidates);
+  for (; iter; iter = list_iter(iter)) {
+    inline_candidate_t* candidate = iter->val;
+    if (candidate->symbol == symbol) {
+      return candidate;
+    }
+  }
+  return NULL;
+}
+
+bool inline_wanted(inline_state_t* state, inline_candidate_t* candidate, fun_call_node_t* call) {
+  if (!candidate->inlinable) return false;
+  profile_t* profile = state->context->profile;
+  if (profile) {
+    unsigned long calls = profile->counts[call->profile_slot];
+    if (calls == 0) return candidate->cost <= state->small_threshold;
+    if (calls * INLINE_HOT_FRACTION >= state->max_calls && candidate->cost <= state->single_call_threshold) return true;
+  }
+  return candidate->cost <= state->small_threshold
+    || (candidate->calls == 1 && candidate->cost <= state->single_call_threshold);
+}
+
+void inline_cost(expr_node_t* node, inline_candidate_t* candidate) {
+  candidate->cost++;
+  if (node->node_type == NODE_BLOCK) {
+    candidate->inlinable = false;
+  } else if (node->node_type == NODE_FUN_CALL && strcmp(((fun_call_node_t*)node)->name, candidate->symbol->name) == 0) {
+    candidate->inlinable = false;
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))inline_cost, candidate);
+}
+
+void inline_visit(expr_node_t* node, inline_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  if (node->node_type == NODE_EXPR_LIST) {
+    context->symbol_table = ((expr_list_node_t*)node)->scope;
+  } else if (node->node_type == NODE_VAR_DECL && ((var_decl_node_t*)node)->rhs->node_type == NODE_BLOCK && !state->marking) {
+    var_decl_node_t* var_decl = (var_decl_node_t*)node;
+    inline_candidate_t* candidate = malloc(sizeof(inline_candidate_t));
+    candidate->symbol = symbol_get_in_scope(context->symbol_table, var_decl->name);
+    candidate->block = (block_node_t*)var_decl->rhs;
+    candidate->cost = 0;
+    candidate->calls = 0;
+    // a @memo block's calls have to go through its table
+    candidate->inlinable = candidate->symbol != NULL && candidate->block->memo_size == 0;
+    if (candidate->symbol) {
+      ast_visit_children((expr_node_t*)candidate->block->body, (void(*)(expr_node_t*, void*))inline_cost, candidate);
+    }
+    printf("Block %s costs %u, %s\n", var_decl->name, candidate->cost, candidate->inlinable ? "inlinable" : "not inlinable");
+    list_push(state->candidates, candidate);
+  } else if (node->node_type == NODE_FUN_CALL) {
+    fun_call_node_t* call = (fun_call_node_t*)node;
+    inline_candidate_t* candidate = inline_candidate_get(state, symbol_get(context->symbol_table, call->name));
+    if (!state->marking && context->profile && context->profile->counts[call->profile_slot] > state->max_calls) {
+      state->max_calls = context->profile->counts[call->profile_slot];
+    }
+    if (candidate && !state->marking) {
+      candidate->calls++;
+    } else if (candidate && inline_wanted(state, candidate, call)) {
+      printf("Inlining call to %s\n", call->name);
+      call->inline_block = candidate->block;
+    }
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))inline_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+void inline_calls(context_t* context, expr_node_t* ast) {
+  if (context->opt_level == 0) return;
+  inline_state_t state;
+  state.context = context;
+  state.candidates = list_init();
+  state.marking = false;
+  state.max_calls = 0;
+  if (context->size_level > 0) {
+    state.small_threshold = 6;
+    state.single_call_threshold = 40;
+  } else {
+    state.small_threshold = 4 + 4 * context->opt_level;
+    state.single_call_threshold = 30 * context->opt_level;
+  }
+
+  inline_visit(ast, &state);
+  state.marking = true;
+  inline_visit(ast, &state);
+
+  list_item_t* iter = list_iter_init(state.candidates);
+  for (; iter; iter = list_iter(iter)) {
+    inline_candidate_t* candidate = iter->val;
+    candidate->block->always_inline = candidate->inlinable && candidate->cost <= state.small_threshold;
+  }
+  list_visit(state.candidates, free);
+  list_free(state.candidates);
+}
@@ -0,0 +1,11 @@
+#ifndef INLINE_H
+
+#define INLINE_H
+
+#include "ast.h"
+#include "context.h"
+
+// Marks the calls whose callee body codegen should copy in, see inline.c
+void inline_calls(context_t* context, expr_node_t* ast);
+
+#endif
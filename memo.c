@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "memo.h"
+
+/*
+ * A @memo block's function looks in a table of earlier results before running
+ * the block's body, which is generated as a function of its own. The table is
+ * a fixed-size global using open addressing: the arguments hash to a slot and
+ * the next few slots are probed. A miss runs the body and fills the empty slot
+ * it stopped at. When the table is too full to find one, the body just runs
+ * without its result being kept.
+ */
+
+#define MEMO_MAX_PROBES 8
+
+LLVMValueRef memo_hash(LLVMBuilderRef builder, LLVMValueRef* args, unsigned int count) {
+  LLVMTypeRef i64 = LLVMInt64Type();
+  LLVMValueRef hash = LLVMConstInt(i64, 0, false);
+  for (unsigned int i = 0; i < count; i++) {
+    LLVMValueRef arg = LLVMBuildZExtOrBitCast(builder, args[i], i64, "");
+    hash = LLVMBuildXor(builder, hash, arg, "");
+    // Fibonacci hashing, the top bits end up depending on every argument bit
+    hash = LLVMBuildMul(builder, hash, LLVMConstInt(i64, 0x9E3779B97F4A7C15ULL, false), "hash");
+  }
+  return hash;
+}
+
+LLVMValueRef memo_call(LLVMBuilderRef builder, LLVMValueRef body_fun, LLVMValueRef* args, unsigned int count) {
+  LLVMValueRef call = LLVMBuildCall(builder, body_fun, args, count, "result");
+  LLVMSetInstructionCallConv(call, LLVMGetFunctionCallConv(body_fun));
+  return call;
+}
+
+void memo_build(LLVMValueRef fun, LLVMValueRef body_fun, unsigned int size) {
+  unsigned int bits = 0;
+  for (; (1u << bits) < size; bits++);
+  size = 1u << bits;
+
+  unsigned int count = LLVMCountParams(fun);
+  LLVMValueRef args[count];
+  LLVMGetParams(fun, args);
+  // { used, arguments..., result }
+  LLVMTypeRef field_types[count + 2];
+  field_types[0] = LLVMInt1Type();
+  for (unsigned int i = 0; i < count; i++) {
+    field_types[i + 1] = LLVMTypeOf(args[i]);
+  }
+  field_types[count + 1] = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(fun)));
+  LLVMTypeRef table_type = LLVMArrayType(LLVMStructType(field_types, count + 2, false), size);
+
+  char* name = malloc(strlen(LLVMGetValueName(fun)) + 6);
+  sprintf(name, "%s.memo", LLVMGetValueName(fun));
+  LLVMValueRef table = LLVMAddGlobal(LLVMGetGlobalParent(fun), table_type, name);
+  LLVMSetInitializer(table, LLVMConstNull(table_type));
+  LLVMSetLinkage(table, LLVMInternalLinkage);
+  free(name);
+
+  LLVMTypeRef i64 = LLVMInt64Type();
+  LLVMBasicBlockRef entry = LLVMAppendBasicBlock(fun, "entry");
+  LLVMBasicBlockRef probe = LLVMAppendBasicBlock(fun, "probe");
+  LLVMBasicBlockRef check = LLVMAppendBasicBlock(fun, "check");
+  LLVMBasicBlockRef hit = LLVMAppendBasicBlock(fun, "hit");
+  LLVMBasicBlockRef next = LLVMAppendBasicBlock(fun, "next");
+  LLVMBasicBlockRef miss = LLVMAppendBasicBlock(fun, "miss");
+  LLVMBasicBlockRef full = LLVMAppendBasicBlock(fun, "full");
+  LLVMBuilderRef builder = LLVMCreateBuilder();
+
+  LLVMPositionBuilderAtEnd(builder, entry);
+  LLVMValueRef hash = memo_hash(builder, args, count);
+  LLVMValueRef start = bits == 0 ? LLVMConstInt(i64, 0, false) : LLVMBuildLShr(builder, hash, LLVMConstInt(i64, 64 - bits, false), "start");
+  LLVMBuildBr(builder, probe);
+
+  LLVMPositionBuilderAtEnd(builder, probe);
+  LLVMValueRef index = LLVMBuildPhi(builder, i64, "index");
+  LLVMValueRef probes = LLVMBuildPhi(builder, i64, "probes");
+  LLVMValueRef slot_indices[] = { LLVMConstInt(i64, 0, false), index };
+  LLVMValueRef slot = LLVMBuildGEP(builder, table, slot_indices, 2, "slot");
+  LLVMValueRef used = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, slot, 0, ""), "used");
+  LLVMBuildCondBr(builder, used, check, miss);
+
+  LLVMPositionBuilderAtEnd(builder, check);
+  LLVMValueRef same = LLVMConstInt(LLVMInt1Type(), 1, false);
+  for (unsigned int i = 0; i < count; i++) {
+    LLVMValueRef key = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, slot, i + 1, ""), "key");
+    same = LLVMBuildAnd(builder, same, LLVMBuildICmp(builder, LLVMIntEQ, key, args[i], ""), "same");
+  }
+  LLVMBuildCondBr(builder, same, hit, next);
+
+  LLVMPositionBuilderAtEnd(builder, hit);
+  LLVMBuildRet(builder, LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, slot, count + 1, ""), "cached"));
+
+  LLVMPositionBuilderAtEnd(builder, next);
+  LLVMValueRef next_index = LLVMBuildAnd(builder,
+      LLVMBuildAdd(builder, index, LLVMConstInt(i64, 1, false), ""),
+      LLVMConstInt(i64, size - 1, false), "nextindex");
+  LLVMValueRef next_probes = LLVMBuildAdd(builder, probes, LLVMConstInt(i64, 1, false), "nextprobes");
+  LLVMValueRef more = LLVMBuildICmp(builder, LLVMIntULT, next_probes, LLVMConstInt(i64, MEMO_MAX_PROBES, false), "more");
+  LLVMBuildCondBr(builder, more, probe, full);
+
+  LLVMValueRef index_in[] = { start, next_index };
+  LLVMValueRef probes_in[] = { LLVMConstInt(i64, 0, false), next_probes };
+  LLVMBasicBlockRef from[] = { entry, next };
+  LLVMAddIncoming(index, index_in, from, 2);
+  LLVMAddIncoming(probes, probes_in, from, 2);
+
+  // the body may have filled this slot for other arguments meanwhile, losing that entry is fine
+  LLVMPositionBuilderAtEnd(builder, miss);
+  LLVMValueRef result = memo_call(builder, body_fun, args, count);
+  for (unsigned int i = 0; i < count; i++) {
+    LLVMBuildStore(builder, args[i], LLVMBuildStructGEP(builder, slot, i + 1, ""));
+  }
+  LLVMBuildStore(builder, result, LLVMBuildStructGEP(builder, slot, count + 1, ""));
+  LLVMBuildStore(builder, LLVMConstInt(LLVMInt1Type(), 1, false), LLVMBuildStructGEP(builder, slot, 0, ""));
+  LLVMBuildRet(builder, result);
+
+  LLVMPositionBuilderAtEnd(builder, full);
+  result = memo_call(builder, body_fun, args, count);
+  LLVMSetTailCall(result, true);
+  LLVMBuildRet(builder, result);
+
+  LLVMDisposeBuilder(builder);
+}
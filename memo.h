@@ -0,0 +1,16 @@
+#ifndef MEMO_H
+
+#define MEMO_H
+
+#include <llvm-c/Core.h>
+
+// default number of entries in a @memo block's table
+#define MEMO_DEFAULT_SIZE 4096
+
+// tables are rounded up to a power of two entries and live in a global
+#define MEMO_MAX_SIZE (1 << 20)
+
+// fills in fun, which has body_fun's signature, to look results up before calling body_fun
+void memo_build(LLVMValueRef fun, LLVMValueRef body_fun, unsigned int size);
+
+#endif
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "parallel.h"
+#include "effect.h"
+
+/*
+ * Picks calls codegen runs on the runtime's thread pool while the current
+ * thread goes on with what follows them. Two places hold calls whose order
+ * doesn't matter:
+ *
+ * - the arguments of a call, f(g(x), h(y))
+ * - declarations in a row where none uses another, a = g(x); b = h(y);
+ *
+ * Nothing in such a group may write memory, going by effect.c. Its
+ * expensive calls but the last are spawned, the last runs on the current
+ * thread, then the others are joined. A call is expensive when it is
+ * estimated to run at least context->parallel_cost AST nodes: a loop counts
+ * its body once per trip, PARALLEL_LOOP_TRIPS times if its bounds aren't
+ * constant, and a call counts its callee's body, PARALLEL_RECURSION_COST
+ * for a call back into a block being counted. Parameters the call being
+ * estimated passes a constant Integer count as that constant in bounds.
+ *
+ * A spawned call that stops the program, e.g. on overflow with
+ * -overflow=trap, may do so while the rest of its group still runs.
+ */
+
+#define PARALLEL_LOOP_TRIPS 100
+#define PARALLEL_RECURSION_COST 1000000
+
+typedef struct {
+  block_node_t* block;
+  unsigned long cost;
+} parallel_block_cost_t;
+
+typedef struct {
+  symbol_t* symbol;
+  long val;
+} parallel_known_t;
+
+typedef struct {
+  context_t* context;
+  // parallel_block_cost_t of the blocks counted so far
+  list_t* block_costs;
+  // parallel_known_t of the parameters given constants by the call being estimated
+  list_t* known;
+  // of the node being counted
+  unsigned long cost;
+} parallel_state_t;
+
+static unsigned long parallel_add(unsigned long a, unsigned long b) {
+  return a > ULONG_MAX - b ? ULONG_MAX : a + b;
+}
+
+static unsigned long parallel_mult(unsigned long a, unsigned long b) {
+  return b != 0 && a > ULONG_MAX / b ? ULONG_MAX : a * b;
+}
+
+static unsigned long parallel_cost(parallel_state_t* state, expr_node_t* node);
+
+static unsigned long parallel_block_cost(parallel_state_t* state, block_node_t* block) {
+  list_item_t* iter = list_iter_init(state->block_costs);
+  for (; iter; iter = list_iter(iter)) {
+    parallel_block_cost_t* block_cost = iter->val;
+    if (block_cost->block == block) return block_cost->cost;
+  }
+  parallel_block_cost_t* block_cost = malloc(sizeof(parallel_block_cost_t));
+  block_cost->block = block;
+  // what recursive calls see while the body is counted
+  block_cost->cost = PARALLEL_RECURSION_COST;
+  list_push(state->block_costs, block_cost);
+  block_cost->cost = parallel_cost(state, (expr_node_t*)block->body);
+  return block_cost->cost;
+}
+
+static bool parallel_int_value(parallel_state_t* state, expr_node_t* node, long* val) {
+  if (node->node_type == NODE_CONST_INT) {
+    *val = ((const_int_node_t*)node)->val;
+    return true;
+  }
+  if (node->node_type != NODE_IDENT) return false;
+  symbol_t* symbol = symbol_get(state->context->symbol_table, ((ident_node_t*)node)->name);
+  list_item_t* iter = list_iter_init(state->known);
+  for (; iter; iter = list_iter(iter)) {
+    parallel_known_t* known = iter->val;
+    if (known->symbol == symbol) {
+      *val = known->val;
+      return true;
+    }
+  }
+  return false;
+}
+
+// counts the body again with the constant arguments of the outermost call known
+static unsigned long parallel_call_cost(parallel_state_t* state, fun_call_node_t* call, block_node_t* block) {
+  unsigned long cost = parallel_block_cost(state, block);
+  if (state->known->size > 0) return cost;
+  list_item_t* iter = list_iter_init(call->params);
+  list_item_t* param_iter = list_iter_init(block->params);
+  for (; iter && param_iter; iter = list_iter(iter), param_iter = list_iter(param_iter)) {
+    expr_node_t* arg = iter->val;
+    if (arg->node_type != NODE_CONST_INT) continue;
+    parallel_known_t* known = malloc(sizeof(parallel_known_t));
+    known->symbol = symbol_get_in_scope(block->body->scope, ((fun_param_node_t*)param_iter->val)->name);
+    known->val = ((const_int_node_t*)arg)->val;
+    list_push(state->known, known);
+  }
+  if (state->known->size > 0) {
+    cost = parallel_cost(state, (expr_node_t*)block->body);
+    parallel_known_t* known;
+    while ((known = list_shift(state->known))) {
+      free(known);
+    }
+  }
+  return cost;
+}
+
+static void parallel_cost_visit(expr_node_t* node, parallel_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  state->cost = parallel_add(state->cost, 1);
+  switch (node->node_type) {
+    case NODE_EXPR_LIST:
+      context->symbol_table = ((expr_list_node_t*)node)->scope;
+      break;
+    case NODE_BLOCK:
+      // its body runs when it's called
+      return;
+    case NODE_FOR: {
+      for_node_t* for_node = (for_node_t*)node;
+      unsigned long trips = PARALLEL_LOOP_TRIPS;
+      long start, end;
+      if (parallel_int_value(state, for_node->start, &start) && parallel_int_value(state, for_node->end, &end)) {
+        trips = start < end ? (unsigned long)end - (unsigned long)start : 0;
+      }
+      unsigned long bounds = parallel_add(parallel_cost(state, for_node->start), parallel_cost(state, for_node->end));
+      unsigned long body = parallel_mult(trips, parallel_cost(state, (expr_node_t*)for_node->body));
+      state->cost = parallel_add(state->cost, parallel_add(bounds, body));
+      return;
+    }
+    case NODE_WHILE: {
+      while_node_t* while_node = (while_node_t*)node;
+      unsigned long trip = parallel_add(parallel_cost(state, while_node->conditional), parallel_cost(state, (expr_node_t*)while_node->body));
+      state->cost = parallel_add(state->cost, parallel_mult(PARALLEL_LOOP_TRIPS, trip));
+      return;
+    }
+    case NODE_FUN_CALL: {
+      // a block passed for a Function parameter is taken to be cheap
+      symbol_t* symbol = symbol_get(context->symbol_table, ((fun_call_node_t*)node)->name);
+      if (symbol != NULL && !symbol->is_param && symbol->block != NULL) {
+        state->cost = parallel_add(state->cost, parallel_call_cost(state, (fun_call_node_t*)node, symbol->block));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))parallel_cost_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+static unsigned long parallel_cost(parallel_state_t* state, expr_node_t* node) {
+  unsigned long outer_cost = state->cost;
+  state->cost = 0;
+  parallel_cost_visit(node, state);
+  unsigned long cost = state->cost;
+  state->cost = outer_cost;
+  return cost;
+}
+
+// the thunk codegen_spawn builds calls the block's function directly
+static bool parallel_can_spawn(parallel_state_t* state, expr_node_t* node) {
+  context_t* context = state->context;
+  if (node->node_type != NODE_FUN_CALL) return false;
+  symbol_t* symbol = symbol_get(context->symbol_table, ((fun_call_node_t*)node)->name);
+  if (symbol == NULL || symbol->is_param || symbol->block == NULL || symbol->block->captures->size > 0) {
+    return false;
+  }
+  list_item_t* iter = list_iter_init(symbol->block->params);
+  for (; iter; iter = list_iter(iter)) {
+    if (type_name_is(((fun_param_node_t*)iter->val)->type, "Function")) return false;
+  }
+  return !(effect_of(context, node) & EFFECT_WRITE) && parallel_cost(state, node) >= context->parallel_cost;
+}
+
+static void parallel_spawn(context_t* context, fun_call_node_t* call) {
+  call->spawn = true;
+  context->spawns = true;
+  // the thread pool runs the block's function
+  call->inline_block = NULL;
+}
+
+static void parallel_call_args(parallel_state_t* state, fun_call_node_t* call) {
+  if (call->params->size < 2) return;
+  list_item_t* iter = list_iter_init(call->params);
+  for (; iter; iter = list_iter(iter)) {
+    if (effect_of(state->context, iter->val) & EFFECT_WRITE) return;
+  }
+  list_t* spawnable = list_init();
+  for (iter = list_iter_init(call->params); iter; iter = list_iter(iter)) {
+    if (parallel_can_spawn(state, iter->val)) {
+      list_push(spawnable, iter->val);
+    }
+  }
+  // the last one runs on the current thread
+  list_pop(spawnable);
+  fun_call_node_t* spawned;
+  while ((spawned = list_shift(spawnable))) {
+    parallel_spawn(state->context, spawned);
+  }
+  list_free(spawnable);
+}
+
+typedef struct {
+  parallel_state_t* state;
+  list_t* symbols;
+  bool used;
+} parallel_uses_t;
+
+static void parallel_uses_visit(expr_node_t* node, parallel_uses_t* uses) {
+  context_t* context = uses->state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  char* name = NULL;
+  if (node->node_type == NODE_EXPR_LIST) {
+    context->symbol_table = ((expr_list_node_t*)node)->scope;
+  } else if (node->node_type == NODE_IDENT) {
+    name = ((ident_node_t*)node)->name;
+  } else if (node->node_type == NODE_FUN_CALL) {
+    name = ((fun_call_node_t*)node)->name;
+  }
+  if (name != NULL) {
+    symbol_t* symbol = symbol_get(context->symbol_table, name);
+    list_item_t* iter = list_iter_init(uses->symbols);
+    for (; iter; iter = list_iter(iter)) {
+      if (iter->val == symbol) uses->used = true;
+    }
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))parallel_uses_visit, uses);
+  context->symbol_table = parent_scope;
+}
+
+// whether node refers to any of symbols
+static bool parallel_uses(parallel_state_t* state, expr_node_t* node, list_t* symbols) {
+  parallel_uses_t uses;
+  uses.state = state;
+  uses.symbols = symbols;
+  uses.used = false;
+  parallel_uses_visit(node, &uses);
+  return uses.used;
+}
+
+// spawns all but the last of the declarations' calls and empties the group
+static void parallel_spawn_group(context_t* context, list_t* group, list_t* symbols) {
+  if (group->size >= 2) {
+    list_pop(group);
+    var_decl_node_t* decl;
+    while ((decl = list_shift(group))) {
+      parallel_spawn(context, (fun_call_node_t*)decl->rhs);
+    }
+  }
+  while (list_shift(group));
+  while (list_shift(symbols));
+}
+
+static void parallel_expr_list(parallel_state_t* state, expr_list_node_t* node) {
+  context_t* context = state->context;
+  // declarations in a row that can run in parallel, and the symbols they declare
+  list_t* group = list_init();
+  list_t* symbols = list_init();
+  list_item_t* iter = list_iter_init(node->expressions);
+  for (; iter; iter = list_iter(iter)) {
+    expr_node_t* expr = iter->val;
+    if (expr->node_type != NODE_VAR_DECL || !parallel_can_spawn(state, ((var_decl_node_t*)expr)->rhs)) {
+      parallel_spawn_group(context, group, symbols);
+      continue;
+    }
+    var_decl_node_t* decl = (var_decl_node_t*)expr;
+    if (parallel_uses(state, decl->rhs, symbols)) {
+      // has to wait for the group, but can start the next one
+      parallel_spawn_group(context, group, symbols);
+    }
+    list_push(group, decl);
+    list_push(symbols, symbol_get(context->symbol_table, decl->name));
+  }
+  parallel_spawn_group(context, group, symbols);
+  list_free(group);
+  list_free(symbols);
+}
+
+static void parallel_visit(expr_node_t* node, parallel_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  if (node->node_type == NODE_EXPR_LIST) {
+    context->symbol_table = ((expr_list_node_t*)node)->scope;
+    parallel_expr_list(state, (expr_list_node_t*)node);
+  } else if (node->node_type == NODE_FUN_CALL) {
+    parallel_call_args(state, (fun_call_node_t*)node);
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))parallel_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+void parallel_calls(context_t* context, expr_node_t* ast) {
+  parallel_state_t state;
+  state.context = context;
+  state.block_costs = list_init();
+  state.known = list_init();
+  state.cost = 0;
+  symbol_table_t* scope = context->symbol_table;
+  parallel_visit(ast, &state);
+  context->symbol_table = scope;
+  list_visit(state.block_costs, free);
+  list_free(state.block_costs);
+  list_free(state.known);
+}
@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+
+#define PARALLEL_H
+
+#include "ast.h"
+#include "context.h"
+
+// Marks the calls codegen runs on the thread pool, see parallel.c
+void parallel_calls(context_t* context, expr_node_t* ast);
+
+#endif
@@ -6,6 +6,11 @@
 
 #include "ast.h"
 #include "parse.h"
+#include "type_union.h"
+#include "type_record.h"
+#include "type_vector.h"
+#include "type_fun.h"
+#include "memo.h"
 
 bin_op_t parse_token_to_bin_op(token_t tok) {
   switch(tok) {
@@ -20,6 +25,8 @@ bin_op_t parse_token_to_bin_op(token_t tok) {
     case TOKEN_LT: return BIN_OP_LT;
     case TOKEN_GTE: return BIN_OP_GTE;
     case TOKEN_LTE: return BIN_OP_LTE;
+    case TOKEN_AND: return BIN_OP_AND;
+    case TOKEN_OR: return BIN_OP_OR;
     default: return BIN_OP_INVALID;
   }
 }
@@ -27,6 +34,7 @@ bin_op_t parse_token_to_bin_op(token_t tok) {
 unary_op_t parse_token_to_unary_op(token_t tok) {
   switch(tok) {
     case TOKEN_DASH: return UNARY_OP_NEGATE;
+    case TOKEN_BANG: return UNARY_OP_NOT;
     default: return UNARY_OP_INVALID;
   }
 }
@@ -40,19 +48,23 @@ int parse_binary_precedence(bin_op_t op) {
   switch(op) {
     case BIN_OP_ASSIGN:
       return 2;
+    case BIN_OP_OR:
+      return 3;
+    case BIN_OP_AND:
+      return 4;
     case BIN_OP_EQ:
     case BIN_OP_GT:
     case BIN_OP_GTE:
     case BIN_OP_LT:
     case BIN_OP_LTE:
-      return 3;
+      return 5;
     case BIN_OP_PLUS:
     case BIN_OP_MINUS:
-      return 4;
+      return 6;
     case BIN_OP_MULT:
     case BIN_OP_DIV:
     case BIN_OP_MOD:
-      return 5;
+      return 7;
     default:
       fprintf(stderr, "Unable to determine binary precedence: unknown operator: %d\n", op);
       return -1;
@@ -62,7 +74,10 @@ int parse_binary_precedence(bin_op_t op) {
 int parse_unary_precedence(unary_op_t op) {
   switch(op) {
     case UNARY_OP_NEGATE:
-      return 4;
+      return 6;
+    case UNARY_OP_NOT:
+      // only applies to the operand, so !a == b is (!a) == b
+      return 8;
     default:
       fprintf(stderr, "Unable to determine unary precedence: unknown operator: %d\n", op);
       return -1;
@@ -95,9 +110,23 @@ token_t parse_get_tok(tokenizer_t* tok) {
 	while (isspace(c))
 	  c = fgetc(tok->input);
 
+  if (c == '.') { // field access, unless it starts a number
+    int next = fgetc(tok->input);
+    ungetc(next, tok->input);
+    if (next == '.') {
+      fgetc(tok->input);
+      c = fgetc(tok->input);
+      return TOKEN_DOTDOT;
+    }
+    if (!isdigit(next)) {
+      c = fgetc(tok->input);
+      return TOKEN_DOT;
+    }
+  }
+
   if (isalpha(c)) { // ident
     tok->ident[i = 0] = c;
-    while (isalpha(tok->ident[++i] = fgetc(tok->input)))
+    while (isalnum(tok->ident[++i] = fgetc(tok->input)))
       ;
     c = tok->ident[i];
     tok->ident[i] = '\0';
@@ -109,6 +138,12 @@ if (strcmp(tok->ident, s) == 0) return ret
     TRYMATCH("false", TOKEN_FALSE);
     TRYMATCH("if", TOKEN_IF);
     TRYMATCH("else", TOKEN_ELSE);
+    TRYMATCH("match", TOKEN_MATCH);
+    TRYMATCH("union", TOKEN_UNION);
+    TRYMATCH("record", TOKEN_RECORD);
+    TRYMATCH("while", TOKEN_WHILE);
+    TRYMATCH("for", TOKEN_FOR);
+    TRYMATCH("in", TOKEN_IN);
 
     return TOKEN_IDENT;
   } else if (isdigit(c) || c == '.') { // number
@@ -117,6 +152,12 @@ if (strcmp(tok->ident, s) == 0) return ret
     bool is_float = ident[i] == '.';
 		while (isdigit(ident[++i] = fgetc(tok->input))
 				|| ident[i] == '.') {
+      if (ident[i] == '.') {
+        // the end of a range like 0..n, not a fraction
+        int next = fgetc(tok->input);
+        ungetc(next, tok->input);
+        if (next == '.') break;
+      }
       is_float = is_float || ident[i] == '.';
     }
 		c = ident[i];
@@ -157,6 +198,9 @@ if (strcmp(tok->ident, s) == 0) return ret
     case ';': return TOKEN_SEMI;
     case ':': return TOKEN_COLON;
     case ',': return TOKEN_COMMA;
+    case '@': return TOKEN_AT;
+    case '[': return TOKEN_OPEN_BRACKET;
+    case ']': return TOKEN_CLOSE_BRACKET;
     case '=':
       ret = (c == '=' ? TOKEN_EQUAL : TOKEN_ASSIGN);
       c = fgetc(tok->input);
@@ -169,6 +213,15 @@ if (strcmp(tok->ident, s) == 0) return ret
       ret = c == '=' ? TOKEN_GTE : TOKEN_GT;
       c = fgetc(tok->input);
       return ret;
+    case '!':
+      return TOKEN_BANG;
+    case '&':
+    case '|':
+      if (c == i) {
+        c = fgetc(tok->input);
+        return i == '&' ? TOKEN_AND : TOKEN_OR;
+      }
+      break;
   }
   fprintf(stderr, "Unreconized character: %c\n", i);
   return TOKEN_INVALID;
@@ -195,7 +248,7 @@ expr_node_t* parse_expression_primary(context_t* context, tokenizer_t *tok, int
  * Exp(p) --> P {B Exp(q)} 
  * P --> U Exp(q) | "(" E ")" | v
  * B --> "+" | "-"  | "*" |"/" | "^" | "||" | "&&" | "="
- * U --> "-"
+ * U --> "-" | "!"
  */
 expr_node_t* parse_expression(context_t* context, tokenizer_t *tok) {
   return parse_expression_primary(context, tok, 0);
@@ -210,53 +263,95 @@ expr_node_t* parse_expression_unary(context_t* context, tokenizer_t *tok) {
   return (expr_node_t*)ast_unary_op_node_init(context, op, rhs);
 }
 
+/*
+ * T --> v | v "(" T {"," T} ")"
+ */
+type_t* parse_type_decl(context_t* context, tokenizer_t* tok) {
+  if (!parse_expect(tok, TOKEN_IDENT, "type name")) {
+    return NULL;
+  }
+  char* type_name = strdup(tok->ident);
+  parse_get_tok_next(tok);
+  type_t* type = NULL;
+  if (tok->current_tok == TOKEN_OPEN_PAREN) {
+    list_t* params = list_init();
+    do {
+      parse_get_tok_next(tok);
+      type_t* param = parse_type_decl(context, tok);
+      if (param == NULL) return NULL;
+      list_push(params, param);
+    } while (tok->current_tok == TOKEN_COMMA);
+    if (!parse_expect(tok, TOKEN_CLOSE_PAREN, ")")) {
+      return NULL;
+    }
+    parse_get_tok_next(tok);
+    // TODO if function type - we don't know the return type, params etc
+    type = type_get_instance(context->type_sys, type_name, params);
+    list_free(params);
+  } else {
+    type = type_get(context->type_sys, type_name);
+  }
+  if (type == NULL) {
+    fprintf(stderr, "Unable to identify type: %s\n", type_name);
+  }
+  free(type_name);
+  return type;
+}
+
+expr_node_t* parse_block(context_t* context, tokenizer_t *tok, symbol_t* self);
+
 expr_node_t* parse_expression_var_decl(context_t* context, tokenizer_t *tok, char* ident) {
-  char* type_name = NULL;
+  type_t* declared_type = NULL;
   if (tok->current_tok == TOKEN_COLON) {
     parse_get_tok_next(tok);
-    if (!parse_expect(tok, TOKEN_IDENT, "type name")) {
+    declared_type = parse_type_decl(context, tok);
+    if (declared_type == NULL) {
+      fprintf(stderr, "Type for '%s' not recognized\n", ident);
       return NULL;
     }
-    type_name = strdup(tok->ident);
-    parse_get_tok_next(tok);
   }
   if (!parse_expect(tok, TOKEN_ASSIGN, "assignment")) {
     return NULL;
   }
   parse_get_tok_next(tok);
-  expr_node_t* rhs = parse_expression(context, tok);
+  symbol_t* symbol = NULL;
+  expr_node_t* rhs = NULL;
+  if (tok->current_tok == TOKEN_OPEN_BRACE) {
+    // declared before the body is parsed so that the block can call itself
+    if (symbol_get_in_scope(context->symbol_table, ident) != NULL) {
+      fprintf(stderr, "Cannot redeclare variable: %s\n", ident);
+      return NULL;
+    }
+    symbol = symbol_set(context->symbol_table, strdup(ident), type_get(context->type_sys, "Function"), false);
+    rhs = parse_block(context, tok, symbol);
+  } else {
+    rhs = parse_expression(context, tok);
+  }
   if (rhs == NULL) return NULL;
 
-  symbol_t* symbol = symbol_get_in_scope(context->symbol_table, ident);
-  if (symbol != NULL) {
+  if (symbol == NULL && symbol_get_in_scope(context->symbol_table, ident) != NULL) {
     fprintf(stderr, "Cannot redeclare variable: %s\n", ident);
     return NULL;
   }
-  if (type_name != NULL) {
-    type_t* declared_type = type_get(context->type_sys, type_name);
-    if (declared_type == NULL) {
-      fprintf(stderr, "Type %s for '%s' not recognized\n", type_name, ident);
-      return NULL;
-    }
-    if (!type_equals(rhs->type, declared_type)) {
-      fprintf(stderr, "Declaring variable '%s' as %s but setting %s\n", ident, type_to_string(declared_type), type_to_string(rhs->type));
-      return NULL;
-    }
-    free(type_name);
+  if (declared_type != NULL && !type_equals(rhs->type, declared_type)) {
+    fprintf(stderr, "Declaring variable '%s' as %s but setting %s\n", ident, type_to_string(declared_type), type_to_string(rhs->type));
+    return NULL;
   }
 
   printf("declaring %s with type %s\n", ident, type_to_string(rhs->type));
-  symbol = symbol_set(context->symbol_table, strdup(ident), rhs->type, false);
+  if (symbol == NULL) {
+    symbol = symbol_set(context->symbol_table, strdup(ident), rhs->type, false);
+  }
   if (type_equals(rhs->type, type_get(context->type_sys, "Function"))) {
     block_node_t* block = (block_node_t*)rhs;
+    symbol->block = block;
     symbol->ret_type = block->body->type;
     symbol->num_params = block->params->size;
   }
   return (expr_node_t*)ast_var_decl_node_init(context, ident, rhs);
 }
 
-expr_node_t* parse_fun_call(context_t* context, tokenizer_t* tok, char* ident) {
-  printf("Parsing function call: %s\n", ident);
+list_t* parse_call_args(context_t* context, tokenizer_t* tok) {
   parse_get_tok_next(tok);
   list_t* params = list_init();
   bool first_pass = true;
@@ -276,26 +371,72 @@ expr_node_t* parse_fun_call(context_t* context, tokenizer_t* tok, char* ident) {
     }
   }
   parse_get_tok_next(tok);
+  return params;
+}
+
+expr_node_t* parse_fun_call(context_t* context, tokenizer_t* tok, char* ident) {
+  printf("Parsing function call: %s\n", ident);
+  list_t* params = parse_call_args(context, tok);
+  if (params == NULL) return NULL;
   printf("Finished parsing function call\n");
   return (expr_node_t*)ast_fun_call_node_init(context, ident, params);
 }
 
-expr_list_node_t* parse_expression_list(context_t* context, tokenizer_t *tok, symbol_table_t* scope);
+// vector builtins can be shadowed by a variable of the same name
+bool parse_is_builtin(context_t* context, char* ident) {
+  unsigned int width;
+  if (symbol_get(context->symbol_table, ident) != NULL) {
+    return false;
+  }
+  return type_vector_is_name(ident, &width) ||
+    strcmp(ident, "shuffle") == 0 ||
+    strcmp(ident, "has") == 0 ||
+    reduce_op_from_string(ident) != REDUCE_OP_INVALID;
+}
 
-type_t* parse_type_decl(context_t* context, tokenizer_t* tok) {
-  if (!parse_expect(tok, TOKEN_IDENT, "type name")) {
+/*
+ * "Vec"N "(" E {"," E} ")" | "shuffle" "(" E ["," E] {"," i} ")" | R "(" E ")" |
+ * "has" "(" E "," E ")"
+ * R --> "sum" | "product" | "min" | "max" | "any" | "all"
+ */
+expr_node_t* parse_builtin(context_t* context, tokenizer_t* tok, char* ident) {
+  list_t* args = parse_call_args(context, tok);
+  if (args == NULL) return NULL;
+  if (args->size == 0) {
+    fprintf(stderr, "%s needs at least one argument\n", ident);
     return NULL;
   }
-  char* type_name = tok->ident;
-  // TODO if function type - we don't know the return type, params etc
-  type_t* type = type_get(context->type_sys, type_name);
-  if (type == NULL) {
-    fprintf(stderr, "Unable to identify type: %s\n", type_name);
+  unsigned int width;
+  if (type_vector_is_name(ident, &width)) {
+    return (expr_node_t*)ast_vector_node_init(context, width, args);
+  }
+  expr_node_t* vector = list_shift(args);
+  if (strcmp(ident, "has") == 0) {
+    if (args->size != 1) {
+      fprintf(stderr, "has takes a map and a key\n");
+      return NULL;
+    }
+    expr_node_t* key = list_shift(args);
+    list_free(args);
+    return (expr_node_t*)ast_contains_node_init(context, vector, key);
+  }
+  if (strcmp(ident, "shuffle") == 0) {
+    expr_node_t* rhs = NULL;
+    if (args->size > 0 && ((expr_node_t*)args->head->val)->type->kind == TYPE_KIND_VECTOR) {
+      rhs = list_shift(args);
+    }
+    return (expr_node_t*)ast_shuffle_node_init(context, vector, rhs, args);
+  }
+  if (args->size != 0) {
+    fprintf(stderr, "%s takes a single vector\n", ident);
     return NULL;
   }
-  return type;
+  list_free(args);
+  return (expr_node_t*)ast_reduce_node_init(context, reduce_op_from_string(ident), vector);
 }
 
+expr_list_node_t* parse_expression_list(context_t* context, tokenizer_t *tok, symbol_table_t* scope);
+
 list_t* parse_param_list(context_t* context, tokenizer_t *tok) {
   parse_get_tok_next(tok);
   if (!parse_expect(tok, TOKEN_OPEN_PAREN, "(")) {
@@ -323,9 +464,16 @@ list_t* parse_param_list(context_t* context, tokenizer_t *tok) {
 
       fun_param_node_t* param = ast_fun_param_node_init(context, ident, type);
       printf("Adding param to func def %s\n", ident);
-      symbol_set(context->symbol_table, strdup(ident), type, true);
+      symbol_t* symbol = symbol_set(context->symbol_table, strdup(ident), type, true);
+      if (type_equals(type, type_get(context->type_sys, "Function"))) {
+        // calls through it are typed by this, its arguments are checked once a block is bound
+        symbol->ret_type = type_fun_ret(type);
+        if (symbol->ret_type == NULL) {
+          fprintf(stderr, "Block parameter %s needs a return type, e.g. %s:Function(Integer)\n", ident, ident);
+          return NULL;
+        }
+      }
       list_push(params, param);
-      parse_get_tok_next(tok);
       first_pass = false;
     } while (tok->current_tok == TOKEN_COMMA);
   }
@@ -336,9 +484,8 @@ list_t* parse_param_list(context_t* context, tokenizer_t *tok) {
   return params;
 }
 
-expr_list_node_t* parse_wrapped_expression_list(context_t* context, tokenizer_t *tok) {
+expr_list_node_t* parse_scoped_expression_list(context_t* context, tokenizer_t *tok, symbol_table_t* current_scope) {
   symbol_table_t* parent_scope = context->symbol_table;
-  symbol_table_t* current_scope = symbol_create_scope(context->symbol_table);
   context->symbol_table = current_scope;
 
   expr_list_node_t* body = NULL;
@@ -355,6 +502,10 @@ expr_list_node_t* parse_wrapped_expression_list(context_t* context, tokenizer_t
   return body;
 }
 
+expr_list_node_t* parse_wrapped_expression_list(context_t* context, tokenizer_t *tok) {
+  return parse_scoped_expression_list(context, tok, symbol_create_scope(context->symbol_table));
+}
+
 expr_node_t* parse_if(context_t* context, tokenizer_t *tok) {
   parse_get_tok_next(tok);
 
@@ -372,7 +523,514 @@ expr_node_t* parse_if(context_t* context, tokenizer_t *tok) {
   return (expr_node_t*)ast_if_node_init(context, conditional, true_expr, false_expr);
 }
 
-expr_node_t* parse_block(context_t* context, tokenizer_t *tok) {
+/*
+ * W --> "while" E "{" L "}"
+ */
+expr_node_t* parse_while(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+
+  expr_node_t* conditional = parse_expression(context, tok);
+  if (conditional == NULL) return NULL;
+
+  expr_list_node_t* body = parse_wrapped_expression_list(context, tok);
+  if (body == NULL) return NULL;
+  return (expr_node_t*)ast_while_node_init(context, conditional, body);
+}
+
+/*
+ * F --> "for" v "in" E ".." E "{" L "}"
+ */
+expr_node_t* parse_for(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_IDENT, "loop variable")) {
+    return NULL;
+  }
+  char* name = strdup(tok->ident);
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_IN, "in")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  expr_node_t* start = parse_expression(context, tok);
+  if (start == NULL) return NULL;
+  if (!parse_expect(tok, TOKEN_DOTDOT, "..")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  expr_node_t* end = parse_expression(context, tok);
+  if (end == NULL) return NULL;
+
+  // the counter is only visible in the body
+  symbol_table_t* scope = symbol_create_scope(context->symbol_table);
+  symbol_t* counter = symbol_set(scope, strdup(name), type_get(context->type_sys, "Integer"), false);
+  expr_list_node_t* body = parse_scoped_expression_list(context, tok, scope);
+  if (body == NULL) return NULL;
+  if (counter->is_assigned) {
+    fprintf(stderr, "Cannot assign to loop variable %s\n", name);
+    return NULL;
+  }
+  return (expr_node_t*)ast_for_node_init(context, name, start, end, body);
+}
+
+bool parse_integer_literal(tokenizer_t *tok, long* val) {
+  bool negative = tok->current_tok == TOKEN_DASH;
+  if (negative) {
+    parse_get_tok_next(tok);
+  }
+  if (!parse_expect(tok, TOKEN_INTEGER, "integer")) {
+    return false;
+  }
+  *val = negative ? -tok->int_val : tok->int_val;
+  parse_get_tok_next(tok);
+  return true;
+}
+
+/*
+ * C --> n [".." n] {"," n [".." n]}
+ *
+ * a .. b is a up to but not including b, like in a for loop
+ */
+list_t* parse_match_cases(context_t* context, tokenizer_t *tok) {
+  list_t* cases = list_init();
+  while (true) {
+    match_case_t* match_case = malloc(sizeof(match_case_t));
+    list_push(cases, match_case);
+    if (!parse_integer_literal(tok, &match_case->lo)) return NULL;
+    match_case->hi = match_case->lo;
+    if (tok->current_tok == TOKEN_DOTDOT) {
+      parse_get_tok_next(tok);
+      long end;
+      if (!parse_integer_literal(tok, &end)) return NULL;
+      if (end <= match_case->lo) {
+        fprintf(stderr, "Empty range %ld .. %ld\n", match_case->lo, end);
+        return NULL;
+      }
+      match_case->hi = end - 1;
+    }
+    if (tok->current_tok != TOKEN_COMMA) {
+      return cases;
+    }
+    parse_get_tok_next(tok);
+  }
+}
+
+/*
+ * M --> "match" E "{" {A "{" L "}"} ["else" "{" L "}"] "}"
+ * A --> v ["(" v ")"] | C
+ *
+ * A union is matched by variant and an Integer by the values in C.
+ */
+expr_node_t* parse_match(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+
+  expr_node_t* subject = parse_expression(context, tok);
+  if (subject == NULL) return NULL;
+  bool is_int = type_name_is(subject->type, "Integer");
+  if (subject->type->kind != TYPE_KIND_UNION && !is_int) {
+    fprintf(stderr, "Cannot match on %s\n", type_to_string(subject->type));
+    return NULL;
+  }
+  if (!parse_expect(tok, TOKEN_OPEN_BRACE, "{")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+
+  list_t* arms = list_init();
+  expr_list_node_t* default_expr = NULL;
+  while (tok->current_tok != TOKEN_CLOSE_BRACE) {
+    if (tok->current_tok == TOKEN_ELSE) {
+      parse_get_tok_next(tok);
+      default_expr = parse_wrapped_expression_list(context, tok);
+      if (default_expr == NULL) return NULL;
+      continue;
+    }
+    if (is_int) {
+      list_t* cases = parse_match_cases(context, tok);
+      if (cases == NULL) return NULL;
+      expr_list_node_t* body = parse_wrapped_expression_list(context, tok);
+      if (body == NULL) return NULL;
+      list_push(arms, ast_match_int_arm_init(context, cases, body));
+      continue;
+    }
+    if (!parse_expect(tok, TOKEN_IDENT, "variant name")) {
+      return NULL;
+    }
+    type_member_t* variant = type_member_get(subject->type, tok->ident);
+    if (variant == NULL) {
+      fprintf(stderr, "%s is not a variant of %s\n", tok->ident, type_to_string(subject->type));
+      return NULL;
+    }
+    parse_get_tok_next(tok);
+
+    symbol_table_t* arm_scope = symbol_create_scope(context->symbol_table);
+    char* binding = NULL;
+    if (tok->current_tok == TOKEN_OPEN_PAREN) {
+      parse_get_tok_next(tok);
+      if (!parse_expect(tok, TOKEN_IDENT, "identifier")) {
+        return NULL;
+      }
+      if (variant->type == NULL) {
+        fprintf(stderr, "Variant %s has no value to bind\n", variant->name);
+        return NULL;
+      }
+      binding = strdup(tok->ident);
+      symbol_set(arm_scope, strdup(binding), variant->type, true);
+      parse_get_tok_next(tok);
+      if (!parse_expect(tok, TOKEN_CLOSE_PAREN, ")")) {
+        return NULL;
+      }
+      parse_get_tok_next(tok);
+    }
+    expr_list_node_t* body = parse_scoped_expression_list(context, tok, arm_scope);
+    if (body == NULL) return NULL;
+    list_push(arms, ast_match_arm_init(context, variant, binding, body));
+  }
+  parse_get_tok_next(tok);
+  return (expr_node_t*)ast_match_node_init(context, subject, arms, default_expr);
+}
+
+/*
+ * D --> "union" v "{" v ["(" T ")"] {"," v ["(" T ")"]} "}"
+ */
+bool parse_union_decl(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_IDENT, "union name")) {
+    return false;
+  }
+  char* name = strdup(tok->ident);
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_OPEN_BRACE, "{")) {
+    return false;
+  }
+  list_t* variants = list_init();
+  do {
+    parse_get_tok_next(tok);
+    if (!parse_expect(tok, TOKEN_IDENT, "variant name")) {
+      return false;
+    }
+    char* variant_name = strdup(tok->ident);
+    type_t* owner = NULL;
+    bool declared = strcmp(variant_name, "Some") == 0 || strcmp(variant_name, "None") == 0 ||
+      type_union_find_variant(context->type_sys, variant_name, &owner) != NULL;
+    list_item_t* iter = list_iter_init(variants);
+    for (; iter; iter = list_iter(iter)) {
+      declared = declared || strcmp(((type_member_t*)iter->val)->name, variant_name) == 0;
+    }
+    if (declared) {
+      fprintf(stderr, "Cannot redeclare variant: %s\n", variant_name);
+      return false;
+    }
+    parse_get_tok_next(tok);
+    type_t* payload_type = NULL;
+    if (tok->current_tok == TOKEN_OPEN_PAREN) {
+      parse_get_tok_next(tok);
+      payload_type = parse_type_decl(context, tok);
+      if (payload_type == NULL) return false;
+      if (!parse_expect(tok, TOKEN_CLOSE_PAREN, ")")) {
+        return false;
+      }
+      parse_get_tok_next(tok);
+    }
+    list_push(variants, type_member_init(variant_name, payload_type, variants->size));
+  } while (tok->current_tok == TOKEN_COMMA);
+  if (!parse_expect(tok, TOKEN_CLOSE_BRACE, "}")) {
+    return false;
+  }
+  parse_get_tok_next(tok);
+
+  type_t* type = type_union_init(context->type_sys, name, variants);
+  free(name);
+  return type != NULL;
+}
+
+/*
+ * A --> {"@" v ["(" a {"," a} ")"]}
+ */
+list_t* parse_annotations(context_t* context, tokenizer_t *tok) {
+  list_t* annotations = list_init();
+  while (tok->current_tok == TOKEN_AT) {
+    parse_get_tok_next(tok);
+    if (!parse_expect(tok, TOKEN_IDENT, "annotation name")) {
+      return NULL;
+    }
+    char* name = strdup(tok->ident);
+    list_t* args = list_init();
+    parse_get_tok_next(tok);
+    if (tok->current_tok == TOKEN_OPEN_PAREN) {
+      do {
+        parse_get_tok_next(tok);
+        if (tok->current_tok != TOKEN_IDENT && tok->current_tok != TOKEN_INTEGER) {
+          parse_expect(tok, 0, "annotation argument");
+          return NULL;
+        }
+        list_push(args, parse_next_token_to_string(tok));
+        parse_get_tok_next(tok);
+      } while (tok->current_tok == TOKEN_COMMA);
+      if (!parse_expect(tok, TOKEN_CLOSE_PAREN, ")")) {
+        return NULL;
+      }
+      parse_get_tok_next(tok);
+    }
+    list_push(annotations, ast_annotation_init(context, name, args));
+  }
+  return annotations;
+}
+
+/*
+ * A v "=" B, where A may be @memo, @memo(size), @fastmath,
+ * @fastmath(flag, ...) with the flags of fast_math_from_string or
+ * @overflow(mode) with a mode of overflow_from_string
+ */
+bool parse_block_annotations(context_t* context, expr_node_t* decl, list_t* annotations) {
+  if (decl->node_type != NODE_VAR_DECL || ((var_decl_node_t*)decl)->rhs->node_type != NODE_BLOCK) {
+    fprintf(stderr, "Annotations only apply to records and block declarations\n");
+    return false;
+  }
+  block_node_t* block = (block_node_t*)((var_decl_node_t*)decl)->rhs;
+  list_item_t* iter = list_iter_init(annotations);
+  for (; iter; iter = list_iter(iter)) {
+    annotation_t* annotation = iter->val;
+    if (strcmp(annotation->name, "memo") == 0) {
+      long size = MEMO_DEFAULT_SIZE;
+      if (annotation->args->size > 0) {
+        size = strtol(annotation->args->head->val, NULL, 10);
+      }
+      if (size < 1 || size > MEMO_MAX_SIZE) {
+        fprintf(stderr, "@memo needs a table size from 1 to %d\n", MEMO_MAX_SIZE);
+        return false;
+      }
+      block->memo_size = size;
+    } else if (strcmp(annotation->name, "fastmath") == 0) {
+      if (annotation->args->size == 0) {
+        block->fast_math = FAST_MATH_ALL;
+      }
+      list_item_t* arg = list_iter_init(annotation->args);
+      for (; arg; arg = list_iter(arg)) {
+        fast_math_t flag = fast_math_from_string(arg->val);
+        if (flag == FAST_MATH_NONE) {
+          fprintf(stderr, "Unknown @fastmath flag: %s, expected reassoc, contract, nnan, ninf or fast\n", (char*)arg->val);
+          return false;
+        }
+        block->fast_math |= flag;
+      }
+    } else if (strcmp(annotation->name, "overflow") == 0) {
+      if (annotation->args->size == 1) {
+        block->overflow = overflow_from_string(annotation->args->head->val);
+      }
+      if (block->overflow == OVERFLOW_DEFAULT) {
+        fprintf(stderr, "@overflow takes one of wrap, nsw, trap or saturate\n");
+        return false;
+      }
+    } else {
+      fprintf(stderr, "Unknown block annotation: @%s\n", annotation->name);
+      return false;
+    }
+  }
+  ast_annotations_free(annotations);
+  return true;
+}
+
+/*
+ * R --> A "record" v "{" v ":" T {"," v ":" T} "}"
+ */
+bool parse_record_decl(context_t* context, tokenizer_t *tok, list_t* annotations) {
+  bool soa = false;
+  list_item_t* iter = list_iter_init(annotations);
+  for (; iter; iter = list_iter(iter)) {
+    annotation_t* annotation = iter->val;
+    if (strcmp(annotation->name, "soa") == 0) {
+      soa = true;
+    } else {
+      fprintf(stderr, "Unknown record annotation: @%s\n", annotation->name);
+      return false;
+    }
+  }
+  ast_annotations_free(annotations);
+
+  if (!parse_expect(tok, TOKEN_RECORD, "record")) {
+    return false;
+  }
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_IDENT, "record name")) {
+    return false;
+  }
+  char* name = strdup(tok->ident);
+  parse_get_tok_next(tok);
+  if (!parse_expect(tok, TOKEN_OPEN_BRACE, "{")) {
+    return false;
+  }
+  list_t* fields = list_init();
+  do {
+    parse_get_tok_next(tok);
+    if (!parse_expect(tok, TOKEN_IDENT, "field name")) {
+      return false;
+    }
+    char* field_name = strdup(tok->ident);
+    iter = list_iter_init(fields);
+    for (; iter; iter = list_iter(iter)) {
+      if (strcmp(((type_member_t*)iter->val)->name, field_name) == 0) {
+        fprintf(stderr, "Cannot redeclare field: %s\n", field_name);
+        return false;
+      }
+    }
+    parse_get_tok_next(tok);
+    if (!parse_expect(tok, TOKEN_COLON, ":")) {
+      return false;
+    }
+    parse_get_tok_next(tok);
+    type_t* field_type = parse_type_decl(context, tok);
+    if (field_type == NULL) return false;
+    list_push(fields, type_member_init(field_name, field_type, fields->size));
+  } while (tok->current_tok == TOKEN_COMMA);
+  if (!parse_expect(tok, TOKEN_CLOSE_BRACE, "}")) {
+    return false;
+  }
+  parse_get_tok_next(tok);
+
+  type_t* type = type_record_init(context->type_sys, name, fields, soa);
+  free(name);
+  return type != NULL;
+}
+
+bool parse_is_record(context_t* context, char* ident) {
+  type_t* type = type_get(context->type_sys, ident);
+  return type != NULL && type->kind == TYPE_KIND_RECORD;
+}
+
+expr_node_t* parse_record(context_t* context, tokenizer_t *tok, char* ident) {
+  type_t* record_type = type_get(context->type_sys, ident);
+  if (!parse_expect(tok, TOKEN_OPEN_PAREN, "(")) {
+    return NULL;
+  }
+  list_t* values = list_init();
+  do {
+    parse_get_tok_next(tok);
+    expr_node_t* value = parse_expression(context, tok);
+    if (value == NULL) return NULL;
+    list_push(values, value);
+  } while (tok->current_tok == TOKEN_COMMA);
+  if (!parse_expect(tok, TOKEN_CLOSE_PAREN, "')'")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  return (expr_node_t*)ast_record_node_init(context, record_type, values);
+}
+
+/*
+ * "[" E {"," E} "]"
+ */
+expr_node_t* parse_array(context_t* context, tokenizer_t *tok) {
+  list_t* elements = list_init();
+  do {
+    parse_get_tok_next(tok);
+    expr_node_t* element = parse_expression(context, tok);
+    if (element == NULL) return NULL;
+    list_push(elements, element);
+  } while (tok->current_tok == TOKEN_COMMA);
+  if (!parse_expect(tok, TOKEN_CLOSE_BRACKET, "]")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  expr_node_t* first = elements->head->val;
+  return (expr_node_t*)ast_array_node_init(context, first->type, elements, NULL);
+}
+
+/*
+ * "Map" "(" T "," T ")"
+ */
+expr_node_t* parse_map_alloc(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+  type_t* key_type = parse_type_decl(context, tok);
+  if (key_type == NULL) return NULL;
+  if (!parse_expect(tok, TOKEN_COMMA, ",")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  type_t* value_type = parse_type_decl(context, tok);
+  if (value_type == NULL) return NULL;
+  if (!parse_expect(tok, TOKEN_CLOSE_PAREN, "')'")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  return (expr_node_t*)ast_map_node_init(context, key_type, value_type);
+}
+
+/*
+ * "Array" "(" T "," E ")"
+ */
+expr_node_t* parse_array_alloc(context_t* context, tokenizer_t *tok) {
+  parse_get_tok_next(tok);
+  type_t* element_type = parse_type_decl(context, tok);
+  if (element_type == NULL) return NULL;
+  if (!parse_expect(tok, TOKEN_COMMA, ",")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  expr_node_t* length = parse_expression(context, tok);
+  if (length == NULL) return NULL;
+  if (!parse_expect(tok, TOKEN_CLOSE_PAREN, "')'")) {
+    return NULL;
+  }
+  parse_get_tok_next(tok);
+  return (expr_node_t*)ast_array_node_init(context, element_type, NULL, length);
+}
+
+bool parse_is_variant(context_t* context, char* ident) {
+  type_t* union_type;
+  return strcmp(ident, "Some") == 0 || strcmp(ident, "None") == 0 ||
+    type_union_find_variant(context->type_sys, ident, &union_type) != NULL;
+}
+
+expr_node_t* parse_variant(context_t* context, tokenizer_t *tok, char* ident) {
+  if (strcmp(ident, "None") == 0) {
+    // None(Type) - there is no value to take the payload type from
+    if (!parse_expect(tok, TOKEN_OPEN_PAREN, "(")) {
+      return NULL;
+    }
+    parse_get_tok_next(tok);
+    type_t* payload_type = parse_type_decl(context, tok);
+    if (payload_type == NULL) return NULL;
+    if (!parse_expect(tok, TOKEN_CLOSE_PAREN, ")")) {
+      return NULL;
+    }
+    parse_get_tok_next(tok);
+    type_t* option_type = type_option_get(context->type_sys, payload_type);
+    if (option_type == NULL) return NULL;
+    return (expr_node_t*)ast_variant_node_init(context, option_type, type_member_get(option_type, "None"), NULL);
+  }
+
+  type_t* union_type = NULL;
+  type_member_t* variant = NULL;
+  if (strcmp(ident, "Some") != 0) {
+    variant = type_union_find_variant(context->type_sys, ident, &union_type);
+  }
+  expr_node_t* payload = NULL;
+  if (tok->current_tok == TOKEN_OPEN_PAREN) {
+    parse_get_tok_next(tok);
+    payload = parse_expression(context, tok);
+    if (payload == NULL) return NULL;
+    if (!parse_expect(tok, TOKEN_CLOSE_PAREN, "')'")) {
+      return NULL;
+    }
+    parse_get_tok_next(tok);
+  }
+  if (variant == NULL) { // Some
+    if (payload == NULL) {
+      fprintf(stderr, "Some requires a value\n");
+      return NULL;
+    }
+    union_type = type_option_get(context->type_sys, payload->type);
+    if (union_type == NULL) return NULL;
+    variant = type_member_get(union_type, "Some");
+  }
+  return (expr_node_t*)ast_variant_node_init(context, union_type, variant, payload);
+}
+
+/*
+ * B --> "{" "(" [v ":" T {"," v ":" T}] ")" [":" T] E {E} "}"
+ * self is the symbol the block is being assigned to, or NULL
+ */
+expr_node_t* parse_block(context_t* context, tokenizer_t *tok, symbol_t* self) {
   symbol_table_t* parent_scope = context->symbol_table;
   symbol_table_t* current_scope = symbol_create_scope(context->symbol_table);
   context->symbol_table = current_scope;
@@ -380,8 +1038,22 @@ expr_node_t* parse_block(context_t* context, tokenizer_t *tok) {
   list_t* param_list = parse_param_list(context, tok);
   expr_node_t* ret = NULL;
   if (param_list != NULL) {
+    type_t* ret_type = NULL;
+    if (tok->current_tok == TOKEN_COLON) {
+      parse_get_tok_next(tok);
+      ret_type = parse_type_decl(context, tok);
+      if (ret_type == NULL) return NULL;
+    }
+    if (self != NULL) {
+      self->num_params = param_list->size;
+      self->ret_type = ret_type;
+    }
     expr_list_node_t* function_body = parse_expression_list(context, tok, current_scope);
     if (function_body == NULL) return NULL;
+    if (ret_type != NULL && !type_equals(ret_type, function_body->type)) {
+      fprintf(stderr, "Block declared to return %s but returns %s\n", type_to_string(ret_type), type_to_string(function_body->type));
+      return NULL;
+    }
     if (parse_expect(tok, TOKEN_CLOSE_BRACE, "}")) {
       parse_get_tok_next(tok);
       ret = (expr_node_t*)ast_block_node_init(context, param_list, function_body);
@@ -401,7 +1073,7 @@ expr_node_t* parse_expression_secondary(context_t* context, tokenizer_t *tok) {
     }
     parse_get_tok_next(tok);
     return inner;
-  } else if (tok->current_tok == TOKEN_DASH) { // unary negation
+  } else if (tok->current_tok == TOKEN_DASH || tok->current_tok == TOKEN_BANG) { // unary negation
     return parse_expression_unary(context, tok);
   } else if (tok->current_tok == TOKEN_INTEGER) {
     expr_node_t* int_node = (expr_node_t*)ast_const_int_node_init(context, tok->int_val);
@@ -421,28 +1093,77 @@ expr_node_t* parse_expression_secondary(context_t* context, tokenizer_t *tok) {
     return bool_node;
   } else if (tok->current_tok == TOKEN_IF) {
     return parse_if(context, tok);
+  } else if (tok->current_tok == TOKEN_WHILE) {
+    return parse_while(context, tok);
+  } else if (tok->current_tok == TOKEN_FOR) {
+    return parse_for(context, tok);
+  } else if (tok->current_tok == TOKEN_MATCH) {
+    return parse_match(context, tok);
   } else if (tok->current_tok == TOKEN_IDENT) {
     expr_node_t* ret = NULL;
     char* ident = strdup(tok->ident);
     parse_get_tok_next(tok);
-    if (tok->current_tok == TOKEN_OPEN_PAREN) {
-      ret = parse_fun_call(context, tok, ident);
-    } else if (tok->current_tok == TOKEN_ASSIGN || tok->current_tok == TOKEN_COLON) {
+    if (tok->current_tok == TOKEN_ASSIGN || tok->current_tok == TOKEN_COLON) {
       ret = parse_expression_var_decl(context, tok, ident);
+    } else if (strcmp(ident, "Array") == 0 && tok->current_tok == TOKEN_OPEN_PAREN) {
+      ret = parse_array_alloc(context, tok);
+    } else if (strcmp(ident, "Map") == 0 && tok->current_tok == TOKEN_OPEN_PAREN) {
+      ret = parse_map_alloc(context, tok);
+    } else if (tok->current_tok == TOKEN_OPEN_PAREN && parse_is_builtin(context, ident)) {
+      ret = parse_builtin(context, tok, ident);
+    } else if (parse_is_variant(context, ident)) {
+      ret = parse_variant(context, tok, ident);
+    } else if (parse_is_record(context, ident)) {
+      ret = parse_record(context, tok, ident);
+    } else if (tok->current_tok == TOKEN_OPEN_PAREN) {
+      ret = parse_fun_call(context, tok, ident);
     } else {
       ret = (expr_node_t*)ast_ident_node_init(context, ident);
     }
     free(ident);
     return ret;
   } else if (tok->current_tok == TOKEN_OPEN_BRACE) {
-    return parse_block(context, tok);
+    return parse_block(context, tok, NULL);
+  } else if (tok->current_tok == TOKEN_OPEN_BRACKET) {
+    return parse_array(context, tok);
   }
   parse_expect(tok, 0, "unary op, '(', var declaration, function declaration, identifier or an integer");
   return NULL;
 }
 
+/*
+ * S --> P {"." v | "[" E "]"}
+ */
+expr_node_t* parse_expression_postfix(context_t* context, tokenizer_t *tok, expr_node_t* expr) {
+  while (expr != NULL && (tok->current_tok == TOKEN_DOT || tok->current_tok == TOKEN_OPEN_BRACKET)) {
+    if (tok->current_tok == TOKEN_OPEN_BRACKET) {
+      parse_get_tok_next(tok);
+      expr_node_t* index = parse_expression(context, tok);
+      if (index == NULL) return NULL;
+      if (!parse_expect(tok, TOKEN_CLOSE_BRACKET, "]")) {
+        return NULL;
+      }
+      parse_get_tok_next(tok);
+      expr = (expr_node_t*)ast_index_node_init(context, expr, index);
+      continue;
+    }
+    parse_get_tok_next(tok);
+    if (!parse_expect(tok, TOKEN_IDENT, "field name")) {
+      return NULL;
+    }
+    if ((expr->type->kind == TYPE_KIND_ARRAY || expr->type->kind == TYPE_KIND_MAP) &&
+        strcmp(tok->ident, "length") == 0) {
+      expr = (expr_node_t*)ast_length_node_init(context, expr);
+    } else {
+      expr = (expr_node_t*)ast_field_node_init(context, expr, tok->ident);
+    }
+    parse_get_tok_next(tok);
+  }
+  return expr;
+}
+
 expr_node_t* parse_expression_primary(context_t* context, tokenizer_t *tok, int prec) {
-  expr_node_t* lhs = parse_expression_secondary(context, tok);
+  expr_node_t* lhs = parse_expression_postfix(context, tok, parse_expression_secondary(context, tok));
   if (lhs == NULL) return NULL;
   bin_op_t bin_op = parse_token_to_bin_op(tok->current_tok);
   int op_prec;
@@ -468,11 +1189,27 @@ expr_list_node_t* parse_expression_list(context_t* context, tokenizer_t *tok, sy
       printf("brace\n");
       return expr_list;
     }
-    printf("next expr\n");
-    expr_node_t* next_expr = parse_expression(context, tok);
-    if (next_expr == NULL) return NULL;
-    ast_expr_list_node_add(context, expr_list, next_expr);
-    expr_list->type = next_expr->type;
+    if (tok->current_tok == TOKEN_UNION) {
+      if (!parse_union_decl(context, tok)) return NULL;
+    } else if (tok->current_tok == TOKEN_RECORD || tok->current_tok == TOKEN_AT) {
+      list_t* annotations = parse_annotations(context, tok);
+      if (annotations == NULL) return NULL;
+      if (tok->current_tok == TOKEN_RECORD) {
+        if (!parse_record_decl(context, tok, annotations)) return NULL;
+      } else {
+        expr_node_t* decl = parse_expression(context, tok);
+        if (decl == NULL) return NULL;
+        if (!parse_block_annotations(context, decl, annotations)) return NULL;
+        ast_expr_list_node_add(context, expr_list, decl);
+        expr_list->type = decl->type;
+      }
+    } else {
+      printf("next expr\n");
+      expr_node_t* next_expr = parse_expression(context, tok);
+      if (next_expr == NULL) return NULL;
+      ast_expr_list_node_add(context, expr_list, next_expr);
+      expr_list->type = next_expr->type;
+    }
     if (tok->current_tok != TOKEN_SEMI && tok->current_tok != TOKEN_EOF) {
       parse_expect(tok, 0, "; or EOF");
       return NULL;
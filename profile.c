@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "profile.h"
+
+/*
+ * A profile is a text file: the number of slots on the first line, then one
+ * count per line in slot order.
+ */
+
+static const char* write_path = NULL;
+static unsigned long* write_counts = NULL;
+static unsigned int write_size = 0;
+
+profile_t* profile_read(const char* path, unsigned int size) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to read profile %s\n", path);
+    return NULL;
+  }
+  unsigned int file_size;
+  if (fscanf(file, "%u", &file_size) != 1 || file_size != size) {
+    fprintf(stderr, "Profile %s was taken from another program, ignoring it\n", path);
+    fclose(file);
+    return NULL;
+  }
+  profile_t* profile = malloc(sizeof(profile_t));
+  profile->counts = malloc(size * sizeof(unsigned long));
+  profile->size = size;
+  for (unsigned int i = 0; i < size; i++) {
+    if (fscanf(file, "%lu", &profile->counts[i]) != 1) {
+      fprintf(stderr, "Profile %s ends after %u of %u counts, ignoring it\n", path, i, size);
+      fclose(file);
+      profile_free(profile);
+      return NULL;
+    }
+  }
+  fclose(file);
+  printf("Read %u counts from profile %s\n", size, path);
+  return profile;
+}
+
+void profile_free(profile_t* profile) {
+  free(profile->counts);
+  free(profile);
+}
+
+void profile_flush() {
+  if (write_counts == NULL) return;
+  FILE* file = fopen(write_path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Unable to write profile %s\n", write_path);
+  } else {
+    fprintf(file, "%u\n", write_size);
+    for (unsigned int i = 0; i < write_size; i++) {
+      fprintf(file, "%lu\n", write_counts[i]);
+    }
+    fclose(file);
+    printf("Wrote %u counts to profile %s\n", write_size, write_path);
+  }
+  write_counts = NULL;
+}
+
+void profile_write_on_exit(const char* path, unsigned long* counts, unsigned int size) {
+  write_path = path;
+  write_counts = counts;
+  write_size = size;
+  // the runtime's errors exit() from inside the program
+  atexit(profile_flush);
+}
+
+bool profile_is_predictable(profile_t* profile, unsigned int slot) {
+  unsigned long taken = profile->counts[slot];
+  unsigned long not_taken = profile->counts[slot + 1];
+  unsigned long common = taken > not_taken ? taken : not_taken;
+  unsigned long total = taken + not_taken;
+  return total > 0 && common * 100 >= total * PROFILE_PREDICTABLE_PERCENT;
+}
+
+static int profile_compare_desc(const void* a, const void* b) {
+  unsigned long lhs = *(const unsigned long*)a;
+  unsigned long rhs = *(const unsigned long*)b;
+  return lhs < rhs ? 1 : lhs > rhs ? -1 : 0;
+}
+
+/*
+ * LLVM calls a count hot when it is among the largest counts making up 99%
+ * of the total, and cold when it is below those making up 99.9999%.
+ */
+void profile_summarize(profile_t* profile, profile_summary_t* summary) {
+  static const unsigned int cutoffs[PROFILE_CUTOFFS] = { 10000, 100000, 500000, 900000, 990000, 999999 };
+  unsigned long* sorted = malloc((profile->size + 1) * sizeof(unsigned long));
+  summary->total = 0;
+  summary->num_counts = 0;
+  for (unsigned int i = 0; i < profile->size; i++) {
+    if (profile->counts[i] == 0) continue;
+    sorted[summary->num_counts++] = profile->counts[i];
+    summary->total += profile->counts[i];
+  }
+  qsort(sorted, summary->num_counts, sizeof(unsigned long), profile_compare_desc);
+  summary->max = summary->num_counts > 0 ? sorted[0] : 0;
+
+  unsigned long sum = 0;
+  unsigned int taken = 0;
+  for (unsigned int i = 0; i < PROFILE_CUTOFFS; i++) {
+    // in floating point, total * cutoff could overflow
+    double needed = (double)summary->total * cutoffs[i] / 1000000;
+    while (taken < summary->num_counts && sum < needed) {
+      sum += sorted[taken++];
+    }
+    summary->cutoffs[i].cutoff = cutoffs[i];
+    summary->cutoffs[i].min_count = taken > 0 ? sorted[taken - 1] : 0;
+    summary->cutoffs[i].num_counts = taken;
+  }
+  free(sorted);
+}
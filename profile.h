@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+
+#define PROFILE_H
+
+#include <stdbool.h>
+
+/*
+ * Counters for profile guided optimization. The parser gives every if two
+ * slots (then and else) and every call and block one, numbered in source
+ * order. A program built with -profile-generate counts into them and writes
+ * them out when it exits, a later build with -profile-use reads them back.
+ * Since slots are numbered in source order, a profile only fits the program
+ * it was taken from.
+ */
+
+typedef struct {
+  unsigned long* counts;
+  unsigned int size;
+} profile_t;
+
+// NULL if the file can't be read or its number of slots isn't size
+profile_t* profile_read(const char* path, unsigned int size);
+
+void profile_free(profile_t* profile);
+
+// writes counts to path from profile_flush, or at exit if the program exits early
+void profile_write_on_exit(const char* path, unsigned long* counts, unsigned int size);
+
+// before the memory holding the counts goes away
+void profile_flush();
+
+// the common arm of a predictable if runs at least this many percent of the time
+#define PROFILE_PREDICTABLE_PERCENT 99
+
+// false for an if that never ran
+bool profile_is_predictable(profile_t* profile, unsigned int slot);
+
+// millionths of the total count, as LLVM's ProfileSummary expects them
+#define PROFILE_CUTOFFS 6
+
+typedef struct {
+  unsigned int cutoff;
+  // the hottest counts adding up to the cutoff are at least min_count
+  unsigned long min_count;
+  unsigned int num_counts;
+} profile_cutoff_t;
+
+typedef struct {
+  unsigned long total;
+  unsigned long max;
+  unsigned int num_counts;
+  profile_cutoff_t cutoffs[PROFILE_CUTOFFS];
+} profile_summary_t;
+
+void profile_summarize(profile_t* profile, profile_summary_t* summary);
+
+#endif
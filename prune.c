@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "prune.h"
+#include "effect.h"
+
+/*
+ * Drops the declarations in the program's top level that nothing it runs
+ * refers to, so neither codegen nor LLVM spend any time on them. Every other
+ * top-level expression is a root, the final one included, and so is a
+ * declaration whose value has to be computed because doing so writes memory
+ * or may stop the program. A declaration is live once a root or a live
+ * declaration refers to its name, and then refers to whatever its value
+ * does, the body of a block included.
+ */
+
+typedef struct {
+  context_t* context;
+  // symbol_t of every name referred to so far
+  list_t* referenced;
+} prune_state_t;
+
+static bool prune_contains(list_t* list, void* val) {
+  list_item_t* iter = list_iter_init(list);
+  for (; iter; iter = list_iter(iter)) {
+    if (iter->val == val) return true;
+  }
+  return false;
+}
+
+static void prune_visit(expr_node_t* node, prune_state_t* state) {
+  context_t* context = state->context;
+  symbol_table_t* parent_scope = context->symbol_table;
+  char* name = NULL;
+  if (node->node_type == NODE_EXPR_LIST) {
+    context->symbol_table = ((expr_list_node_t*)node)->scope;
+  } else if (node->node_type == NODE_IDENT) {
+    name = ((ident_node_t*)node)->name;
+  } else if (node->node_type == NODE_FUN_CALL) {
+    name = ((fun_call_node_t*)node)->name;
+  }
+  if (name != NULL) {
+    symbol_t* symbol = symbol_get(context->symbol_table, name);
+    if (symbol != NULL && !prune_contains(state->referenced, symbol)) {
+      list_push(state->referenced, symbol);
+    }
+  }
+  ast_visit_children(node, (void(*)(expr_node_t*, void*))prune_visit, state);
+  context->symbol_table = parent_scope;
+}
+
+// leaving it out mustn't change what the program does; an unused block is never run
+static bool prune_is_droppable(context_t* context, var_decl_node_t* decl) {
+  return decl->rhs->node_type == NODE_BLOCK ||
+    !(effect_of(context, decl->rhs) & (EFFECT_WRITE | EFFECT_DIVERGE));
+}
+
+void prune_declarations(context_t* context, expr_node_t* ast) {
+  if (ast->node_type != NODE_EXPR_LIST) return;
+  expr_list_node_t* program = (expr_list_node_t*)ast;
+  symbol_table_t* parent_scope = context->symbol_table;
+  context->symbol_table = program->scope;
+  prune_state_t state;
+  state.context = context;
+  state.referenced = list_init();
+
+  // declarations not known to be live yet
+  list_t* pending = list_init();
+  list_item_t* iter = list_iter_init(program->expressions);
+  for (; iter; iter = list_iter(iter)) {
+    expr_node_t* node = iter->val;
+    bool last = list_iter(iter) == NULL;
+    if (node->node_type == NODE_VAR_DECL && !last && prune_is_droppable(context, (var_decl_node_t*)node)) {
+      list_push(pending, node);
+    } else {
+      prune_visit(node, &state);
+    }
+  }
+
+  // a declaration found live can make earlier pending ones live in turn
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    list_t* still_pending = list_init();
+    var_decl_node_t* decl;
+    while ((decl = list_shift(pending))) {
+      if (prune_contains(state.referenced, symbol_get_in_scope(program->scope, decl->name))) {
+        prune_visit(decl->rhs, &state);
+        changed = true;
+      } else {
+        list_push(still_pending, decl);
+      }
+    }
+    list_free(pending);
+    pending = still_pending;
+  }
+
+  if (pending->size > 0) {
+    list_t* kept = list_init();
+    expr_node_t* node;
+    while ((node = list_shift(program->expressions))) {
+      if (prune_contains(pending, node)) {
+        printf("Dropping unused declaration %s\n", ((var_decl_node_t*)node)->name);
+        ast_expr_node_free(node);
+      } else {
+        list_push(kept, node);
+      }
+    }
+    list_free(program->expressions);
+    program->expressions = kept;
+  }
+  list_free(pending);
+  list_free(state.referenced);
+  context->symbol_table = parent_scope;
+}
@@ -0,0 +1,11 @@
+#ifndef PRUNE_H
+
+#define PRUNE_H
+
+#include "ast.h"
+#include "context.h"
+
+// Removes top-level declarations the program never uses, see prune.c
+void prune_declarations(context_t* context, expr_node_t* ast);
+
+#endif
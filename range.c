@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#include "range.h"
+
+/*
+ * Integer range analysis used to drop array bounds checks during codegen.
+ *
+ * Ranges of declared Integers (and lengths of declared Arrays) are kept on
+ * their symbols. Codegen narrows them while generating code that is only
+ * reached when a comparison holds, e.g. the then branch of
+ * `if i < a.length`, and restores them afterwards.
+ */
+
+typedef struct {
+  symbol_t* symbol;
+  long range_lo;
+  long range_hi;
+  symbol_t* bounded_by;
+} range_saved_t;
+
+range_t range_full() {
+  range_t range = { LONG_MIN, LONG_MAX };
+  return range;
+}
+
+range_t range_const(long val) {
+  range_t range = { val, val };
+  return range;
+}
+
+// integer arithmetic wraps, so any bound that could overflow means nothing is known
+range_t range_from_wide(__int128 lo, __int128 hi) {
+  if (lo < LONG_MIN || hi > LONG_MAX) {
+    return range_full();
+  }
+  range_t range = { (long)lo, (long)hi };
+  return range;
+}
+
+range_t range_mult(range_t lhs, range_t rhs) {
+  __int128 products[] = {
+    (__int128)lhs.lo * rhs.lo, (__int128)lhs.lo * rhs.hi,
+    (__int128)lhs.hi * rhs.lo, (__int128)lhs.hi * rhs.hi,
+  };
+  __int128 lo = products[0], hi = products[0];
+  for (unsigned int i = 1; i < 4; i++) {
+    if (products[i] < lo) lo = products[i];
+    if (products[i] > hi) hi = products[i];
+  }
+  return range_from_wide(lo, hi);
+}
+
+symbol_t* range_symbol(context_t* context, expr_node_t* node) {
+  if (node->node_type != NODE_IDENT) {
+    return NULL;
+  }
+  symbol_t* symbol = symbol_get(context->symbol_table, ((ident_node_t*)node)->name);
+  if (symbol == NULL || symbol->is_assigned) {
+    return NULL;
+  }
+  return symbol;
+}
+
+range_t range_of(context_t* context, expr_node_t* node) {
+  if (!type_name_is(node->type, "Integer")) {
+    return range_full();
+  }
+  switch (node->node_type) {
+    case NODE_CONST_INT:
+      return range_const(((const_int_node_t*)node)->val);
+    case NODE_IDENT: {
+      symbol_t* symbol = range_symbol(context, node);
+      if (symbol == NULL) return range_full();
+      range_t range = { symbol->range_lo, symbol->range_hi };
+      return range;
+    }
+    case NODE_LENGTH:
+      return range_of_length(context, ((length_node_t*)node)->array);
+    case NODE_UNARY_OP: {
+      unary_op_node_t* unary_op = (unary_op_node_t*)node;
+      range_t rhs = range_of(context, unary_op->rhs);
+      return range_from_wide(-(__int128)rhs.hi, -(__int128)rhs.lo);
+    }
+    case NODE_BINARY_OP: {
+      bin_op_node_t* bin_op = (bin_op_node_t*)node;
+      if (!type_name_is(bin_op->lhs->type, "Integer") || !type_name_is(bin_op->rhs->type, "Integer")) {
+        return range_full();
+      }
+      range_t lhs = range_of(context, bin_op->lhs);
+      range_t rhs = range_of(context, bin_op->rhs);
+      switch (bin_op->op) {
+        case BIN_OP_PLUS:
+          return range_from_wide((__int128)lhs.lo + rhs.lo, (__int128)lhs.hi + rhs.hi);
+        case BIN_OP_MINUS:
+          return range_from_wide((__int128)lhs.lo - rhs.hi, (__int128)lhs.hi - rhs.lo);
+        case BIN_OP_MULT:
+          return range_mult(lhs, rhs);
+        case BIN_OP_DIV:
+          // truncating division by a positive divisor is monotonic
+          if (rhs.lo > 0) {
+            range_t range = { lhs.lo >= 0 ? lhs.lo / rhs.hi : lhs.lo / rhs.lo,
+                              lhs.hi >= 0 ? lhs.hi / rhs.lo : lhs.hi / rhs.hi };
+            return range;
+          }
+          return range_full();
+        case BIN_OP_MOD:
+          // the remainder takes the sign of the dividend
+          if (rhs.lo > 0 && rhs.hi < LONG_MAX) {
+            range_t range = { lhs.lo >= 0 ? 0 : -(rhs.hi - 1), lhs.hi <= 0 ? 0 : rhs.hi - 1 };
+            if (lhs.lo >= 0 && lhs.hi < range.hi) range.hi = lhs.hi;
+            return range;
+          }
+          return range_full();
+        default:
+          return range_full();
+      }
+    }
+    default:
+      return range_full();
+  }
+}
+
+// no length is below 0, type_array_build stops the program first
+range_t range_of_length(context_t* context, expr_node_t* node) {
+  range_t range = { 0, LONG_MAX };
+  if (node->node_type == NODE_ARRAY) {
+    array_node_t* array = (array_node_t*)node;
+    if (array->elements != NULL) {
+      return range_const(array->elements->size);
+    }
+    range_t length = range_of(context, array->length);
+    if (length.lo > 0) range.lo = length.lo;
+    if (length.hi >= 0) range.hi = length.hi;
+  } else if (node->node_type == NODE_IDENT) {
+    symbol_t* symbol = range_symbol(context, node);
+    if (symbol != NULL) {
+      range.lo = symbol->range_lo > 0 ? symbol->range_lo : 0;
+      range.hi = symbol->range_hi;
+    }
+  }
+  return range;
+}
+
+void range_declare(context_t* context, symbol_t* symbol, expr_node_t* rhs) {
+  range_t range = range_full();
+  if (type_name_is(rhs->type, "Integer")) {
+    range = range_of(context, rhs);
+  } else if (rhs->type->kind == TYPE_KIND_ARRAY) {
+    range = range_of_length(context, rhs);
+  }
+  symbol->range_lo = range.lo;
+  symbol->range_hi = range.hi;
+  symbol->bounded_by = NULL;
+}
+
+bool range_index_is_safe(context_t* context, expr_node_t* array, expr_node_t* index) {
+  range_t index_range = range_of(context, index);
+  if (index_range.lo < 0) {
+    return false;
+  }
+  if (index_range.hi < range_of_length(context, array).lo) {
+    return true;
+  }
+  symbol_t* index_symbol = range_symbol(context, index);
+  symbol_t* array_symbol = range_symbol(context, array);
+  return index_symbol != NULL && array_symbol != NULL && index_symbol->bounded_by == array_symbol;
+}
+
+void range_save(list_t* saved, symbol_t* symbol) {
+  range_saved_t* state = malloc(sizeof(range_saved_t));
+  state->symbol = symbol;
+  state->range_lo = symbol->range_lo;
+  state->range_hi = symbol->range_hi;
+  state->bounded_by = symbol->bounded_by;
+  list_unshift(saved, state);
+}
+
+// narrow the range of `symbol` given `symbol op bound` holds
+void range_narrow(context_t* context, list_t* saved, symbol_t* symbol, bin_op_t op, expr_node_t* bound) {
+  range_t range = range_of(context, bound);
+  range_save(saved, symbol);
+  switch (op) {
+    case BIN_OP_LT:
+      if (range.hi != LONG_MIN && range.hi - 1 < symbol->range_hi) symbol->range_hi = range.hi - 1;
+      if (bound->node_type == NODE_LENGTH) {
+        symbol->bounded_by = range_symbol(context, ((length_node_t*)bound)->array);
+      }
+      break;
+    case BIN_OP_LTE:
+      if (range.hi < symbol->range_hi) symbol->range_hi = range.hi;
+      break;
+    case BIN_OP_GT:
+      if (range.lo != LONG_MAX && range.lo + 1 > symbol->range_lo) symbol->range_lo = range.lo + 1;
+      break;
+    case BIN_OP_GTE:
+      if (range.lo > symbol->range_lo) symbol->range_lo = range.lo;
+      break;
+    case BIN_OP_EQ:
+      if (range.lo > symbol->range_lo) symbol->range_lo = range.lo;
+      if (range.hi < symbol->range_hi) symbol->range_hi = range.hi;
+      break;
+    default:
+      break;
+  }
+}
+
+bin_op_t range_negate(bin_op_t op) {
+  switch (op) {
+    case BIN_OP_LT: return BIN_OP_GTE;
+    case BIN_OP_LTE: return BIN_OP_GT;
+    case BIN_OP_GT: return BIN_OP_LTE;
+    case BIN_OP_GTE: return BIN_OP_LT;
+    default: return BIN_OP_INVALID;
+  }
+}
+
+bin_op_t range_swap(bin_op_t op) {
+  switch (op) {
+    case BIN_OP_LT: return BIN_OP_GT;
+    case BIN_OP_LTE: return BIN_OP_GTE;
+    case BIN_OP_GT: return BIN_OP_LT;
+    case BIN_OP_GTE: return BIN_OP_LTE;
+    default: return op;
+  }
+}
+
+void range_assume_into(context_t* context, list_t* saved, expr_node_t* cond, bool truth) {
+  if (cond->node_type == NODE_UNARY_OP && ((unary_op_node_t*)cond)->op == UNARY_OP_NOT) {
+    range_assume_into(context, saved, ((unary_op_node_t*)cond)->rhs, !truth);
+    return;
+  }
+  if (cond->node_type != NODE_BINARY_OP) {
+    return;
+  }
+  bin_op_node_t* bin_op = (bin_op_node_t*)cond;
+  if ((bin_op->op == BIN_OP_AND && truth) || (bin_op->op == BIN_OP_OR && !truth)) {
+    // both sides hold (or both fail)
+    range_assume_into(context, saved, bin_op->lhs, truth);
+    range_assume_into(context, saved, bin_op->rhs, truth);
+    return;
+  }
+  if (!type_name_is(bin_op->lhs->type, "Integer") || !type_name_is(bin_op->rhs->type, "Integer")) {
+    return;
+  }
+  bin_op_t op = truth ? bin_op->op : range_negate(bin_op->op);
+  if (op == BIN_OP_INVALID) {
+    return;
+  }
+  symbol_t* lhs_symbol = range_symbol(context, bin_op->lhs);
+  if (lhs_symbol != NULL) {
+    range_narrow(context, saved, lhs_symbol, op, bin_op->rhs);
+  }
+  symbol_t* rhs_symbol = range_symbol(context, bin_op->rhs);
+  if (rhs_symbol != NULL) {
+    range_narrow(context, saved, rhs_symbol, range_swap(op), bin_op->lhs);
+  }
+}
+
+// narrow symbol ranges for code only reached when cond == truth
+list_t* range_assume(context_t* context, expr_node_t* cond, bool truth) {
+  list_t* saved = list_init();
+  range_assume_into(context, saved, cond, truth);
+  return saved;
+}
+
+// the body of `for counter in start .. end` only runs with start <= counter < end
+list_t* range_assume_counter(context_t* context, symbol_t* counter, expr_node_t* start, expr_node_t* end) {
+  list_t* saved = list_init();
+  range_save(saved, counter);
+  counter->range_lo = range_of(context, start).lo;
+  counter->range_hi = LONG_MAX;
+  counter->bounded_by = NULL;
+  range_narrow(context, saved, counter, BIN_OP_LT, end);
+  return saved;
+}
+
+void range_restore(list_t* saved) {
+  list_item_t* iter = list_iter_init(saved);
+  for (; iter; iter = list_iter(iter)) {
+    range_saved_t* state = iter->val;
+    state->symbol->range_lo = state->range_lo;
+    state->symbol->range_hi = state->range_hi;
+    state->symbol->bounded_by = state->bounded_by;
+  }
+  list_visit(saved, free);
+  list_free(saved);
+}
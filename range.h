@@ -0,0 +1,28 @@
+#ifndef RANGE_H
+
+#define RANGE_H
+
+#include "context.h"
+#include "ast.h"
+
+// inclusive bounds; LONG_MIN..LONG_MAX means nothing is known
+typedef struct {
+  long lo;
+  long hi;
+} range_t;
+
+range_t range_of(context_t* context, expr_node_t* node);
+
+range_t range_of_length(context_t* context, expr_node_t* node);
+
+void range_declare(context_t* context, symbol_t* symbol, expr_node_t* rhs);
+
+bool range_index_is_safe(context_t* context, expr_node_t* array, expr_node_t* index);
+
+list_t* range_assume(context_t* context, expr_node_t* cond, bool truth);
+
+list_t* range_assume_counter(context_t* context, symbol_t* counter, expr_node_t* start, expr_node_t* end);
+
+void range_restore(list_t* saved);
+
+#endif
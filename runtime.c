@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "runtime.h"
+
+void runtime_bounds_error(long index, long length) {
+  fprintf(stderr, "Index %ld out of bounds for array of length %ld\n", index, length);
+  exit(1);
+}
+
+void runtime_array_length_error(long length) {
+  fprintf(stderr, "Negative array length %ld\n", length);
+  exit(1);
+}
+
+void runtime_array_alloc_error(long length) {
+  fprintf(stderr, "Out of memory for an array of length %ld\n", length);
+  exit(1);
+}
+
+void runtime_overflow_error(long lhs, long rhs, int op) {
+  fprintf(stderr, "Integer overflow in %ld %c %ld\n", lhs, op, rhs);
+  exit(1);
+}
+
+// must match type_map_hash
+unsigned long runtime_map_hash(long key) {
+  unsigned long hash = (unsigned long)key * 0x9E3779B97F4A7C15UL;
+  return hash ^ (hash >> 29);
+}
+
+// bit i is set when group[i] == byte
+static unsigned int runtime_map_match(const unsigned char* group, unsigned char byte) {
+#ifdef __SSE2__
+  __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+  unsigned int bits = 0;
+  for (int i = 0; i < RUNTIME_MAP_GROUP; i++) {
+    bits |= (unsigned int)(group[i] == byte) << i;
+  }
+  return bits;
+#endif
+}
+
+static void runtime_map_init(runtime_map_t* map, long capacity) {
+  map->ctrl = malloc(capacity + RUNTIME_MAP_GROUP);
+  memset(map->ctrl, RUNTIME_MAP_EMPTY, capacity + RUNTIME_MAP_GROUP);
+  map->slots = calloc(capacity, map->slot_size);
+  map->capacity = capacity;
+  map->size = 0;
+  // keep at least 1/8 of the slots empty so probing always terminates
+  map->growth_left = capacity - capacity / 8;
+}
+
+runtime_map_t* runtime_map_new(long slot_size) {
+  runtime_map_t* map = malloc(sizeof(runtime_map_t));
+  map->slot_size = slot_size;
+  runtime_map_init(map, RUNTIME_MAP_GROUP);
+  return map;
+}
+
+void* runtime_map_find(runtime_map_t* map, long key) {
+  unsigned long hash = runtime_map_hash(key);
+  unsigned long mask = map->capacity - 1;
+  unsigned long pos = (hash >> 7) & mask;
+  unsigned long stride = 0;
+  while (true) {
+    const unsigned char* group = map->ctrl + pos;
+    unsigned int bits = runtime_map_match(group, hash & 0x7f);
+    for (; bits; bits &= bits - 1) {
+      unsigned long index = (pos + __builtin_ctz(bits)) & mask;
+      char* slot = map->slots + index * map->slot_size;
+      if (*(long*)slot == key) {
+        return slot;
+      }
+    }
+    if (runtime_map_match(group, RUNTIME_MAP_EMPTY)) {
+      return NULL;
+    }
+    // triangular probing visits every group when the group count is a power of two
+    stride += RUNTIME_MAP_GROUP;
+    pos = (pos + stride) & mask;
+  }
+}
+
+// claims an empty slot for a key known not to be in the map
+static char* runtime_map_claim(runtime_map_t* map, long key) {
+  unsigned long hash = runtime_map_hash(key);
+  unsigned long mask = map->capacity - 1;
+  unsigned long pos = (hash >> 7) & mask;
+  unsigned long stride = 0;
+  unsigned int bits;
+  while (!(bits = runtime_map_match(map->ctrl + pos, RUNTIME_MAP_EMPTY))) {
+    stride += RUNTIME_MAP_GROUP;
+    pos = (pos + stride) & mask;
+  }
+  unsigned long index = (pos + __builtin_ctz(bits)) & mask;
+  map->ctrl[index] = hash & 0x7f;
+  if (index < RUNTIME_MAP_GROUP) {
+    map->ctrl[map->capacity + index] = hash & 0x7f;
+  }
+  map->size++;
+  map->growth_left--;
+  char* slot = map->slots + index * map->slot_size;
+  *(long*)slot = key;
+  return slot;
+}
+
+static void runtime_map_grow(runtime_map_t* map) {
+  unsigned char* old_ctrl = map->ctrl;
+  char* old_slots = map->slots;
+  long old_capacity = map->capacity;
+  runtime_map_init(map, old_capacity * 2);
+  for (long i = 0; i < old_capacity; i++) {
+    if (old_ctrl[i] == RUNTIME_MAP_EMPTY) continue;
+    char* old_slot = old_slots + i * map->slot_size;
+    char* slot = runtime_map_claim(map, *(long*)old_slot);
+    memcpy(slot, old_slot, map->slot_size);
+  }
+  free(old_ctrl);
+  free(old_slots);
+}
+
+// the slot for key, added with a zeroed value if it wasn't there
+void* runtime_map_insert(runtime_map_t* map, long key) {
+  char* slot = runtime_map_find(map, key);
+  if (slot) {
+    return slot;
+  }
+  if (map->growth_left == 0) {
+    runtime_map_grow(map);
+  }
+  return runtime_map_claim(map, key);
+}
+
+#define RUNTIME_TASK_QUEUED 0
+#define RUNTIME_TASK_RUNNING 1
+#define RUNTIME_TASK_DONE 2
+
+struct runtime_task_t {
+  void (*fun)(void*);
+  void* data;
+  int state;
+  // in the queue while QUEUED
+  struct runtime_task_t* prev;
+  struct runtime_task_t* next;
+};
+
+long runtime_free_workers = 0;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static runtime_task_t* pool_head = NULL;
+static runtime_task_t* pool_tail = NULL;
+
+static void runtime_unqueue(runtime_task_t* task) {
+  if (task->prev) {
+    task->prev->next = task->next;
+  } else {
+    pool_head = task->next;
+  }
+  if (task->next) {
+    task->next->prev = task->prev;
+  } else {
+    pool_tail = task->prev;
+  }
+}
+
+// with pool_lock held, which is let go while the task runs
+static void runtime_run(runtime_task_t* task) {
+  runtime_unqueue(task);
+  task->state = RUNTIME_TASK_RUNNING;
+  pthread_mutex_unlock(&pool_lock);
+  task->fun(task->data);
+  pthread_mutex_lock(&pool_lock);
+  task->state = RUNTIME_TASK_DONE;
+  __atomic_fetch_add(&runtime_free_workers, 1, __ATOMIC_RELAXED);
+  pthread_cond_broadcast(&pool_done);
+}
+
+static void* runtime_worker(void* unused) {
+  pthread_mutex_lock(&pool_lock);
+  while (true) {
+    while (pool_head == NULL) {
+      pthread_cond_wait(&pool_work, &pool_lock);
+    }
+    runtime_run(pool_head);
+  }
+  return NULL;
+}
+
+void runtime_start_pool() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_mutex_lock(&pool_lock);
+  for (long i = 1; i < cpus; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, runtime_worker, NULL) != 0) break;
+    pthread_detach(thread);
+    __atomic_fetch_add(&runtime_free_workers, 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&pool_lock);
+}
+
+runtime_task_t* runtime_spawn(void (*fun)(void*), void* data) {
+  runtime_task_t* task = malloc(sizeof(runtime_task_t));
+  task->fun = fun;
+  task->data = data;
+  task->state = RUNTIME_TASK_QUEUED;
+  task->next = NULL;
+  pthread_mutex_lock(&pool_lock);
+  __atomic_fetch_sub(&runtime_free_workers, 1, __ATOMIC_RELAXED);
+  task->prev = pool_tail;
+  if (pool_tail) {
+    pool_tail->next = task;
+  } else {
+    pool_head = task;
+  }
+  pool_tail = task;
+  pthread_cond_signal(&pool_work);
+  pthread_mutex_unlock(&pool_lock);
+  return task;
+}
+
+// a task waiting on one still queued would wait on itself if every worker did the same
+void runtime_join(runtime_task_t* task) {
+  pthread_mutex_lock(&pool_lock);
+  if (task->state == RUNTIME_TASK_QUEUED) {
+    runtime_run(task);
+  }
+  while (task->state != RUNTIME_TASK_DONE) {
+    pthread_cond_wait(&pool_done, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  free(task);
+}
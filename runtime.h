@@ -0,0 +1,69 @@
+#ifndef RUNTIME_H
+
+#define RUNTIME_H
+
+// Functions called by generated code. The tool is linked with -rdynamic so
+// the JIT resolves these by name.
+
+void runtime_bounds_error(long index, long length);
+
+void runtime_array_length_error(long length);
+
+void runtime_array_alloc_error(long length);
+
+// op is the operator's character, '+', '-' or '*'
+void runtime_overflow_error(long lhs, long rhs, int op);
+
+#define RUNTIME_MAP_GROUP 16
+#define RUNTIME_MAP_EMPTY 0x80
+
+/*
+ * Open addressing table with one control byte per slot: EMPTY, or the low 7
+ * bits of the key's hash when the slot is full. Lookups compare a group of
+ * 16 control bytes at once and only touch slots whose byte matches.
+ *
+ * Generated code reads this struct directly (see type_map.c), so the field
+ * order is part of the ABI.
+ */
+typedef struct {
+  // capacity + RUNTIME_MAP_GROUP bytes; the tail mirrors the first group so
+  // a group read never wraps
+  unsigned char* ctrl;
+  // capacity slots of slot_size bytes, each a { key, value } pair
+  char* slots;
+  long capacity;
+  long size;
+  long growth_left;
+  long slot_size;
+} runtime_map_t;
+
+unsigned long runtime_map_hash(long key);
+
+runtime_map_t* runtime_map_new(long slot_size);
+
+void* runtime_map_find(runtime_map_t* map, long key);
+
+void* runtime_map_insert(runtime_map_t* map, long key);
+
+/*
+ * A pool of worker threads, one per CPU besides the one running the
+ * program. Generated code spawns calls that can run while it goes on (see
+ * parallel.c) and joins them before using their results. When no worker is
+ * free it makes the call itself instead, so a recursive block spawning at
+ * every level only pays for reading runtime_free_workers once the pool is
+ * busy.
+ */
+typedef struct runtime_task_t runtime_task_t;
+
+// workers minus the tasks queued or running, generated code reads it with a relaxed atomic load
+extern long runtime_free_workers;
+
+// before running a program that spawns
+void runtime_start_pool();
+
+runtime_task_t* runtime_spawn(void (*fun)(void*), void* data);
+
+// returns once the task is done, running it here if no worker has started it
+void runtime_join(runtime_task_t* task);
+
+#endif
@@ -0,0 +1,237 @@
+// General stuff
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "ssa.h"
+
+/*
+ * Builds SSA form while generating code, following Braun et al., "Simple and
+ * Efficient Construction of Static Single Assignment Form". Each variable
+ * remembers its value at the end of every block that assigns it. A read in a
+ * block without a definition looks through the predecessors, adding a phi
+ * where they join. Blocks that can still get predecessors are unsealed, and
+ * phis added there get their operands once the block is sealed.
+ */
+
+typedef struct {
+  LLVMBasicBlockRef block;
+  symbol_t* symbol;
+  LLVMValueRef phi;
+} ssa_incomplete_phi_t;
+
+static list_t* unsealed_blocks = NULL;
+static list_t* incomplete_phis = NULL;
+// every symbol with definitions, so a removed phi can be replaced in all of them
+static list_t* defined_symbols = NULL;
+
+static bool ssa_is_unsealed(LLVMBasicBlockRef block) {
+  if (unsealed_blocks == NULL) return false;
+  list_item_t* iter = list_iter_init(unsealed_blocks);
+  for (; iter; iter = list_iter(iter)) {
+    if (iter->val == block) return true;
+  }
+  return false;
+}
+
+// fills preds (if given) with one entry per edge into the block
+static unsigned int ssa_predecessors(LLVMBasicBlockRef block, LLVMBasicBlockRef* preds) {
+  unsigned int count = 0;
+  LLVMUseRef use = LLVMGetFirstUse(LLVMBasicBlockAsValue(block));
+  for (; use; use = LLVMGetNextUse(use)) {
+    LLVMValueRef user = LLVMGetUser(use);
+    // only terminators branch to a block, phis merely name it
+    if (LLVMIsAInstruction(user) && !LLVMIsAPHINode(user)) {
+      if (preds) {
+        preds[count] = LLVMGetInstructionParent(user);
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+static LLVMValueRef ssa_phi(symbol_t* symbol, LLVMBasicBlockRef block) {
+  LLVMBuilderRef builder = LLVMCreateBuilder();
+  LLVMValueRef first = LLVMGetFirstInstruction(block);
+  if (first) {
+    LLVMPositionBuilderBefore(builder, first);
+  } else {
+    LLVMPositionBuilderAtEnd(builder, block);
+  }
+  LLVMValueRef phi = LLVMBuildPhi(builder, type_get_ref(symbol->type), symbol->name);
+  LLVMDisposeBuilder(builder);
+  return phi;
+}
+
+static void ssa_replace_defs(LLVMValueRef old_value, LLVMValueRef new_value) {
+  list_item_t* symbol_iter = list_iter_init(defined_symbols);
+  for (; symbol_iter; symbol_iter = list_iter(symbol_iter)) {
+    symbol_t* symbol = symbol_iter->val;
+    list_item_t* iter = list_iter_init(symbol->defs);
+    for (; iter; iter = list_iter(iter)) {
+      ssa_def_t* def = iter->val;
+      if (def->value == old_value) {
+        def->value = new_value;
+      }
+    }
+  }
+}
+
+// a phi whose operands are all one value (or itself) is just that value
+static LLVMValueRef ssa_remove_trivial_phi(LLVMValueRef phi) {
+  LLVMValueRef same = NULL;
+  unsigned int count = LLVMCountIncoming(phi);
+  for (unsigned int i = 0; i < count; i++) {
+    LLVMValueRef incoming = LLVMGetIncomingValue(phi, i);
+    if (incoming == same || incoming == phi) continue;
+    if (same != NULL) return phi;
+    same = incoming;
+  }
+  if (same == NULL) {
+    // only reachable from itself
+    same = LLVMGetUndef(LLVMTypeOf(phi));
+  }
+  LLVMReplaceAllUsesWith(phi, same);
+  ssa_replace_defs(phi, same);
+  LLVMInstructionEraseFromParent(phi);
+  return same;
+}
+
+static LLVMValueRef ssa_add_phi_operands(symbol_t* symbol, LLVMValueRef phi) {
+  LLVMBasicBlockRef block = LLVMGetInstructionParent(phi);
+  unsigned int num_preds = ssa_predecessors(block, NULL);
+  LLVMBasicBlockRef preds[num_preds];
+  ssa_predecessors(block, preds);
+  for (unsigned int i = 0; i < num_preds; i++) {
+    LLVMValueRef value = ssa_read(symbol, preds[i]);
+    if (value == NULL) return NULL;
+    LLVMAddIncoming(phi, &value, &preds[i], 1);
+  }
+  return ssa_remove_trivial_phi(phi);
+}
+
+static LLVMValueRef ssa_read_recursive(symbol_t* symbol, LLVMBasicBlockRef block) {
+  LLVMValueRef value = NULL;
+  unsigned int num_preds = ssa_predecessors(block, NULL);
+  if (ssa_is_unsealed(block)) {
+    value = ssa_phi(symbol, block);
+    ssa_incomplete_phi_t* incomplete = malloc(sizeof(ssa_incomplete_phi_t));
+    incomplete->block = block;
+    incomplete->symbol = symbol;
+    incomplete->phi = value;
+    if (incomplete_phis == NULL) {
+      incomplete_phis = list_init();
+    }
+    list_push(incomplete_phis, incomplete);
+  } else if (num_preds == 0) {
+    if (block == LLVMGetEntryBasicBlock(LLVMGetBasicBlockParent(block))) {
+      return NULL;
+    }
+    // nothing jumps here, e.g. code after a tail call
+    value = LLVMGetUndef(type_get_ref(symbol->type));
+  } else if (num_preds == 1) {
+    LLVMBasicBlockRef pred;
+    ssa_predecessors(block, &pred);
+    value = ssa_read(symbol, pred);
+    if (value == NULL) return NULL;
+  } else {
+    // written before the operands are read so that loops find it
+    LLVMValueRef phi = ssa_phi(symbol, block);
+    ssa_write(symbol, block, phi);
+    value = ssa_add_phi_operands(symbol, phi);
+    if (value == NULL) return NULL;
+  }
+  ssa_write(symbol, block, value);
+  return value;
+}
+
+void ssa_write(symbol_t* symbol, LLVMBasicBlockRef block, LLVMValueRef value) {
+  list_item_t* iter = list_iter_init(symbol->defs);
+  for (; iter; iter = list_iter(iter)) {
+    ssa_def_t* def = iter->val;
+    if (def->block == block) {
+      def->value = value;
+      return;
+    }
+  }
+  if (symbol->defs->size == 0) {
+    if (defined_symbols == NULL) {
+      defined_symbols = list_init();
+    }
+    list_push(defined_symbols, symbol);
+  }
+  ssa_def_t* def = malloc(sizeof(ssa_def_t));
+  def->block = block;
+  def->value = value;
+  list_push(symbol->defs, def);
+}
+
+LLVMValueRef ssa_read(symbol_t* symbol, LLVMBasicBlockRef block) {
+  list_item_t* iter = list_iter_init(symbol->defs);
+  for (; iter; iter = list_iter(iter)) {
+    ssa_def_t* def = iter->val;
+    if (def->block == block) {
+      return def->value;
+    }
+  }
+  return ssa_read_recursive(symbol, block);
+}
+
+void ssa_unseal(LLVMBasicBlockRef block) {
+  if (unsealed_blocks == NULL) {
+    unsealed_blocks = list_init();
+  }
+  list_push(unsealed_blocks, block);
+}
+
+void ssa_seal(LLVMBasicBlockRef block) {
+  if (incomplete_phis != NULL) {
+    list_t* still_incomplete = list_init();
+    ssa_incomplete_phi_t* incomplete;
+    while ((incomplete = list_shift(incomplete_phis))) {
+      if (incomplete->block == block) {
+        ssa_add_phi_operands(incomplete->symbol, incomplete->phi);
+        free(incomplete);
+      } else {
+        list_push(still_incomplete, incomplete);
+      }
+    }
+    list_free(incomplete_phis);
+    incomplete_phis = still_incomplete;
+  }
+
+  list_t* still_unsealed = list_init();
+  LLVMBasicBlockRef unsealed;
+  while ((unsealed = list_shift(unsealed_blocks))) {
+    if (unsealed != block) {
+      list_push(still_unsealed, unsealed);
+    }
+  }
+  list_free(unsealed_blocks);
+  unsealed_blocks = still_unsealed;
+}
+
+void ssa_forget_function(LLVMValueRef fun) {
+  if (defined_symbols == NULL) return;
+  list_t* still_defined = list_init();
+  symbol_t* symbol;
+  while ((symbol = list_shift(defined_symbols))) {
+    list_t* kept = list_init();
+    ssa_def_t* def;
+    while ((def = list_shift(symbol->defs))) {
+      if (LLVMGetBasicBlockParent(def->block) == fun) {
+        free(def);
+      } else {
+        list_push(kept, def);
+      }
+    }
+    list_free(symbol->defs);
+    symbol->defs = kept;
+    if (kept->size > 0) {
+      list_push(still_defined, symbol);
+    }
+  }
+  list_free(defined_symbols);
+  defined_symbols = still_defined;
+}
@@ -0,0 +1,29 @@
+#ifndef SSA_H
+
+#define SSA_H
+
+#include <llvm-c/Core.h>
+
+#include "symbol.h"
+
+// a variable's value at the end of a basic block
+typedef struct {
+  LLVMBasicBlockRef block;
+  LLVMValueRef value;
+} ssa_def_t;
+
+void ssa_write(symbol_t* symbol, LLVMBasicBlockRef block, LLVMValueRef value);
+
+// NULL if the variable isn't defined in the block's function
+LLVMValueRef ssa_read(symbol_t* symbol, LLVMBasicBlockRef block);
+
+// a block that may still get predecessors, reads through it leave phis to complete
+void ssa_unseal(LLVMBasicBlockRef block);
+
+// all of the block's predecessors are known
+void ssa_seal(LLVMBasicBlockRef block);
+
+// drops the definitions in a finished function, before passes delete its blocks
+void ssa_forget_function(LLVMValueRef fun);
+
+#endif
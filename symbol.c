@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #include "symbol.h"
 
@@ -14,6 +15,8 @@ symbol_table_t* symbol_init() {
 }
 
 void symbol_free(symbol_t* symbol) {
+  list_visit(symbol->defs, free);
+  list_free(symbol->defs);
   free(symbol->name);
   free(symbol);
 }
@@ -58,7 +61,16 @@ symbol_t* symbol_set(symbol_table_t* symbol_table, char* name, type_t* type, boo
   new_symbol->is_param = is_param;
   new_symbol->ret_type = NULL;
   new_symbol->value = NULL;
+  new_symbol->defs = list_init();
+  new_symbol->has_env = false;
+  new_symbol->block = NULL;
+  new_symbol->bound_to = NULL;
+  new_symbol->env = NULL;
   new_symbol->num_params = 0;
+  new_symbol->is_assigned = false;
+  new_symbol->range_lo = LONG_MIN;
+  new_symbol->range_hi = LONG_MAX;
+  new_symbol->bounded_by = NULL;
   list_push(symbol_table->symbols, new_symbol);
   return new_symbol;
 }
@@ -9,6 +9,8 @@
 #include "list.h"
 #include "enums.h"
 
+struct block_node_t;
+
 typedef struct symbol_table_t {
   struct symbol_table_t* parent;
   list_t* symbols;
@@ -18,9 +20,27 @@ typedef struct symbol_t {
   char* name;
   type_t* type;
   type_t* ret_type;
+  // the function, for a block; variables keep their values in defs
   LLVMValueRef value;
+  // ssa_def_t for each basic block that leaves the variable with a new value, see ssa.c
+  list_t* defs;
+  // a block with captures takes its environment as a hidden last parameter
+  bool has_env;
+  // that environment as an i8*, valid in the function defining the block
+  LLVMValueRef env;
   size_t num_params;
+  // the declaration, for a block; calls binding its Function parameters specialize it
+  struct block_node_t* block;
+  // a Function parameter, while generating code for a call that passed this block
+  struct symbol_t* bound_to;
   bool is_param;
+  // reassigned somewhere after its declaration, so no facts hold for it
+  bool is_assigned;
+  // values an Integer (or lengths an Array) is known to have at this point in codegen
+  long range_lo;
+  long range_hi;
+  // an Integer known to be less than the length of this Array
+  struct symbol_t* bounded_by;
 } symbol_t;
 
 symbol_table_t* symbol_init();
@@ -3,46 +3,99 @@
 #include <llvm-c/Analysis.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/Transforms/PassManagerBuilder.h>
 
 // General stuff
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "codegen.h"
 #include "graphgen.h"
 #include "parse.h"
 #include "ast.h"
 #include "context.h"
+#include "fold.h"
+#include "inline.h"
+#include "closure.h"
+#include "prune.h"
+#include "parallel.h"
+#include "runtime.h"
+#include "profile.h"
+
+unsigned int count_instructions(LLVMModuleRef mod) {
+  unsigned int count = 0;
+  LLVMValueRef fun = LLVMGetFirstFunction(mod);
+  for (; fun; fun = LLVMGetNextFunction(fun)) {
+    LLVMBasicBlockRef block = LLVMGetFirstBasicBlock(fun);
+    for (; block; block = LLVMGetNextBasicBlock(block)) {
+      LLVMValueRef inst = LLVMGetFirstInstruction(block);
+      for (; inst; inst = LLVMGetNextInstruction(inst)) {
+        count++;
+      }
+    }
+  }
+  return count;
+}
 
-int execute(LLVMModuleRef mod) {
+int execute(context_t* context, LLVMModuleRef mod) {
   LLVMExecutionEngineRef engine;
-  LLVMModuleProviderRef provider = LLVMCreateModuleProviderForExistingModule(mod);
   char *error = NULL;
-  if(LLVMCreateJITCompiler(&engine, provider, 2, &error) != 0) {
+  unsigned int jit_opt_level = context->opt_level > 2 ? 3 : context->opt_level;
+  // MCJIT compiles the whole module once main is asked for, after the passes ran
+  if(LLVMCreateJITCompilerForModule(&engine, mod, jit_opt_level, &error) != 0) {
     fprintf(stderr, "%s\n", error);
     LLVMDisposeMessage(error);
     abort();
   }
 
   LLVMPassManagerRef pass = LLVMCreatePassManager();
-  LLVMAddTargetData(LLVMGetExecutionEngineTargetData(engine), pass);
+  // the vectorizers ask the target how wide its registers are
+  LLVMAddAnalysisPasses(LLVMGetExecutionEngineTargetMachine(engine), pass);
 
-  LLVMAddConstantPropagationPass(pass);
-  LLVMAddInstructionCombiningPass(pass);
-  LLVMAddPromoteMemoryToRegisterPass(pass);
-  LLVMAddGVNPass(pass);
-  LLVMAddCFGSimplificationPass(pass);
+  codegen_add_whole_program_passes(context, pass);
+  LLVMPassManagerBuilderRef pass_builder = codegen_pass_builder(context);
+  LLVMPassManagerBuilderPopulateModulePassManager(pass_builder, pass);
+  LLVMPassManagerBuilderDispose(pass_builder);
+  codegen_add_loop_passes(context, pass);
 
+  unsigned int instructions_before = count_instructions(mod);
+  clock_t pass_start = clock();
   LLVMRunPassManager(pass, mod);
+  double pass_ms = (double)(clock() - pass_start) * 1000 / CLOCKS_PER_SEC;
+  printf("Optimized %u instructions down to %u in %.3fms\n", instructions_before, count_instructions(mod), pass_ms);
   LLVMDumpModule(mod);
 
   LLVMValueRef main_func = LLVMGetNamedFunction(mod, "main");
 
+  clock_t jit_start = clock();
+  LLVMGetPointerToGlobal(engine, main_func);
+  double jit_ms = (double)(clock() - jit_start) * 1000 / CLOCKS_PER_SEC;
+
+  if (context->profile_generate) {
+    // by name, for the copy the compiled code counts in
+    unsigned long* counters = (unsigned long*)LLVMGetGlobalValueAddress(engine, "profile_counters");
+    profile_write_on_exit(context->profile_generate, counters, context->profile_slots);
+  }
+
+  if (LLVMGetNamedFunction(mod, "runtime_spawn") != NULL) {
+    runtime_start_pool();
+  }
+
   LLVMGenericValueRef exec_args[] = {};
+  // wall time, the program may run on several threads
+  struct timespec run_start, run_end;
+  clock_gettime(CLOCK_MONOTONIC, &run_start);
   LLVMGenericValueRef exec_res = LLVMRunFunction(engine, main_func, 0, exec_args);
+  clock_gettime(CLOCK_MONOTONIC, &run_end);
+  double run_ms = (run_end.tv_sec - run_start.tv_sec) * 1000.0 + (run_end.tv_nsec - run_start.tv_nsec) / 1000000.0;
+  printf("Compiled to machine code in %.3fms, ran in %.3fms\n", jit_ms, run_ms);
+  profile_flush();
 
   LLVMTypeRef ret_type = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(main_func)));
   LLVMTypeKind ret_type_kind = LLVMGetTypeKind(ret_type);
@@ -66,17 +119,105 @@ int execute(LLVMModuleRef mod) {
   return res;
 }
 
+// -fast-math=reassoc,nnan,... into fast_math_t flags, FAST_MATH_NONE if any is unknown
+unsigned int parse_fast_math_option(const char* flags) {
+  char* copy = strdup(flags);
+  unsigned int fast_math = FAST_MATH_NONE;
+  for (char* flag = strtok(copy, ","); flag; flag = strtok(NULL, ",")) {
+    fast_math_t parsed = fast_math_from_string(flag);
+    if (parsed == FAST_MATH_NONE) {
+      fprintf(stderr, "Unknown fast math flag: %s, expected reassoc, contract, nnan, ninf or fast\n", flag);
+      free(copy);
+      return FAST_MATH_NONE;
+    }
+    fast_math |= parsed;
+  }
+  free(copy);
+  return fast_math;
+}
+
 int main(int argc, char const *argv[])
 {
-  LLVMLinkInJIT();
+  LLVMLinkInMCJIT();
   LLVMInitializeNativeTarget();
+  LLVMInitializeNativeAsmPrinter();
 
   context_t* context = context_init();
+  // read once the parser has numbered the profile slots
+  const char* profile_use = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-Os") == 0) {
+      context->opt_level = 2;
+      context->size_level = 1;
+    } else if (strlen(argv[i]) == 3 && strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '0' && argv[i][2] <= '3') {
+      context->opt_level = argv[i][2] - '0';
+      context->size_level = 0;
+    } else if (strncmp(argv[i], "-select-cost=", 13) == 0) {
+      context->select_cost = atoi(argv[i] + 13);
+    } else if (strcmp(argv[i], "-fast-math") == 0) {
+      context->fast_math = FAST_MATH_ALL;
+    } else if (strncmp(argv[i], "-fast-math=", 11) == 0) {
+      context->fast_math = parse_fast_math_option(argv[i] + 11);
+      if (context->fast_math == FAST_MATH_NONE) return 1;
+    } else if (strncmp(argv[i], "-overflow=", 10) == 0) {
+      context->overflow = overflow_from_string((char*)argv[i] + 10);
+      if (context->overflow == OVERFLOW_DEFAULT) {
+        fprintf(stderr, "Unknown overflow mode: %s, expected wrap, nsw, trap or saturate\n", argv[i] + 10);
+        return 1;
+      }
+    } else if (strncmp(argv[i], "-parallel-cost=", 15) == 0) {
+      context->parallel_cost = strtoul(argv[i] + 15, NULL, 10);
+    } else if (strcmp(argv[i], "-no-whole-program") == 0) {
+      context->whole_program = false;
+    } else if (strncmp(argv[i], "-mcpu=", 6) == 0) {
+      // one LLVM knows (llc -mcpu=help lists them), it only warns about others
+      if (strcmp(argv[i] + 6, "host") != 0) {
+        context->cpu = argv[i] + 6;
+      }
+    } else if (strncmp(argv[i], "-profile-generate=", 18) == 0) {
+      context->profile_generate = argv[i] + 18;
+    } else if (strncmp(argv[i], "-profile-use=", 13) == 0) {
+      profile_use = argv[i] + 13;
+    } else {
+      fprintf(stderr, "Unknown option: %s\nusage: tool [-O0|-O1|-O2|-O3|-Os] [-select-cost=N] [-fast-math[=flag,...]] [-overflow=wrap|nsw|trap|saturate] [-profile-generate=FILE|-profile-use=FILE] [-mcpu=host|NAME] [-no-whole-program] [-parallel-cost=N] < program\n", argv[i]);
+      return 1;
+    }
+  }
+
+  // the host's features, since a CPU may have some turned off, e.g. by a hypervisor
+  char* host_cpu = NULL;
+  char* host_features = NULL;
+  if (context->cpu == NULL) {
+    context->cpu = host_cpu = LLVMGetHostCPUName();
+    context->cpu_features = host_features = LLVMGetHostCPUFeatures();
+  }
+  printf("Generating code for %s\n", context->cpu);
+  if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+    // no worker to run anything, and checking for one still costs
+    printf("Only one CPU, running calls in sequence\n");
+    context->parallel_cost = 0;
+  }
 
   expr_node_t* ast = parse_file(context, stdin);
   if (!ast) {
     return 0;
   }
+  if (profile_use) {
+    // a profile that doesn't fit just goes unused
+    context->profile = profile_read(profile_use, context->profile_slots);
+  }
+  ast = fold(context, ast);
+  if (!closure_analyze(context, ast)) {
+    return 0;
+  }
+  if (context->whole_program) {
+    prune_declarations(context, ast);
+  }
+  inline_calls(context, ast);
+  // instrumented code counts in globals the threads would race on
+  if (context->opt_level > 0 && context->parallel_cost > 0 && context->profile_generate == NULL) {
+    parallel_calls(context, ast);
+  }
 
   FILE *dot_file;
   dot_file = fopen("graph.dot", "w");
@@ -97,9 +238,13 @@ int main(int argc, char const *argv[])
   ast_expr_node_free(ast);
 
   // run it!
-  int res = execute(mod);
+  int res = execute(context, mod);
 
   context_free(context);
+  if (host_cpu) {
+    LLVMDisposeMessage(host_cpu);
+    LLVMDisposeMessage(host_features);
+  }
 
   return res;
 }
@@ -6,9 +6,30 @@
 #include "type_bool.h"
 #include "type_float.h"
 #include "type_fun.h"
+#include "type_union.h"
+#include "type_record.h"
+#include "type_array.h"
+#include "type_vector.h"
+#include "type_map.h"
 #include "list.h"
 
+void type_member_free(type_member_t* member) {
+  free(member->name);
+  free(member);
+}
+
 void type_free(type_t* type) {
+  if (type->params) {
+    list_free(type->params);
+  }
+  if (type->members) {
+    list_visit(type->members, (void(*)(void*))type_member_free);
+    list_free(type->members);
+  }
+  if (type->kind == TYPE_KIND_RECORD) {
+    free(((record_layout_t*)type->layout)->slots);
+  }
+  free(type->layout);
   free(type->name);
   free(type);
 }
@@ -40,23 +61,73 @@ type_t* type_get(type_system_t* type_sys, char* name) {
   return NULL;
 }
 
+type_t* type_get_instance(type_system_t* type_sys, char* name, list_t* params) {
+  if (strcmp(name, "Option") == 0 && params->size == 1) {
+    return type_option_get(type_sys, params->head->val);
+  }
+  if (strcmp(name, "Function") == 0 && params->size == 1) {
+    return type_fun_get(type_sys, params->head->val);
+  }
+  if (strcmp(name, "Array") == 0 && params->size == 1) {
+    return type_array_get(type_sys, params->head->val);
+  }
+  if (strcmp(name, "Map") == 0 && params->size == 2) {
+    return type_map_get(type_sys, params->head->val, params->head->next->val);
+  }
+  unsigned int width;
+  if (type_vector_is_name(name, &width) && params->size == 1) {
+    return type_vector_get(type_sys, width, params->head->val);
+  }
+  return NULL;
+}
+
 LLVMTypeRef type_get_ref(type_t* type) {
-  return type->get_ref();
+  if (type->get_ref == NULL) {
+    return NULL;
+  }
+  return type->get_ref(type);
 }
 
 type_t* type_set(type_system_t* type_sys, bool primitive, char* name,
-    LLVMTypeRef (*get_ref)(void*),
+    LLVMTypeRef (*get_ref)(type_t*),
     LLVMValueRef (*convert)(type_system_t*, LLVMBuilderRef, LLVMValueRef, type_t*)) {
   list_t* types = type_sys->types;
   type_t* type = malloc(sizeof(type_t));
   type->primitive = primitive;
+  type->kind = TYPE_KIND_PRIMITIVE;
   type->name = strdup(name);
   type->get_ref = get_ref;
   type->convert = convert;
+  type->params = NULL;
+  type->members = NULL;
+  type->layout = NULL;
   list_push(types, type);
   return type;
 }
 
+type_member_t* type_member_init(char* name, type_t* type, unsigned int index) {
+  type_member_t* member = malloc(sizeof(type_member_t));
+  member->name = name;
+  member->type = type;
+  member->index = index;
+  member->slot = index;
+  return member;
+}
+
+type_member_t* type_member_get(type_t* type, char* name) {
+  if (type->members == NULL) {
+    return NULL;
+  }
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* candidate = iter->val;
+    if (strcmp(candidate->name, name) == 0) {
+      return candidate;
+    }
+  }
+  return NULL;
+}
+
 bool type_equals(type_t* type1, type_t* type2) {
   // TODO - can we just do type1 == type2?
   return type1 == type2 || type_name_is(type1, type2->name);
@@ -8,28 +8,60 @@
 
 #include "list.h"
 
+typedef enum {
+  TYPE_KIND_PRIMITIVE,
+  TYPE_KIND_UNION,
+  TYPE_KIND_RECORD,
+  TYPE_KIND_ARRAY,
+  TYPE_KIND_VECTOR,
+  TYPE_KIND_MAP,
+} type_kind_t;
+
 typedef struct type_system_t {
   list_t* types;
 } type_system_t;
 
 typedef struct type_t {
   bool primitive;
+  type_kind_t kind;
   char* name;
-  LLVMTypeRef (*get_ref)();
+  LLVMTypeRef (*get_ref)(struct type_t*);
   LLVMValueRef (*convert)(type_system_t*, LLVMBuilderRef, LLVMValueRef, struct type_t*);
+  // type arguments of an instantiated type, e.g. Integer in Array(Integer)
+  list_t* params;
+  // variants of a union, fields of a record (in declaration order)
+  list_t* members;
+  // kind specific lowering information
+  void* layout;
 } type_t;
 
+typedef struct type_member_t {
+  char* name;
+  // NULL for a variant that carries no payload
+  type_t* type;
+  // position in the declaration
+  unsigned int index;
+  // position in the lowered LLVM struct
+  unsigned int slot;
+} type_member_t;
+
 type_system_t* type_init();
 
 void type_system_free(type_system_t*);
 
 type_t* type_get(type_system_t* type_sys, char* name);
 
+type_t* type_get_instance(type_system_t* type_sys, char* name, list_t* params);
+
 type_t* type_set(type_system_t* type_sys, bool primitive, char* name,
-    LLVMTypeRef (*get_ref)(void*),
+    LLVMTypeRef (*get_ref)(type_t*),
     LLVMValueRef (*convert)(type_system_t*, LLVMBuilderRef, LLVMValueRef, type_t*)
 );
 
+type_member_t* type_member_init(char* name, type_t* type, unsigned int index);
+
+type_member_t* type_member_get(type_t* type, char* name);
+
 bool type_equals(type_t* type1, type_t* type2);
 
 bool type_name_is(type_t* type, char* name);
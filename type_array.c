@@ -0,0 +1,149 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "type_array.h"
+#include "type_record.h"
+
+type_t* type_array_element(type_t* type) {
+  return type->params->head->val;
+}
+
+/*
+ * Array(T) is a { T*, length } pair. Arrays of @soa records keep one
+ * array per field instead: { { T1*, T2*, ... }, length }
+ */
+LLVMTypeRef type_array_get_ref(type_t* type) {
+  type_t* element_type = type_array_element(type);
+  LLVMTypeRef storage_ref;
+  if (type_record_is_soa(element_type)) {
+    storage_ref = type_record_soa_columns_ref(element_type);
+  } else {
+    storage_ref = LLVMPointerType(type_get_ref(element_type), 0);
+  }
+  LLVMTypeRef elements[] = { storage_ref, LLVMInt64Type() };
+  return LLVMStructType(elements, 2, false);
+}
+
+LLVMValueRef type_array_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
+  return NULL;
+}
+
+type_t* type_array_get(type_system_t* type_sys, type_t* element_type) {
+  if (type_get_ref(element_type) == NULL) {
+    fprintf(stderr, "Cannot make an array of %s\n", type_to_string(element_type));
+    return NULL;
+  }
+  char* name = malloc(sizeof(char) * (strlen(element_type->name) + 8));
+  sprintf(name, "Array(%s)", element_type->name);
+  type_t* type = type_get(type_sys, name);
+  if (type == NULL) {
+    type = type_set(type_sys, false, name, type_array_get_ref, type_array_convert);
+    type->kind = TYPE_KIND_ARRAY;
+    type->params = list_init();
+    list_push(type->params, element_type);
+  }
+  free(name);
+  return type;
+}
+
+// goes on when ok holds, otherwise calls the runtime function error_name with the length
+void type_array_check(LLVMBuilderRef builder, LLVMValueRef ok, char* error_name, LLVMValueRef length) {
+  LLVMValueRef fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+  LLVMBasicBlockRef ok_block = LLVMAppendBasicBlock(fun, "lengthok");
+  LLVMBasicBlockRef error_block = LLVMAppendBasicBlock(fun, "badlength");
+  LLVMBuildCondBr(builder, ok, ok_block, error_block);
+
+  LLVMPositionBuilderAtEnd(builder, error_block);
+  LLVMModuleRef mod = LLVMGetGlobalParent(fun);
+  LLVMValueRef error_fun = LLVMGetNamedFunction(mod, error_name);
+  if (error_fun == NULL) {
+    LLVMTypeRef param_types[] = { LLVMInt64Type() };
+    error_fun = LLVMAddFunction(mod, error_name, LLVMFunctionType(LLVMVoidType(), param_types, 1, false));
+  }
+  LLVMBuildCall(builder, error_fun, &length, 1, "");
+  LLVMBuildUnreachable(builder);
+
+  LLVMPositionBuilderAtEnd(builder, ok_block);
+}
+
+// zeroed memory for length elements of element_ref
+LLVMValueRef type_array_alloc(LLVMBuilderRef builder, LLVMTypeRef element_ref, LLVMValueRef length) {
+  LLVMModuleRef mod = LLVMGetGlobalParent(LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder)));
+  LLVMValueRef calloc_fun = LLVMGetNamedFunction(mod, "calloc");
+  if (calloc_fun == NULL) {
+    LLVMTypeRef param_types[] = { LLVMInt64Type(), LLVMInt64Type() };
+    calloc_fun = LLVMAddFunction(mod, "calloc", LLVMFunctionType(LLVMPointerType(LLVMInt8Type(), 0), param_types, 2, false));
+  }
+  LLVMValueRef args[] = { length, LLVMSizeOf(element_ref) };
+  LLVMValueRef mem = LLVMBuildCall(builder, calloc_fun, args, 2, "arraymem");
+  // calloc(0, size) may return NULL as well, which is fine for an empty array
+  LLVMValueRef allocated = LLVMBuildOr(builder,
+      LLVMBuildIsNotNull(builder, mem, "allocated"),
+      LLVMBuildICmp(builder, LLVMIntEQ, length, LLVMConstInt(LLVMInt64Type(), 0, false), "empty"), "allocated");
+  type_array_check(builder, allocated, "runtime_array_alloc_error", length);
+  return LLVMBuildBitCast(builder, mem, LLVMPointerType(element_ref, 0), "array");
+}
+
+// arrays live until the program exits; nothing is freed
+LLVMValueRef type_array_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef length) {
+  type_t* element_type = type_array_element(type);
+  // range.c relies on this for every array's length being at least 0
+  if (!LLVMIsAConstantInt(length) || LLVMConstIntGetSExtValue(length) < 0) {
+    LLVMValueRef non_negative = LLVMBuildICmp(builder, LLVMIntSGE, length, LLVMConstInt(LLVMInt64Type(), 0, false), "nonnegative");
+    type_array_check(builder, non_negative, "runtime_array_length_error", length);
+  }
+  LLVMValueRef storage;
+  if (type_record_is_soa(element_type)) {
+    storage = LLVMGetUndef(type_record_soa_columns_ref(element_type));
+    list_item_t* iter = list_iter_init(element_type->members);
+    for (; iter; iter = list_iter(iter)) {
+      type_member_t* field = iter->val;
+      LLVMValueRef column = type_array_alloc(builder, type_get_ref(field->type), length);
+      storage = LLVMBuildInsertValue(builder, storage, column, field->slot, field->name);
+    }
+  } else {
+    storage = type_array_alloc(builder, type_get_ref(element_type), length);
+  }
+  LLVMValueRef array = LLVMGetUndef(type_get_ref(type));
+  array = LLVMBuildInsertValue(builder, array, storage, 0, "storage");
+  return LLVMBuildInsertValue(builder, array, length, 1, "length");
+}
+
+LLVMValueRef type_array_length(type_t* type, LLVMBuilderRef builder, LLVMValueRef val) {
+  return LLVMBuildExtractValue(builder, val, 1, "length");
+}
+
+LLVMValueRef type_array_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index) {
+  type_t* element_type = type_array_element(type);
+  LLVMValueRef storage = LLVMBuildExtractValue(builder, val, 0, "storage");
+  if (type_record_is_soa(element_type)) {
+    return type_record_soa_load(element_type, builder, storage, index);
+  }
+  LLVMValueRef ptr = LLVMBuildGEP(builder, storage, &index, 1, "elementptr");
+  return LLVMBuildLoad(builder, ptr, "element");
+}
+
+// reads one field of an element, touching only that field's column for @soa records
+LLVMValueRef type_array_load_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index, type_member_t* field) {
+  type_t* element_type = type_array_element(type);
+  if (type_record_is_soa(element_type)) {
+    LLVMValueRef storage = LLVMBuildExtractValue(builder, val, 0, "storage");
+    return type_record_soa_load_field(element_type, builder, storage, index, field);
+  }
+  LLVMValueRef storage = LLVMBuildExtractValue(builder, val, 0, "storage");
+  LLVMValueRef indices[] = { index, LLVMConstInt(LLVMInt32Type(), field->slot, false) };
+  LLVMValueRef ptr = LLVMBuildGEP(builder, storage, indices, 2, "fieldptr");
+  return LLVMBuildLoad(builder, ptr, field->name);
+}
+
+void type_array_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index, LLVMValueRef element) {
+  type_t* element_type = type_array_element(type);
+  LLVMValueRef storage = LLVMBuildExtractValue(builder, val, 0, "storage");
+  if (type_record_is_soa(element_type)) {
+    type_record_soa_store(element_type, builder, storage, index, element);
+    return;
+  }
+  LLVMValueRef ptr = LLVMBuildGEP(builder, storage, &index, 1, "elementptr");
+  LLVMBuildStore(builder, element, ptr);
+}
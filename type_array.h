@@ -0,0 +1,21 @@
+#ifndef TYPE_ARRAY_H
+
+#define TYPE_ARRAY_H
+
+#include "type.h"
+
+type_t* type_array_get(type_system_t* type_sys, type_t* element_type);
+
+type_t* type_array_element(type_t* type);
+
+LLVMValueRef type_array_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef length);
+
+LLVMValueRef type_array_length(type_t* type, LLVMBuilderRef builder, LLVMValueRef val);
+
+LLVMValueRef type_array_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index);
+
+LLVMValueRef type_array_load_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index, type_member_t* field);
+
+void type_array_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef index, LLVMValueRef element);
+
+#endif
@@ -1,6 +1,8 @@
+#include <stdlib.h>
+
 #include "type_bool.h"
 
-LLVMTypeRef type_bool_get_ref() {
+LLVMTypeRef type_bool_get_ref(type_t* type) {
   return LLVMIntType(1);
 }
 
@@ -11,10 +13,10 @@ LLVMValueRef type_bool_convert(type_system_t* type_sys, LLVMBuilderRef builder,
   if (type_name_is(to_type, "Float")) {
     type_t* type_int = type_get(type_sys, "Integer");
     LLVMValueRef intermediate = type_int->convert(type_sys, builder, val, type_int);
-    return LLVMBuildSIToFP(builder, intermediate, to_type->get_ref(), "inttofloat");
+    return LLVMBuildSIToFP(builder, intermediate, type_get_ref(to_type), "inttofloat");
   }
   if (type_name_is(to_type, "Integer")) {
-    return LLVMBuildIntCast(builder, val, to_type->get_ref(), "booltoint");
+    return LLVMBuildIntCast(builder, val, type_get_ref(to_type), "booltoint");
   }
   return NULL;
 }
@@ -1,6 +1,8 @@
+#include <stdlib.h>
+
 #include "type_float.h"
 
-LLVMTypeRef type_float_get_ref() {
+LLVMTypeRef type_float_get_ref(type_t* type) {
   return LLVMDoubleType();
 }
 
@@ -9,12 +11,12 @@ LLVMValueRef type_float_convert(type_system_t* type_sys, LLVMBuilderRef builder,
     return val;
   }
   if (type_name_is(to_type, "Integer")) {
-    return LLVMBuildFPToSI(builder, val, to_type->get_ref(), "floattoint");
+    return LLVMBuildFPToSI(builder, val, type_get_ref(to_type), "floattoint");
   }
   if (type_name_is(to_type, "Boolean")) {
     type_t* int_type = type_get(type_sys, "Integer");
     LLVMValueRef intermediate = int_type->convert(type_sys, builder, val, int_type);
-    return LLVMBuildIntCast(builder, intermediate, to_type->get_ref(), "inttobool");
+    return LLVMBuildIntCast(builder, intermediate, type_get_ref(to_type), "inttobool");
   }
   return NULL;
 }
@@ -1,10 +1,35 @@
+#include <stdlib.h>
+
 #include "type_fun.h"
 
 LLVMValueRef type_fun_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
   return NULL;
 }
 
+/*
+ * Function(R) is still named Function so that it equals the plain type; the
+ * return type lets calls through a Function parameter be typed before the
+ * block it's bound to is known.
+ */
+type_t* type_fun_get(type_system_t* type_sys, type_t* ret_type) {
+  list_item_t* iter = list_iter_init(type_sys->types);
+  for (; iter; iter = list_iter(iter)) {
+    type_t* type = iter->val;
+    if (type_name_is(type, "Function") && type_fun_ret(type) == ret_type) {
+      return type;
+    }
+  }
+  type_t* type = type_set(type_sys, true, "Function", NULL, type_fun_convert);
+  type->params = list_init();
+  list_push(type->params, ret_type);
+  return type;
+}
+
+type_t* type_fun_ret(type_t* type) {
+  if (type->params == NULL || type->params->size == 0) return NULL;
+  return type->params->head->val;
+}
+
 void type_fun_init(type_system_t* type_sys) {
   type_set(type_sys, true, "Function", NULL, type_fun_convert);
 }
-
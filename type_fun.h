@@ -2,3 +2,8 @@
 
 void type_fun_init(type_system_t* type_sys);
 
+// Function(R), a block returning R
+type_t* type_fun_get(type_system_t* type_sys, type_t* ret_type);
+
+// NULL for a plain Function
+type_t* type_fun_ret(type_t* type);
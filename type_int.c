@@ -2,7 +2,7 @@
 
 #include "type_int.h"
 
-LLVMTypeRef type_int_get_ref() {
+LLVMTypeRef type_int_get_ref(type_t* type) {
   return LLVMInt64Type();
 }
 
@@ -11,10 +11,10 @@ LLVMValueRef type_int_convert(type_system_t* type_sys, LLVMBuilderRef builder, L
     return val;
   }
   if (type_name_is(to_type, "Float")) {
-    return LLVMBuildSIToFP(builder, val, to_type->get_ref(), "inttofloat");
+    return LLVMBuildSIToFP(builder, val, type_get_ref(to_type), "inttofloat");
   }
   if (type_name_is(to_type, "Boolean")) {
-    return LLVMBuildIntCast(builder, val, to_type->get_ref(), "inttobool");
+    return LLVMBuildIntCast(builder, val, type_get_ref(to_type), "inttobool");
   }
   return NULL;
 }
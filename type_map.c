@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "type_map.h"
+#include "runtime.h"
+
+type_t* type_map_key(type_t* type) {
+  return type->params->head->val;
+}
+
+type_t* type_map_value(type_t* type) {
+  return type->params->head->next->val;
+}
+
+// mirrors runtime_map_t
+LLVMTypeRef type_map_header_ref() {
+  LLVMTypeRef bytes = LLVMPointerType(LLVMInt8Type(), 0);
+  LLVMTypeRef fields[] = { bytes, bytes, LLVMInt64Type(), LLVMInt64Type(), LLVMInt64Type(), LLVMInt64Type() };
+  return LLVMStructType(fields, 6, false);
+}
+
+LLVMTypeRef type_map_get_ref(type_t* type) {
+  return LLVMPointerType(type_map_header_ref(), 0);
+}
+
+// keys are widened to 64 bits so the runtime can hash and compare them
+LLVMTypeRef type_map_slot_ref(type_t* type) {
+  LLVMTypeRef fields[] = { LLVMInt64Type(), type_get_ref(type_map_value(type)) };
+  return LLVMStructType(fields, 2, false);
+}
+
+LLVMValueRef type_map_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
+  return NULL;
+}
+
+type_t* type_map_get(type_system_t* type_sys, type_t* key_type, type_t* value_type) {
+  if (!type_name_is(key_type, "Integer") && !type_name_is(key_type, "Boolean")) {
+    fprintf(stderr, "Cannot use %s as a map key\n", type_to_string(key_type));
+    return NULL;
+  }
+  if (type_get_ref(value_type) == NULL) {
+    fprintf(stderr, "Cannot make a map of %s\n", type_to_string(value_type));
+    return NULL;
+  }
+  char* name = malloc(sizeof(char) * (strlen(key_type->name) + strlen(value_type->name) + 8));
+  sprintf(name, "Map(%s, %s)", key_type->name, value_type->name);
+  type_t* type = type_get(type_sys, name);
+  if (type == NULL) {
+    type = type_set(type_sys, false, name, type_map_get_ref, type_map_convert);
+    type->kind = TYPE_KIND_MAP;
+    type->params = list_init();
+    list_push(type->params, key_type);
+    list_push(type->params, value_type);
+  }
+  free(name);
+  return type;
+}
+
+LLVMValueRef type_map_runtime_fun(LLVMBuilderRef builder, char* name, LLVMTypeRef ret_type, LLVMTypeRef* param_types, unsigned int param_count) {
+  LLVMModuleRef mod = LLVMGetGlobalParent(LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder)));
+  LLVMValueRef fun = LLVMGetNamedFunction(mod, name);
+  if (fun == NULL) {
+    fun = LLVMAddFunction(mod, name, LLVMFunctionType(ret_type, param_types, param_count, false));
+  }
+  return fun;
+}
+
+LLVMValueRef type_map_header_load(LLVMBuilderRef builder, LLVMValueRef map, unsigned int field, char* name) {
+  return LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, map, field, name), name);
+}
+
+LLVMValueRef type_map_key_bits(LLVMBuilderRef builder, LLVMValueRef key) {
+  return LLVMBuildZExtOrBitCast(builder, key, LLVMInt64Type(), "keybits");
+}
+
+// must match runtime_map_hash
+LLVMValueRef type_map_hash(LLVMBuilderRef builder, LLVMValueRef key_bits) {
+  LLVMTypeRef i64 = LLVMInt64Type();
+  LLVMValueRef hash = LLVMBuildMul(builder, key_bits, LLVMConstInt(i64, 0x9E3779B97F4A7C15ULL, false), "hash");
+  LLVMValueRef high = LLVMBuildLShr(builder, hash, LLVMConstInt(i64, 29, false), "hashhigh");
+  return LLVMBuildXor(builder, hash, high, "hash");
+}
+
+LLVMValueRef type_map_splat_byte(LLVMBuilderRef builder, LLVMValueRef byte) {
+  LLVMTypeRef group_ref = LLVMVectorType(LLVMInt8Type(), RUNTIME_MAP_GROUP);
+  LLVMValueRef first = LLVMBuildInsertElement(builder, LLVMGetUndef(group_ref), byte,
+      LLVMConstInt(LLVMInt32Type(), 0, false), "bytefirst");
+  LLVMValueRef zeros = LLVMConstNull(LLVMVectorType(LLVMInt32Type(), RUNTIME_MAP_GROUP));
+  return LLVMBuildShuffleVector(builder, first, LLVMGetUndef(group_ref), zeros, "bytes");
+}
+
+// bit i is set when lane i of group equals bytes
+LLVMValueRef type_map_group_match(LLVMBuilderRef builder, LLVMValueRef group, LLVMValueRef bytes, char* name) {
+  LLVMValueRef lanes = LLVMBuildICmp(builder, LLVMIntEQ, group, bytes, name);
+  return LLVMBuildBitCast(builder, lanes, LLVMIntType(RUNTIME_MAP_GROUP), name);
+}
+
+/*
+ * The probe loop of runtime_map_find, emitted inline and specialized for
+ * the slot type. Each step compares 16 control bytes at once:
+ *
+ *   group = load <16 x i8> ctrl[pos]
+ *   for each lane where group == h2: compare that slot's key
+ *   stop at a group with an empty lane, else move on to the next group
+ *
+ * Gives a pointer to the key's slot, or null if the key isn't in the map.
+ */
+LLVMValueRef type_map_find(type_t* type, LLVMBuilderRef builder, LLVMValueRef map, LLVMValueRef key) {
+  LLVMTypeRef i64 = LLVMInt64Type();
+  LLVMTypeRef mask_ref = LLVMIntType(RUNTIME_MAP_GROUP);
+  LLVMTypeRef group_ref = LLVMVectorType(LLVMInt8Type(), RUNTIME_MAP_GROUP);
+  LLVMTypeRef slot_ptr_ref = LLVMPointerType(type_map_slot_ref(type), 0);
+  LLVMValueRef fun = LLVMGetBasicBlockParent(LLVMGetInsertBlock(builder));
+
+  LLVMValueRef ctrl = type_map_header_load(builder, map, 0, "ctrl");
+  LLVMValueRef slot_mem = type_map_header_load(builder, map, 1, "slotmem");
+  LLVMValueRef slots = LLVMBuildBitCast(builder, slot_mem, slot_ptr_ref, "slots");
+  LLVMValueRef capacity = type_map_header_load(builder, map, 2, "capacity");
+  LLVMValueRef mask = LLVMBuildSub(builder, capacity, LLVMConstInt(i64, 1, false), "mask");
+  LLVMValueRef key_bits = type_map_key_bits(builder, key);
+  LLVMValueRef hash = type_map_hash(builder, key_bits);
+  LLVMValueRef h2 = LLVMBuildAnd(builder, hash, LLVMConstInt(i64, 0x7f, false), "h2");
+  LLVMValueRef h2_bytes = type_map_splat_byte(builder, LLVMBuildTrunc(builder, h2, LLVMInt8Type(), "h2"));
+  LLVMValueRef empty_bytes = type_map_splat_byte(builder, LLVMConstInt(LLVMInt8Type(), RUNTIME_MAP_EMPTY, false));
+  LLVMValueRef h1 = LLVMBuildLShr(builder, hash, LLVMConstInt(i64, 7, false), "h1");
+  LLVMValueRef start = LLVMBuildAnd(builder, h1, mask, "start");
+  LLVMBasicBlockRef entry_block = LLVMGetInsertBlock(builder);
+
+  LLVMBasicBlockRef probe_block = LLVMAppendBasicBlock(fun, "probe");
+  LLVMBasicBlockRef scan_block = LLVMAppendBasicBlock(fun, "scan");
+  LLVMBasicBlockRef check_block = LLVMAppendBasicBlock(fun, "check");
+  LLVMBasicBlockRef next_match_block = LLVMAppendBasicBlock(fun, "nextmatch");
+  LLVMBasicBlockRef group_done_block = LLVMAppendBasicBlock(fun, "groupdone");
+  LLVMBasicBlockRef next_group_block = LLVMAppendBasicBlock(fun, "nextgroup");
+  LLVMBasicBlockRef done_block = LLVMAppendBasicBlock(fun, "probedone");
+  LLVMBuildBr(builder, probe_block);
+
+  LLVMPositionBuilderAtEnd(builder, probe_block);
+  LLVMValueRef pos = LLVMBuildPhi(builder, i64, "pos");
+  LLVMValueRef stride = LLVMBuildPhi(builder, i64, "stride");
+  LLVMValueRef group_ptr = LLVMBuildGEP(builder, ctrl, &pos, 1, "groupptr");
+  group_ptr = LLVMBuildBitCast(builder, group_ptr, LLVMPointerType(group_ref, 0), "groupptr");
+  LLVMValueRef group = LLVMBuildLoad(builder, group_ptr, "group");
+  LLVMSetAlignment(group, 1);
+  LLVMValueRef matches = type_map_group_match(builder, group, h2_bytes, "matches");
+  LLVMValueRef empties = type_map_group_match(builder, group, empty_bytes, "empties");
+  LLVMBuildBr(builder, scan_block);
+
+  LLVMPositionBuilderAtEnd(builder, scan_block);
+  LLVMValueRef bits = LLVMBuildPhi(builder, mask_ref, "bits");
+  LLVMValueRef any_match = LLVMBuildICmp(builder, LLVMIntNE, bits, LLVMConstNull(mask_ref), "anymatch");
+  LLVMBuildCondBr(builder, any_match, check_block, group_done_block);
+
+  LLVMPositionBuilderAtEnd(builder, check_block);
+  LLVMTypeRef cttz_params[] = { mask_ref, LLVMInt1Type() };
+  LLVMValueRef cttz = type_map_runtime_fun(builder, "llvm.cttz.i16", mask_ref, cttz_params, 2);
+  LLVMValueRef cttz_args[] = { bits, LLVMConstInt(LLVMInt1Type(), 1, false) };
+  LLVMValueRef lane = LLVMBuildCall(builder, cttz, cttz_args, 2, "lane");
+  lane = LLVMBuildZExt(builder, lane, i64, "lane");
+  LLVMValueRef index = LLVMBuildAnd(builder, LLVMBuildAdd(builder, pos, lane, "index"), mask, "index");
+  LLVMValueRef slot = LLVMBuildGEP(builder, slots, &index, 1, "slot");
+  LLVMValueRef slot_key = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, slot, 0, "slotkey"), "slotkey");
+  LLVMValueRef is_key = LLVMBuildICmp(builder, LLVMIntEQ, slot_key, key_bits, "iskey");
+  LLVMBuildCondBr(builder, is_key, done_block, next_match_block);
+
+  LLVMPositionBuilderAtEnd(builder, next_match_block);
+  LLVMValueRef lower = LLVMBuildSub(builder, bits, LLVMConstInt(mask_ref, 1, false), "lower");
+  LLVMValueRef rest = LLVMBuildAnd(builder, bits, lower, "rest");
+  LLVMBuildBr(builder, scan_block);
+
+  LLVMPositionBuilderAtEnd(builder, group_done_block);
+  LLVMValueRef any_empty = LLVMBuildICmp(builder, LLVMIntNE, empties, LLVMConstNull(mask_ref), "anyempty");
+  LLVMBuildCondBr(builder, any_empty, done_block, next_group_block);
+
+  LLVMPositionBuilderAtEnd(builder, next_group_block);
+  LLVMValueRef next_stride = LLVMBuildAdd(builder, stride, LLVMConstInt(i64, RUNTIME_MAP_GROUP, false), "stride");
+  LLVMValueRef next_pos = LLVMBuildAnd(builder, LLVMBuildAdd(builder, pos, next_stride, "pos"), mask, "pos");
+  LLVMBuildBr(builder, probe_block);
+
+  LLVMValueRef pos_vals[] = { start, next_pos };
+  LLVMBasicBlockRef pos_blocks[] = { entry_block, next_group_block };
+  LLVMAddIncoming(pos, pos_vals, pos_blocks, 2);
+  LLVMValueRef stride_vals[] = { LLVMConstInt(i64, 0, false), next_stride };
+  LLVMAddIncoming(stride, stride_vals, pos_blocks, 2);
+  LLVMValueRef bits_vals[] = { matches, rest };
+  LLVMBasicBlockRef bits_blocks[] = { probe_block, next_match_block };
+  LLVMAddIncoming(bits, bits_vals, bits_blocks, 2);
+
+  LLVMPositionBuilderAtEnd(builder, done_block);
+  LLVMValueRef found = LLVMBuildPhi(builder, slot_ptr_ref, "found");
+  LLVMValueRef found_vals[] = { slot, LLVMConstNull(slot_ptr_ref) };
+  LLVMBasicBlockRef found_blocks[] = { check_block, group_done_block };
+  LLVMAddIncoming(found, found_vals, found_blocks, 2);
+  return found;
+}
+
+// maps live until the program exits; nothing is freed
+LLVMValueRef type_map_build(type_t* type, LLVMBuilderRef builder) {
+  LLVMTypeRef param_types[] = { LLVMInt64Type() };
+  LLVMValueRef new_fun = type_map_runtime_fun(builder, "runtime_map_new", type_get_ref(type), param_types, 1);
+  LLVMValueRef args[] = { LLVMSizeOf(type_map_slot_ref(type)) };
+  return LLVMBuildCall(builder, new_fun, args, 1, "map");
+}
+
+LLVMValueRef type_map_length(type_t* type, LLVMBuilderRef builder, LLVMValueRef val) {
+  return type_map_header_load(builder, val, 3, "size");
+}
+
+LLVMValueRef type_map_contains(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key) {
+  LLVMValueRef slot = type_map_find(type, builder, val, key);
+  return LLVMBuildIsNotNull(builder, slot, "contains");
+}
+
+// a missing key reads as the zero value, like a freshly inserted one
+LLVMValueRef type_map_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key) {
+  LLVMValueRef slot = type_map_find(type, builder, val, key);
+  LLVMBasicBlockRef miss_block = LLVMGetInsertBlock(builder);
+  LLVMValueRef fun = LLVMGetBasicBlockParent(miss_block);
+  LLVMBasicBlockRef hit_block = LLVMAppendBasicBlock(fun, "hit");
+  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(fun, "lookupdone");
+  LLVMBuildCondBr(builder, LLVMBuildIsNotNull(builder, slot, "hit"), hit_block, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, hit_block);
+  LLVMValueRef value = LLVMBuildLoad(builder, LLVMBuildStructGEP(builder, slot, 1, "valueptr"), "value");
+  LLVMBuildBr(builder, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, merge_block);
+  LLVMValueRef res = LLVMBuildPhi(builder, LLVMTypeOf(value), "lookup");
+  LLVMValueRef vals[] = { value, LLVMConstNull(LLVMTypeOf(value)) };
+  LLVMBasicBlockRef blocks[] = { hit_block, miss_block };
+  LLVMAddIncoming(res, vals, blocks, 2);
+  return res;
+}
+
+// updating an existing key stays inline; only new keys call into the runtime
+void type_map_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key, LLVMValueRef value) {
+  LLVMTypeRef slot_ptr_ref = LLVMPointerType(type_map_slot_ref(type), 0);
+  LLVMValueRef slot = type_map_find(type, builder, val, key);
+  LLVMBasicBlockRef hit_block = LLVMGetInsertBlock(builder);
+  LLVMValueRef fun = LLVMGetBasicBlockParent(hit_block);
+  LLVMBasicBlockRef insert_block = LLVMAppendBasicBlock(fun, "insert");
+  LLVMBasicBlockRef merge_block = LLVMAppendBasicBlock(fun, "insertdone");
+  LLVMBuildCondBr(builder, LLVMBuildIsNull(builder, slot, "miss"), insert_block, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, insert_block);
+  LLVMTypeRef param_types[] = { LLVMTypeOf(val), LLVMInt64Type() };
+  LLVMValueRef insert_fun = type_map_runtime_fun(builder, "runtime_map_insert",
+      LLVMPointerType(LLVMInt8Type(), 0), param_types, 2);
+  LLVMValueRef args[] = { val, type_map_key_bits(builder, key) };
+  LLVMValueRef new_slot = LLVMBuildCall(builder, insert_fun, args, 2, "newslot");
+  new_slot = LLVMBuildBitCast(builder, new_slot, slot_ptr_ref, "newslot");
+  LLVMBuildBr(builder, merge_block);
+
+  LLVMPositionBuilderAtEnd(builder, merge_block);
+  LLVMValueRef target = LLVMBuildPhi(builder, slot_ptr_ref, "slot");
+  LLVMValueRef vals[] = { slot, new_slot };
+  LLVMBasicBlockRef blocks[] = { hit_block, insert_block };
+  LLVMAddIncoming(target, vals, blocks, 2);
+  LLVMBuildStore(builder, value, LLVMBuildStructGEP(builder, target, 1, "valueptr"));
+}
@@ -0,0 +1,23 @@
+#ifndef TYPE_MAP_H
+
+#define TYPE_MAP_H
+
+#include "type.h"
+
+type_t* type_map_get(type_system_t* type_sys, type_t* key_type, type_t* value_type);
+
+type_t* type_map_key(type_t* type);
+
+type_t* type_map_value(type_t* type);
+
+LLVMValueRef type_map_build(type_t* type, LLVMBuilderRef builder);
+
+LLVMValueRef type_map_length(type_t* type, LLVMBuilderRef builder, LLVMValueRef val);
+
+LLVMValueRef type_map_contains(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key);
+
+LLVMValueRef type_map_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key);
+
+void type_map_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, LLVMValueRef key, LLVMValueRef value);
+
+#endif
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "type_record.h"
+
+// ABI alignment on the 64 bit targets we JIT for
+unsigned int type_record_alignment(LLVMTypeRef ref) {
+  switch (LLVMGetTypeKind(ref)) {
+    case LLVMIntegerTypeKind: {
+      unsigned int bytes = (LLVMGetIntTypeWidth(ref) + 7) / 8;
+      unsigned int align = 1;
+      while (align < bytes && align < 8) align *= 2;
+      return align;
+    }
+    case LLVMStructTypeKind: {
+      unsigned int count = LLVMCountStructElementTypes(ref);
+      LLVMTypeRef elements[count];
+      LLVMGetStructElementTypes(ref, elements);
+      unsigned int align = 1;
+      for (unsigned int i = 0; i < count; i++) {
+        unsigned int element_align = type_record_alignment(elements[i]);
+        if (element_align > align) align = element_align;
+      }
+      return align;
+    }
+    case LLVMDoubleTypeKind:
+    case LLVMPointerTypeKind:
+    default:
+      return 8;
+  }
+}
+
+/*
+ * Lay fields out by decreasing alignment so no padding is needed between them:
+ *
+ * record { a:Boolean, b:Integer, c:Boolean } -> { i64, i1, i1 } (16 bytes, not 24)
+ */
+record_layout_t* type_record_layout(type_t* type, bool soa) {
+  record_layout_t* layout = malloc(sizeof(record_layout_t));
+  layout->soa = soa;
+  size_t num_fields = type->members->size;
+  layout->slots = malloc(sizeof(type_member_t*) * num_fields);
+  unsigned int aligns[num_fields];
+  unsigned int placed = 0;
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* field = iter->val;
+    unsigned int align = type_record_alignment(type_get_ref(field->type));
+    // stable insertion keeps declaration order between equally aligned fields
+    unsigned int i = placed;
+    while (i > 0 && aligns[i - 1] < align) {
+      layout->slots[i] = layout->slots[i - 1];
+      aligns[i] = aligns[i - 1];
+      i--;
+    }
+    layout->slots[i] = field;
+    aligns[i] = align;
+    placed++;
+  }
+  for (unsigned int i = 0; i < num_fields; i++) {
+    layout->slots[i]->slot = i;
+  }
+  return layout;
+}
+
+LLVMTypeRef type_record_get_ref(type_t* type) {
+  record_layout_t* layout = type->layout;
+  size_t num_fields = type->members->size;
+  LLVMTypeRef elements[num_fields];
+  for (unsigned int i = 0; i < num_fields; i++) {
+    elements[i] = type_get_ref(layout->slots[i]->type);
+  }
+  return LLVMStructType(elements, num_fields, false);
+}
+
+LLVMValueRef type_record_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
+  return NULL;
+}
+
+type_t* type_record_init(type_system_t* type_sys, char* name, list_t* fields, bool soa) {
+  if (type_get(type_sys, name) != NULL) {
+    fprintf(stderr, "Cannot redeclare type: %s\n", name);
+    return NULL;
+  }
+  if (fields->size == 0) {
+    fprintf(stderr, "Record %s must have at least one field\n", name);
+    return NULL;
+  }
+  list_item_t* iter = list_iter_init(fields);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* field = iter->val;
+    if (type_get_ref(field->type) == NULL) {
+      fprintf(stderr, "Field %s of %s cannot hold a %s\n", field->name, name, type_to_string(field->type));
+      return NULL;
+    }
+  }
+  type_t* type = type_set(type_sys, false, name, type_record_get_ref, type_record_convert);
+  type->kind = TYPE_KIND_RECORD;
+  type->members = fields;
+  record_layout_t* layout = type_record_layout(type, soa);
+  type->layout = layout;
+  return type;
+}
+
+bool type_record_is_soa(type_t* type) {
+  return type->kind == TYPE_KIND_RECORD && ((record_layout_t*)type->layout)->soa;
+}
+
+// values are in declaration order
+LLVMValueRef type_record_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef* values) {
+  LLVMValueRef record = LLVMGetUndef(type_get_ref(type));
+  list_item_t* iter = list_iter_init(type->members);
+  for (unsigned int i = 0; iter; iter = list_iter(iter), i++) {
+    type_member_t* field = iter->val;
+    record = LLVMBuildInsertValue(builder, record, values[i], field->slot, field->name);
+  }
+  return record;
+}
+
+LLVMValueRef type_record_get_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, type_member_t* field) {
+  return LLVMBuildExtractValue(builder, val, field->slot, field->name);
+}
+
+/*
+ * A collection of @soa records is stored as one array per field, so a loop
+ * reading a single field only touches that field's array:
+ *
+ * record { x:Float, alive:Boolean } -> { double*, i1* }
+ */
+LLVMTypeRef type_record_soa_columns_ref(type_t* type) {
+  record_layout_t* layout = type->layout;
+  size_t num_fields = type->members->size;
+  LLVMTypeRef columns[num_fields];
+  for (unsigned int i = 0; i < num_fields; i++) {
+    columns[i] = LLVMPointerType(type_get_ref(layout->slots[i]->type), 0);
+  }
+  return LLVMStructType(columns, num_fields, false);
+}
+
+LLVMValueRef type_record_soa_load_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index, type_member_t* field) {
+  LLVMValueRef column = LLVMBuildExtractValue(builder, columns, field->slot, "column");
+  LLVMValueRef ptr = LLVMBuildGEP(builder, column, &index, 1, "elementptr");
+  return LLVMBuildLoad(builder, ptr, field->name);
+}
+
+LLVMValueRef type_record_soa_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index) {
+  LLVMValueRef record = LLVMGetUndef(type_get_ref(type));
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* field = iter->val;
+    LLVMValueRef field_val = type_record_soa_load_field(type, builder, columns, index, field);
+    record = LLVMBuildInsertValue(builder, record, field_val, field->slot, field->name);
+  }
+  return record;
+}
+
+void type_record_soa_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index, LLVMValueRef val) {
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* field = iter->val;
+    LLVMValueRef column = LLVMBuildExtractValue(builder, columns, field->slot, "column");
+    LLVMValueRef ptr = LLVMBuildGEP(builder, column, &index, 1, "elementptr");
+    LLVMBuildStore(builder, type_record_get_field(type, builder, val, field), ptr);
+  }
+}
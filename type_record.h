@@ -0,0 +1,30 @@
+#ifndef TYPE_RECORD_H
+
+#define TYPE_RECORD_H
+
+#include "type.h"
+
+typedef struct {
+  // collections of this record keep one array per field (@soa)
+  bool soa;
+  // fields in slot order
+  type_member_t** slots;
+} record_layout_t;
+
+type_t* type_record_init(type_system_t* type_sys, char* name, list_t* fields, bool soa);
+
+bool type_record_is_soa(type_t* type);
+
+LLVMValueRef type_record_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef* values);
+
+LLVMValueRef type_record_get_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef val, type_member_t* field);
+
+LLVMTypeRef type_record_soa_columns_ref(type_t* type);
+
+LLVMValueRef type_record_soa_load(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index);
+
+LLVMValueRef type_record_soa_load_field(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index, type_member_t* field);
+
+void type_record_soa_store(type_t* type, LLVMBuilderRef builder, LLVMValueRef columns, LLVMValueRef index, LLVMValueRef val);
+
+#endif
@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "type_union.h"
+
+unsigned int type_union_round_bits(unsigned int bits) {
+  if (bits <= 8) return 8;
+  if (bits <= 16) return 16;
+  if (bits <= 32) return 32;
+  return 64;
+}
+
+// number of bits a payload occupies, or 0 if it can't be stored in a union
+unsigned int type_union_payload_bits(type_t* type) {
+  LLVMTypeRef ref = type_get_ref(type);
+  if (ref == NULL) {
+    return 0;
+  }
+  switch (LLVMGetTypeKind(ref)) {
+    case LLVMIntegerTypeKind:
+      return LLVMGetIntTypeWidth(ref);
+    case LLVMDoubleTypeKind:
+      return 64;
+    default:
+      return 0;
+  }
+}
+
+// values a type never takes when stored as an integer of `bits` bits start at `start`
+bool type_union_niche(type_t* type, unsigned int* bits, unsigned long long* start) {
+  if (type_name_is(type, "Boolean")) {
+    *bits = 8;
+    *start = 2;
+    return true;
+  }
+  if (type->kind != TYPE_KIND_UNION) {
+    return false;
+  }
+  union_layout_t* layout = type->layout;
+  unsigned long long used;
+  if (layout->kind == UNION_LAYOUT_NICHE) {
+    used = layout->niche_start + type->members->size - 1;
+  } else if (layout->kind == UNION_LAYOUT_PACKED && layout->payload_bits + layout->tag_bits < 64) {
+    used = (unsigned long long)type->members->size << layout->payload_bits;
+  } else {
+    return false;
+  }
+  if (layout->storage_bits < 64 && used >= (1ULL << layout->storage_bits)) {
+    return false;
+  }
+  *bits = layout->storage_bits;
+  *start = used;
+  return true;
+}
+
+LLVMValueRef type_union_to_bits(LLVMBuilderRef builder, LLVMValueRef val, LLVMTypeRef bits_ref) {
+  if (LLVMTypeOf(val) == bits_ref) {
+    return val;
+  }
+  if (LLVMGetTypeKind(LLVMTypeOf(val)) == LLVMDoubleTypeKind) {
+    val = LLVMBuildBitCast(builder, val, LLVMInt64Type(), "floatbits");
+  }
+  return LLVMBuildZExtOrBitCast(builder, val, bits_ref, "payloadbits");
+}
+
+LLVMValueRef type_union_from_bits(LLVMBuilderRef builder, LLVMValueRef bits, type_t* payload_type) {
+  LLVMTypeRef ref = type_get_ref(payload_type);
+  if (LLVMTypeOf(bits) == ref) {
+    return bits;
+  }
+  if (LLVMGetTypeKind(ref) == LLVMDoubleTypeKind) {
+    bits = LLVMBuildTruncOrBitCast(builder, bits, LLVMInt64Type(), "floatbits");
+    return LLVMBuildBitCast(builder, bits, ref, "payload");
+  }
+  return LLVMBuildTruncOrBitCast(builder, bits, ref, "payload");
+}
+
+/*
+ * Pick the smallest representation for the union:
+ *
+ * union { Some(Boolean), None }          -> i8, None is 2
+ * union { A(Boolean), B(Boolean), C }    -> i8, tag in bits 1-2
+ * union { Some(Integer), None }          -> { i8, i64 }
+ */
+union_layout_t* type_union_layout(type_t* type) {
+  union_layout_t* layout = malloc(sizeof(union_layout_t));
+  size_t num_variants = type->members->size;
+  layout->tag_bits = 0;
+  while ((1ULL << layout->tag_bits) < num_variants) layout->tag_bits++;
+  layout->payload_bits = 0;
+  layout->payload_ref = NULL;
+  layout->dataful = NULL;
+  layout->niche_start = 0;
+
+  size_t num_dataful = 0;
+  bool same_payload_ref = true;
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* variant = iter->val;
+    if (variant->type == NULL) continue;
+    num_dataful++;
+    layout->dataful = variant;
+    unsigned int bits = type_union_payload_bits(variant->type);
+    if (bits > layout->payload_bits) {
+      layout->payload_bits = bits;
+    }
+    LLVMTypeRef ref = type_get_ref(variant->type);
+    if (layout->payload_ref != NULL && layout->payload_ref != ref) {
+      same_payload_ref = false;
+    }
+    layout->payload_ref = ref;
+  }
+
+  unsigned int niche_bits;
+  unsigned long long niche_start;
+  if (num_dataful == 1 && num_variants > 1 &&
+      type_union_niche(layout->dataful->type, &niche_bits, &niche_start) &&
+      (niche_bits == 64 || niche_start + (num_variants - 1) <= (1ULL << niche_bits))) {
+    layout->kind = UNION_LAYOUT_NICHE;
+    layout->storage_bits = niche_bits;
+    layout->niche_start = niche_start;
+  } else if (layout->payload_bits + layout->tag_bits <= 64) {
+    layout->kind = UNION_LAYOUT_PACKED;
+    layout->storage_bits = type_union_round_bits(layout->payload_bits + layout->tag_bits);
+    layout->dataful = NULL;
+  } else {
+    layout->kind = UNION_LAYOUT_TAGGED;
+    layout->storage_bits = type_union_round_bits(layout->tag_bits);
+    layout->dataful = NULL;
+    if (!same_payload_ref) {
+      layout->payload_ref = LLVMIntType(layout->payload_bits);
+    }
+  }
+  return layout;
+}
+
+LLVMTypeRef type_union_get_ref(type_t* type) {
+  union_layout_t* layout = type->layout;
+  if (layout->kind == UNION_LAYOUT_TAGGED) {
+    LLVMTypeRef elements[] = { LLVMIntType(layout->storage_bits), layout->payload_ref };
+    return LLVMStructType(elements, 2, false);
+  }
+  return LLVMIntType(layout->storage_bits);
+}
+
+LLVMValueRef type_union_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
+  return NULL;
+}
+
+type_t* type_union_init(type_system_t* type_sys, char* name, list_t* variants) {
+  if (type_get(type_sys, name) != NULL) {
+    fprintf(stderr, "Cannot redeclare type: %s\n", name);
+    return NULL;
+  }
+  if (variants->size == 0) {
+    fprintf(stderr, "Union %s must have at least one variant\n", name);
+    return NULL;
+  }
+  list_item_t* iter = list_iter_init(variants);
+  for (; iter; iter = list_iter(iter)) {
+    type_member_t* variant = iter->val;
+    if (variant->type != NULL && type_union_payload_bits(variant->type) == 0) {
+      fprintf(stderr, "Variant %s of %s cannot hold a %s\n", variant->name, name, type_to_string(variant->type));
+      return NULL;
+    }
+  }
+  type_t* type = type_set(type_sys, false, name, type_union_get_ref, type_union_convert);
+  type->kind = TYPE_KIND_UNION;
+  type->members = variants;
+  union_layout_t* layout = type_union_layout(type);
+  type->layout = layout;
+  return type;
+}
+
+type_t* type_option_get(type_system_t* type_sys, type_t* payload_type) {
+  char* name = malloc(sizeof(char) * (strlen(payload_type->name) + 9));
+  sprintf(name, "Option(%s)", payload_type->name);
+  type_t* type = type_get(type_sys, name);
+  if (type == NULL) {
+    list_t* variants = list_init();
+    list_push(variants, type_member_init(strdup("Some"), payload_type, 0));
+    list_push(variants, type_member_init(strdup("None"), NULL, 1));
+    type = type_union_init(type_sys, name, variants);
+    if (type != NULL) {
+      type->params = list_init();
+      list_push(type->params, payload_type);
+    }
+  }
+  free(name);
+  return type;
+}
+
+type_member_t* type_union_find_variant(type_system_t* type_sys, char* name, type_t** union_type) {
+  list_item_t* iter = list_iter_init(type_sys->types);
+  for (; iter; iter = list_iter(iter)) {
+    type_t* candidate = iter->val;
+    // instances of generic unions are looked up by their type arguments
+    if (candidate->kind != TYPE_KIND_UNION || candidate->params != NULL) continue;
+    type_member_t* variant = type_member_get(candidate, name);
+    if (variant) {
+      *union_type = candidate;
+      return variant;
+    }
+  }
+  return NULL;
+}
+
+LLVMValueRef type_union_build(type_t* type, LLVMBuilderRef builder, type_member_t* variant, LLVMValueRef payload) {
+  union_layout_t* layout = type->layout;
+  LLVMTypeRef storage_ref = LLVMIntType(layout->storage_bits);
+  if (layout->kind == UNION_LAYOUT_NICHE) {
+    if (variant == layout->dataful) {
+      return type_union_to_bits(builder, payload, storage_ref);
+    }
+    return type_union_case_value(type, variant);
+  }
+  if (layout->kind == UNION_LAYOUT_PACKED) {
+    unsigned long long tag_val = layout->tag_bits > 0 ? (unsigned long long)variant->index << layout->payload_bits : 0;
+    LLVMValueRef tag = LLVMConstInt(storage_ref, tag_val, false);
+    if (payload == NULL) {
+      return tag;
+    }
+    LLVMValueRef bits = type_union_to_bits(builder, payload, storage_ref);
+    if (layout->tag_bits == 0) {
+      return bits;
+    }
+    return LLVMBuildOr(builder, tag, bits, "packed");
+  }
+  LLVMValueRef tagged = LLVMGetUndef(type_get_ref(type));
+  tagged = LLVMBuildInsertValue(builder, tagged, LLVMConstInt(storage_ref, variant->index, false), 0, "tag");
+  LLVMValueRef slot = payload ? type_union_to_bits(builder, payload, layout->payload_ref) : LLVMConstNull(layout->payload_ref);
+  return LLVMBuildInsertValue(builder, tagged, slot, 1, "tagged");
+}
+
+// the value to switch on when matching; see type_union_case_value
+LLVMValueRef type_union_discriminant(type_t* type, LLVMBuilderRef builder, LLVMValueRef val) {
+  union_layout_t* layout = type->layout;
+  LLVMTypeRef storage_ref = LLVMIntType(layout->storage_bits);
+  switch (layout->kind) {
+    case UNION_LAYOUT_NICHE:
+      return val;
+    case UNION_LAYOUT_PACKED:
+      if (layout->tag_bits == 0) {
+        return LLVMConstInt(storage_ref, 0, false);
+      }
+      if (layout->payload_bits == 0) {
+        return val;
+      }
+      return LLVMBuildLShr(builder, val, LLVMConstInt(storage_ref, layout->payload_bits, false), "tag");
+    case UNION_LAYOUT_TAGGED:
+    default:
+      return LLVMBuildExtractValue(builder, val, 0, "tag");
+  }
+}
+
+// NULL when the variant is whatever the discriminant doesn't otherwise match
+LLVMValueRef type_union_case_value(type_t* type, type_member_t* variant) {
+  union_layout_t* layout = type->layout;
+  LLVMTypeRef storage_ref = LLVMIntType(layout->storage_bits);
+  if (layout->kind != UNION_LAYOUT_NICHE) {
+    return LLVMConstInt(storage_ref, variant->index, false);
+  }
+  if (variant == layout->dataful) {
+    return NULL;
+  }
+  unsigned long long niche = layout->niche_start;
+  list_item_t* iter = list_iter_init(type->members);
+  for (; iter && iter->val != variant; iter = list_iter(iter)) {
+    type_member_t* prev = iter->val;
+    if (prev != layout->dataful) niche++;
+  }
+  return LLVMConstInt(storage_ref, niche, false);
+}
+
+LLVMValueRef type_union_get_payload(type_t* type, LLVMBuilderRef builder, type_member_t* variant, LLVMValueRef val) {
+  union_layout_t* layout = type->layout;
+  if (layout->kind == UNION_LAYOUT_TAGGED) {
+    val = LLVMBuildExtractValue(builder, val, 1, "slot");
+  }
+  return type_union_from_bits(builder, val, variant->type);
+}
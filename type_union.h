@@ -0,0 +1,42 @@
+#ifndef TYPE_UNION_H
+
+#define TYPE_UNION_H
+
+#include "type.h"
+
+typedef enum {
+  // { tag, payload } pair, returned in two registers
+  UNION_LAYOUT_TAGGED,
+  // a single integer with the tag in the bits above the payload
+  UNION_LAYOUT_PACKED,
+  // payload-less variants use values the only payload never takes
+  UNION_LAYOUT_NICHE,
+} union_layout_kind_t;
+
+typedef struct {
+  union_layout_kind_t kind;
+  unsigned int tag_bits;
+  unsigned int payload_bits;
+  unsigned int storage_bits;
+  // tagged: what the payload slot is stored as
+  LLVMTypeRef payload_ref;
+  // niche: the variant that carries a payload, and the first value not used by it
+  type_member_t* dataful;
+  unsigned long long niche_start;
+} union_layout_t;
+
+type_t* type_union_init(type_system_t* type_sys, char* name, list_t* variants);
+
+type_t* type_option_get(type_system_t* type_sys, type_t* payload_type);
+
+type_member_t* type_union_find_variant(type_system_t* type_sys, char* name, type_t** union_type);
+
+LLVMValueRef type_union_build(type_t* type, LLVMBuilderRef builder, type_member_t* variant, LLVMValueRef payload);
+
+LLVMValueRef type_union_discriminant(type_t* type, LLVMBuilderRef builder, LLVMValueRef val);
+
+LLVMValueRef type_union_case_value(type_t* type, type_member_t* variant);
+
+LLVMValueRef type_union_get_payload(type_t* type, LLVMBuilderRef builder, type_member_t* variant, LLVMValueRef val);
+
+#endif
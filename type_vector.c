@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "type_vector.h"
+
+type_t* type_vector_element(type_t* type) {
+  return type->params->head->val;
+}
+
+unsigned int type_vector_width(type_t* type) {
+  return LLVMGetVectorSize(type_get_ref(type));
+}
+
+// Vec2, Vec4, Vec8 and Vec16
+bool type_vector_is_name(char* name, unsigned int* width) {
+  if (strncmp(name, "Vec", 3) != 0) {
+    return false;
+  }
+  char* end;
+  unsigned long n = strtoul(name + 3, &end, 10);
+  if (*end != '\0' || end == name + 3) {
+    return false;
+  }
+  if (n != 2 && n != 4 && n != 8 && n != 16) {
+    return false;
+  }
+  *width = n;
+  return true;
+}
+
+/*
+ * VecN(T) is an <N x T> register. Arithmetic on it lowers to a single
+ * vector instruction; the backend splits it when N * T is wider than the
+ * target's registers.
+ */
+LLVMTypeRef type_vector_get_ref(type_t* type) {
+  type_t* element_type = type_vector_element(type);
+  unsigned int width;
+  sscanf(type->name, "Vec%u", &width);
+  return LLVMVectorType(type_get_ref(element_type), width);
+}
+
+LLVMValueRef type_vector_convert(type_system_t* type_sys, LLVMBuilderRef builder, LLVMValueRef val, type_t* to_type) {
+  return NULL;
+}
+
+type_t* type_vector_get(type_system_t* type_sys, unsigned int width, type_t* element_type) {
+  if (width != 2 && width != 4 && width != 8 && width != 16) {
+    fprintf(stderr, "Vectors have 2, 4, 8 or 16 lanes, not %u\n", width);
+    return NULL;
+  }
+  if (!type_name_is(element_type, "Integer") && !type_name_is(element_type, "Float") &&
+      !type_name_is(element_type, "Boolean")) {
+    fprintf(stderr, "Cannot make a vector of %s\n", type_to_string(element_type));
+    return NULL;
+  }
+  char* name = malloc(sizeof(char) * (strlen(element_type->name) + 9));
+  sprintf(name, "Vec%u(%s)", width, element_type->name);
+  type_t* type = type_get(type_sys, name);
+  if (type == NULL) {
+    type = type_set(type_sys, false, name, type_vector_get_ref, type_vector_convert);
+    type->kind = TYPE_KIND_VECTOR;
+    type->params = list_init();
+    list_push(type->params, element_type);
+  }
+  free(name);
+  return type;
+}
+
+LLVMValueRef type_vector_splat(type_t* type, LLVMBuilderRef builder, LLVMValueRef scalar) {
+  LLVMTypeRef ref = type_get_ref(type);
+  LLVMValueRef first = LLVMBuildInsertElement(builder, LLVMGetUndef(ref), scalar,
+      LLVMConstInt(LLVMInt32Type(), 0, false), "splatfirst");
+  unsigned int width = type_vector_width(type);
+  unsigned int mask[width];
+  memset(mask, 0, sizeof(mask));
+  return type_vector_shuffle(builder, first, NULL, mask, width);
+}
+
+LLVMValueRef type_vector_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef* elements) {
+  LLVMValueRef vector = LLVMGetUndef(type_get_ref(type));
+  unsigned int width = type_vector_width(type);
+  for (unsigned int i = 0; i < width; i++) {
+    vector = LLVMBuildInsertElement(builder, vector, elements[i],
+        LLVMConstInt(LLVMInt32Type(), i, false), "vector");
+  }
+  return vector;
+}
+
+// mask indices past the width of lhs select from rhs
+LLVMValueRef type_vector_shuffle(LLVMBuilderRef builder, LLVMValueRef lhs, LLVMValueRef rhs, unsigned int* mask, unsigned int width) {
+  LLVMValueRef mask_vals[width];
+  for (unsigned int i = 0; i < width; i++) {
+    mask_vals[i] = LLVMConstInt(LLVMInt32Type(), mask[i], false);
+  }
+  if (rhs == NULL) {
+    rhs = LLVMGetUndef(LLVMTypeOf(lhs));
+  }
+  return LLVMBuildShuffleVector(builder, lhs, rhs, LLVMConstVector(mask_vals, width), "shuffle");
+}
+
+LLVMValueRef type_vector_combine(type_t* element_type, LLVMBuilderRef builder, reduce_op_t op, LLVMValueRef lhs, LLVMValueRef rhs) {
+  bool is_float = type_name_is(element_type, "Float");
+  LLVMValueRef cmp;
+  switch (op) {
+    case REDUCE_OP_SUM:
+      return is_float ? LLVMBuildFAdd(builder, lhs, rhs, "sum") : LLVMBuildAdd(builder, lhs, rhs, "sum");
+    case REDUCE_OP_PRODUCT:
+      return is_float ? LLVMBuildFMul(builder, lhs, rhs, "product") : LLVMBuildMul(builder, lhs, rhs, "product");
+    case REDUCE_OP_MIN:
+      cmp = is_float ? LLVMBuildFCmp(builder, LLVMRealOLT, lhs, rhs, "lt") : LLVMBuildICmp(builder, LLVMIntSLT, lhs, rhs, "lt");
+      return LLVMBuildSelect(builder, cmp, lhs, rhs, "min");
+    case REDUCE_OP_MAX:
+      cmp = is_float ? LLVMBuildFCmp(builder, LLVMRealOGT, lhs, rhs, "gt") : LLVMBuildICmp(builder, LLVMIntSGT, lhs, rhs, "gt");
+      return LLVMBuildSelect(builder, cmp, lhs, rhs, "max");
+    case REDUCE_OP_ALL:
+      return LLVMBuildAnd(builder, lhs, rhs, "all");
+    case REDUCE_OP_ANY:
+      return LLVMBuildOr(builder, lhs, rhs, "any");
+    default:
+      return NULL;
+  }
+}
+
+/*
+ * Fold the upper half of the vector onto the lower half until one lane is
+ * left, so a reduction of N lanes takes log2(N) vector operations:
+ *
+ * sum(<a, b, c, d>) -> <a+c, b+d, _, _> -> <a+c+b+d, _, _, _>
+ */
+LLVMValueRef type_vector_reduce(type_t* type, LLVMBuilderRef builder, reduce_op_t op, LLVMValueRef val) {
+  type_t* element_type = type_vector_element(type);
+  unsigned int width = type_vector_width(type);
+  unsigned int mask[width];
+  for (unsigned int half = width / 2; half > 0; half /= 2) {
+    for (unsigned int i = 0; i < width; i++) {
+      // lanes past the half are don't-cares; keep them in range
+      mask[i] = (i + half) % width;
+    }
+    LLVMValueRef upper = type_vector_shuffle(builder, val, NULL, mask, width);
+    val = type_vector_combine(element_type, builder, op, val, upper);
+    if (val == NULL) return NULL;
+  }
+  return LLVMBuildExtractElement(builder, val, LLVMConstInt(LLVMInt32Type(), 0, false), "reduced");
+}
@@ -0,0 +1,24 @@
+#ifndef TYPE_VECTOR_H
+
+#define TYPE_VECTOR_H
+
+#include "type.h"
+#include "enums.h"
+
+type_t* type_vector_get(type_system_t* type_sys, unsigned int width, type_t* element_type);
+
+bool type_vector_is_name(char* name, unsigned int* width);
+
+type_t* type_vector_element(type_t* type);
+
+unsigned int type_vector_width(type_t* type);
+
+LLVMValueRef type_vector_splat(type_t* type, LLVMBuilderRef builder, LLVMValueRef scalar);
+
+LLVMValueRef type_vector_build(type_t* type, LLVMBuilderRef builder, LLVMValueRef* elements);
+
+LLVMValueRef type_vector_shuffle(LLVMBuilderRef builder, LLVMValueRef lhs, LLVMValueRef rhs, unsigned int* mask, unsigned int width);
+
+LLVMValueRef type_vector_reduce(type_t* type, LLVMBuilderRef builder, reduce_op_t op, LLVMValueRef val);
+
+#endif